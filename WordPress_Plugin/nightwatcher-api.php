@@ -2,12 +2,19 @@
 /*
 Plugin Name: NightWatcher Simple Block with DB and REST API
 Description: Displays "NightWatcher" in a block, provides a setup page to verify a dedicated MySQL database and user, creates a table, and receives data via REST API.
-Version: 1.3
+Version: 1.5
 Author: NightWatcher Team
 */
 
 if (!defined('ABSPATH')) exit;
 
+// Largest number of readings accepted by one /submit_batch request
+define('NIGHTWATCHER_MAX_BATCH', 1000);
+// Rows per multi-row INSERT statement (keeps statements well under max_allowed_packet)
+define('NIGHTWATCHER_INSERT_ROWS', 250);
+// Largest decompressed body accepted from a gzip-encoded /submit_batch request
+define('NIGHTWATCHER_MAX_BODY', 4 * 1024 * 1024);
+
 // --- Block Registration ---
 function nightwatcher_register_block() {
     if (!function_exists('register_block_type')) return;
@@ -139,6 +146,12 @@ add_action('rest_api_init', function() {
             'humidity' => ['required' => true, 'type' => 'number'],
         ],
     ]);
+    // Bulk ingest: the body is a JSON array of readings in the same format as /submit
+    register_rest_route('nightwatcher/v1', '/submit_batch', [
+        'methods' => 'POST',
+        'callback' => 'nightwatcher_receive_batch',
+        'permission_callback' => 'nightwatcher_api_auth',
+    ]);
 });
 
 function nightwatcher_api_auth($request) {
@@ -189,3 +202,84 @@ function nightwatcher_receive_data($request) {
         return new WP_Error('db_insert_error', 'Could not insert data.', ['status' => 500]);
     }
 }
+
+// Checks one reading from a batch and returns its column values in insert order, or null if invalid
+function nightwatcher_batch_row($reading) {
+    if (!is_array($reading)) return null;
+    foreach (['datetime', 'site_name'] as $key) {
+        if (!isset($reading[$key]) || !is_string($reading[$key]) || $reading[$key] === '') return null;
+    }
+    $row = [$reading['datetime'], $reading['site_name']];
+    foreach (['latitude', 'longitude', 'mpsqa', 'temperature', 'pressure', 'humidity'] as $key) {
+        if (!isset($reading[$key]) || !is_numeric($reading[$key])) return null;
+        $row[] = (float)$reading[$key];
+    }
+    return $row;
+}
+
+function nightwatcher_receive_batch($request) {
+    $encoding = strtolower(trim((string)$request->get_header('content_encoding')));
+    if ($encoding === 'gzip') {
+        // WordPress does not decode request bodies, so a compressed array is unpacked here
+        $body = gzdecode($request->get_body(), NIGHTWATCHER_MAX_BODY);
+        if ($body === false) {
+            return new WP_Error('invalid_encoding', 'Could not decompress gzip body.', ['status' => 400]);
+        }
+        $readings = json_decode($body, true);
+    } elseif ($encoding === '' || $encoding === 'identity') {
+        $readings = $request->get_json_params();
+    } else {
+        return new WP_Error('unsupported_encoding', 'Unsupported Content-Encoding.', ['status' => 415]);
+    }
+    if (!is_array($readings) || empty($readings) || array_keys($readings) !== range(0, count($readings) - 1)) {
+        return new WP_Error('invalid_batch', 'Expected a JSON array of readings.', ['status' => 400]);
+    }
+    if (count($readings) > NIGHTWATCHER_MAX_BATCH) {
+        return new WP_Error('batch_too_large', 'At most ' . NIGHTWATCHER_MAX_BATCH . ' readings per request.', ['status' => 413]);
+    }
+    // Validate everything before touching the database so a bad reading rejects the whole batch
+    $rows = [];
+    foreach ($readings as $index => $reading) {
+        $row = nightwatcher_batch_row($reading);
+        if ($row === null) {
+            return new WP_Error('invalid_reading', "Reading $index is missing a field or has a field of the wrong type.", ['status' => 400]);
+        }
+        $rows[] = $row;
+    }
+
+    $db_name = get_option('nightwatcher_db_name');
+    $db_user = get_option('nightwatcher_db_user');
+    $db_pass = get_option('nightwatcher_db_pass');
+    $dbhost = DB_HOST;
+    $mysqli = new mysqli($dbhost, $db_user, $db_pass, $db_name);
+    if ($mysqli->connect_errno) {
+        return new WP_Error('db_connect_error', 'Could not connect to NightWatcher DB.', ['status' => 500]);
+    }
+    // One transaction, a few multi-row INSERTs: the batch is stored completely or not at all
+    $mysqli->begin_transaction();
+    $ok = true;
+    foreach (array_chunk($rows, NIGHTWATCHER_INSERT_ROWS) as $chunk) {
+        $placeholders = implode(', ', array_fill(0, count($chunk), '(?, ?, ?, ?, ?, ?, ?, ?)'));
+        $stmt = $mysqli->prepare("INSERT INTO nightwatcher_data (datetime, site_name, latitude, longitude, mpsqa, temperature, pressure, humidity) VALUES $placeholders");
+        if (!$stmt) {
+            $ok = false;
+            break;
+        }
+        $values = array_merge(...$chunk);
+        $stmt->bind_param(str_repeat('ssdddddd', count($chunk)), ...$values);
+        $ok = $stmt->execute();
+        $stmt->close();
+        if (!$ok) break;
+    }
+    if ($ok) {
+        $ok = $mysqli->commit();
+    } else {
+        $mysqli->rollback();
+    }
+    $mysqli->close();
+    if ($ok) {
+        return ['success' => true, 'inserted' => count($rows)];
+    } else {
+        return new WP_Error('db_insert_error', 'Could not insert data.', ['status' => 500]);
+    }
+}
@@ -0,0 +1,189 @@
+/*
+ * Project: NightWatcher
+ * File: command_bench.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * Control command benchmark: drives handle_command on one thread, as the control server's
+ * event loop does, for dt, dt <n>, dt bin, and status against published snapshots of
+ * several devices. dt is timed twice: served from the per-device record cache, and with
+ * the cache invalidated before every command so each one serializes the record again, as
+ * every dt did before the cache. Reports nanoseconds per command and commands per core-second.
+ * Exits nonzero if a cached record differs from a freshly serialized one.
+ */
+// main.h declares the daemon's int main(void); rename that declaration so this program can take arguments
+#define main nightwatcher_main
+#include "nightwatcher.h"
+#undef main
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define BENCH_DEVICES 4
+
+// The export and reload commands need librrd and the daemon's worker pool; the bench never sends them
+DBExport *db_export_open(const char *dbName, time_t start, time_t end, const char *cf, unsigned long step, bool binary,
+                         int gzip_level) {
+    (void)dbName; (void)start; (void)end; (void)cf; (void)step; (void)binary; (void)gzip_level;
+    return NULL;
+}
+
+int queue_site_config_reload(void) {
+    return -1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Publishes a site with BENCH_DEVICES devices, their readings, and the weather, with
+ * values of the size a real site has.
+ */
+static void publish_site(SQM_LE_Device *devs, AW_WeatherData *weather) {
+    GlobalConfig *cfg = site_config_alloc();
+    strcpy(cfg->siteName, "Kitt Peak Dark Sky Site");
+    cfg->latitude = 31.9583f;
+    cfg->longitude = -111.5967f;
+    cfg->elevation = 2096.0f;
+    strcpy(cfg->sqmIP, "192.168.1.40");
+    cfg->sqmPort = 10001;
+    strcpy(cfg->dbName, "./nightwatcher.rrd");
+    cfg->readingInterval = 60;
+    cfg->controlPort = 8080;
+    cfg->sqmHeartbeatInterval = 30;
+    cfg->sqmReadTimeout = 5;
+    cfg->enableReadOnStartup = true;
+    cfg->AmbientWeatherUpdateInterval = 300;
+    strcpy(cfg->AmbientWeatherAPIKey, "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+    strcpy(cfg->AmbientWeatherAppKey, "fedcba9876543210fedcba9876543210fedcba9876543210fedcba9876543210");
+    cfg->enableWeather = true;
+    cfg->numDevices = BENCH_DEVICES;
+    for (int i = 0; i < BENCH_DEVICES; ++i) {
+        snprintf(cfg->devices[i].name, sizeof(cfg->devices[i].name), "sqm%d", i);
+        snprintf(cfg->devices[i].ip, sizeof(cfg->devices[i].ip), "192.168.1.%d", 40 + i);
+        cfg->devices[i].port = 10001;
+        snprintf(cfg->devices[i].dbName, sizeof(cfg->devices[i].dbName), "./sqm%d.rrd", i);
+
+        SQM_LE_Device *d = &devs[i];
+        memset(d, 0, sizeof(*d));
+        strcpy(d->ip, cfg->devices[i].ip);
+        d->port = 10001;
+        d->socket_fd = -1;
+        d->sqmModel = 3;
+        d->sqmSerial = 2921 + i;
+        d->healthy = true;
+        d->reading_ready = true;
+        d->calibration = 19.86f;
+        d->mpsqa = 21.37f + i / 100.0f;
+        d->sensorFreq = 22921;
+        d->sensorPeriodCount = 20;
+        d->sensorTemp = 12.5f;
+        snprintf(d->last_reading, sizeof(d->last_reading), "r, %05.2fm,0000022921Hz,0000000020c,0000000.000s, 012.5C", d->mpsqa);
+        strcpy(d->last_reading_timestamp, "2026-10-18 03:14:15");
+        snprintf(d->unit_info, sizeof(d->unit_info), "i,00000004,00000003,00000023,%08d", d->sqmSerial);
+        snapshot_publish_device(i, d);
+    }
+    site_config_publish(cfg);
+    snapshot_set_sqm_read(true);
+
+    memset(weather, 0, sizeof(*weather));
+    weather->temperature_f = 48.2;
+    weather->humidity = 31.0;
+    weather->wind_speed_mph = 3.4;
+    weather->wind_gust_mph = 7.9;
+    weather->pressure_in = 23.01;
+    weather->rainfall_in = 0.0;
+    strcpy(weather->timestamp, "2026-10-18T03:10:00.000Z");
+    weather->weatherReady = true;
+    snapshot_publish_weather(weather);
+}
+
+/*
+ * Runs cmd iterations times and returns nanoseconds per command. With invalidate set, the
+ * dt cache is invalidated before every command, so each dt serializes its record again.
+ */
+static double time_command(const char *cmd, int iterations, bool invalidate, char *response, size_t response_size,
+                           GlobalConfig *site, SQM_LE_Device *devs, AW_WeatherData *weather) {
+    size_t total = 0;
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        if (invalidate) snapshot_site_changed();
+        total += handle_command(cmd, response, response_size, site, devs, weather);
+    }
+    double ns = (double)(now_ns() - start) / iterations;
+    if (total == 0) fprintf(stderr, "%s: empty responses\n", cmd);
+    return ns;
+}
+
+/*
+ * Checks that the cached record for cmd is the one a fresh serialization produces.
+ * Returns 0 if they match.
+ */
+static int check_cache(const char *cmd, char *response, char *fresh, size_t size,
+                       GlobalConfig *site, SQM_LE_Device *devs, AW_WeatherData *weather) {
+    size_t cached_len = handle_command(cmd, response, size, site, devs, weather);
+    snapshot_site_changed();
+    size_t fresh_len = handle_command(cmd, fresh, size, site, devs, weather);
+    if (cached_len == 0 || cached_len != fresh_len || memcmp(response, fresh, cached_len) != 0) {
+        fprintf(stderr, "%s: cached record differs from a fresh one\n", cmd);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 200000;
+    int c;
+    while ((c = getopt(argc, argv, "n:h")) != -1) {
+        switch (c) {
+        case 'n': iterations = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-n ITERATIONS] (default 200000 per command)\n", argv[0]);
+            return c == 'h' ? 0 : 2;
+        }
+    }
+    if (iterations < 1) return 2;
+
+    static SQM_LE_Device devs[BENCH_DEVICES];
+    AW_WeatherData weather;
+    publish_site(devs, &weather);
+    GlobalConfig *site = site_config_acquire();
+    char *response = malloc(CONTROL_RESPONSE_SIZE);
+    char *fresh = malloc(CONTROL_RESPONSE_SIZE);
+    if (!response || !fresh) return 1;
+
+    int failures = 0;
+    failures += check_cache("dt", response, fresh, CONTROL_RESPONSE_SIZE, site, devs, &weather);
+    failures += check_cache("dt 3", response, fresh, CONTROL_RESPONSE_SIZE, site, devs, &weather);
+    failures += check_cache("dt bin 2", response, fresh, CONTROL_RESPONSE_SIZE, site, devs, &weather);
+
+    static const struct {
+        const char *label;
+        const char *cmd;
+        bool invalidate;
+    } rows[] = {
+        { "dt (serialized each time)", "dt", true },
+        { "dt (cached)", "dt", false },
+        { "dt 3 (serialized each time)", "dt 3", true },
+        { "dt 3 (cached)", "dt 3", false },
+        { "dt bin (cached)", "dt bin", false },
+        { "status", "status", false },
+    };
+    printf("iterations: %d per command, %d devices, one thread\n", iterations, BENCH_DEVICES);
+    printf("%-28s %12s %16s\n", "command", "ns/command", "per core-second");
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); ++i) {
+        double ns = time_command(rows[i].cmd, iterations, rows[i].invalidate, response, CONTROL_RESPONSE_SIZE,
+                                 site, devs, &weather);
+        printf("%-28s %12.1f %16.0f\n", rows[i].label, ns, 1e9 / ns);
+    }
+
+    site_config_release(site);
+    free(response);
+    free(fresh);
+    return failures ? 1 : 0;
+}
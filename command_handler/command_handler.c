@@ -9,6 +9,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <strings.h>
+#include <time.h>
 
 // Helper: trim leading/trailing whitespace in place
 static void trim_whitespace(char *str) {
@@ -24,12 +26,21 @@ static void trim_whitespace(char *str) {
 // Command: status
 // Return the overall status of the site.
 // Return formation should be Status:[parameter]:[value]\n 
-void command_status(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
-    (void)words; (void)nwords; (void)dev;
+static size_t command_status(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)words; (void)nwords;
     char temp[256];
+    // Report the published state of the primary device and the weather
+    SQM_LE_Device dev_copy;
+    AW_WeatherData weather_copy;
+    snapshot_read_device(0, &dev_copy);
+    if (dev) dev = &dev_copy;
+    if (weatherData) {
+        snapshot_read_weather(&weather_copy);
+        weatherData = &weather_copy;
+    }
     if (site) {
-        snprintf(response, response_size, "Status:SQM Enabled:%s\n", site->enableSQMread ? "true" : "false");
-        snprintf(temp, sizeof(temp),"Status:SQM Healthy:%s\n", site->sqmHealthy ? "true" : "false");
+        snprintf(response, response_size, "Status:SQM Enabled:%s\n", snapshot_sqm_read() ? "true" : "false");
+        snprintf(temp, sizeof(temp),"Status:SQM Healthy:%s\n", dev_copy.healthy ? "true" : "false");
         strcat(response, temp);
     } else {
         snprintf(response, response_size, "Status:Site Initialized:false\n");
@@ -49,13 +60,20 @@ void command_status(char *words[], int nwords, char *response, size_t response_s
         snprintf(temp, sizeof(temp), "Status:Weather Initialized:false\n");
         strcat(response, temp);
     }
+    return strlen(response);
 }
 
 // Command: show
-void command_show(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+static size_t command_show(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
     (void)words; (void)nwords; (void)site; (void)dev; (void)weatherData;
 //  snprintf(response, response_size, "Show: Not implemented");
     if(site && dev) {
+        SQM_LE_Device dev_copy;
+        AW_WeatherData weather_copy;
+        snapshot_read_device(0, &dev_copy);
+        snapshot_read_weather(&weather_copy);
+        dev = &dev_copy;
+        weatherData = &weather_copy;
         if (strcmp(words[1], "reading") == 0) {
           if (dev->reading_ready) {
             snprintf(response, response_size, "Reading: %s\n", dev->last_reading); 
@@ -81,55 +99,88 @@ void command_show(char *words[], int nwords, char *response, size_t response_siz
         }
 
     }
+    return strlen(response);
 }
 
 // Command: set
-void command_set(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev) {
+static size_t command_set(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)weatherData;
     (void)words; (void)nwords; (void)site; (void)dev;
     snprintf(response, response_size, "Set: Not implemented");
+    return strlen(response);
 }
 
 // Command: start
-void command_start(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev) {
+static size_t command_start(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)weatherData;
     (void)words; (void)nwords; (void)site; (void)dev;
-    if (site->enableSQMread == false) {
-        site->enableSQMread = true;
-    }
+    snapshot_set_sqm_read(true);
     snprintf(response, response_size, "Start: SQM read enabled\n");
+    return strlen(response);
 }
 
 // Command: stop
-void command_stop(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev) {
+static size_t command_stop(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)weatherData;
     (void)words; (void)nwords; (void)site; (void)dev;
-    if (site->enableSQMread == true) {
-        site->enableSQMread = false;
-    }
+    snapshot_set_sqm_read(false);
     snprintf(response, response_size, "Stop: SQM read disabled\n");
+    return strlen(response);
 }
 
-// Command: db
-void command_db(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev) {
+// Command: reload
+// Queues a re-read of the configuration file, as SIGHUP does. The result is logged and
+// pushed to subscribers as a Reload event.
+static size_t command_reload(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)weatherData;
     (void)words; (void)nwords; (void)site; (void)dev;
-    snprintf(response, response_size, "DB: Not implemented");
+    int ret = queue_site_config_reload();
+    snprintf(response, response_size, "Reload: %s\n", ret == 0 ? "queued" : ret > 0 ? "already queued" : "failed: worker queue full");
+    return strlen(response);
+}
+
+// Helper: parse a db range time; values <= 0 are seconds relative to now
+static time_t parse_db_time(const char *word, time_t now) {
+    long long value = strtoll(word, NULL, 10);
+    return value <= 0 ? now + (time_t)value : (time_t)value;
+}
+
+// Command: db
+// db last <n>            - newest n readings from the in-memory history
+// db range <start> <end> - readings with start <= time <= end (UNIX seconds; 0 or negative = relative to now)
+// Each reading is returned as DB:<time>,<device>,<mpsqa>,<sensorTemp>,<siteTemp>,<sitePressure>,<siteHumidity>\n
+// (device -1 is a weather update). Served from memory with no disk access.
+static size_t command_db(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)weatherData;
+    (void)site; (void)dev;
+    int count = -2;
+    if (nwords == 3 && strcmp(words[1], "last") == 0) {
+        count = history_format_last((unsigned int)strtoul(words[2], NULL, 10), response, response_size);
+    } else if (nwords == 4 && strcmp(words[1], "range") == 0) {
+        time_t now = time(NULL);
+        count = history_format_range(parse_db_time(words[2], now), parse_db_time(words[3], now), response, response_size);
+    }
+    if (count == -2) {
+        snprintf(response, response_size, "DB: Usage: db last <n> | db range <start> <end> | db export <start> <end> [options]\n");
+    } else if (count == -1) {
+        snprintf(response, response_size, "DB: History not available\n");
+    } else if (count == 0 && response[0] == '\0') {
+        snprintf(response, response_size, "DB: No readings\n");
+    }
+    return strlen(response);
 }
 
 // Command: quit
-void command_quit(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev) {
+static size_t command_quit(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)weatherData;
     (void)words; (void)nwords; (void)site; (void)dev;
     snprintf(response, response_size, "Quit: Exiting NightWatcher gracefully\n");
     exit(0);
 }
 
-// Helper: ensure all char arrays in structs are null-terminated and safe for snprintf
-static void sanitize_structs(GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
-    // GlobalConfig
-    site->siteName[sizeof(site->siteName)-1] = '\0';
-    site->sqmIP[sizeof(site->sqmIP)-1] = '\0';
-    site->dbName[sizeof(site->dbName)-1] = '\0';
-    site->AmbientWeatherAPIKey[sizeof(site->AmbientWeatherAPIKey)-1] = '\0';
-    site->AmbientWeatherAppKey[sizeof(site->AmbientWeatherAppKey)-1] = '\0';
-    site->AmbientWeatherDeviceMAC[sizeof(site->AmbientWeatherDeviceMAC)-1] = '\0';
-    site->AmbientWeatherEncodedMAC[sizeof(site->AmbientWeatherEncodedMAC)-1] = '\0';
+// Helper: ensure the char arrays in snapshot copies are null-terminated and safe for snprintf.
+// Only ever called on private copies; the GlobalConfig strings are terminated by read_config.
+static void sanitize_copies(SQM_LE_Device *dev, AW_WeatherData *weatherData) {
     // SQM_LE_Device
     dev->ip[sizeof(dev->ip)-1] = '\0';
     dev->last_reading[sizeof(dev->last_reading)-1] = '\0';
@@ -138,27 +189,40 @@ static void sanitize_structs(GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherD
     weatherData->timestamp[sizeof(weatherData->timestamp)-1] = '\0';
 }
 
-// command: dt - Data Transmit - transmit all data to the client
-void command_dt(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
-    (void)words; (void)nwords; (void)site; (void)dev; (void)weatherData;
-    sanitize_structs(site, dev, weatherData);
+// Helper: the device whose health, model, and serial the dt record reports for the site.
+// That is the primary device (index 0); copy receives its snapshot when dev is another one.
+static const SQM_LE_Device *site_device(int index, const SQM_LE_Device *dev, SQM_LE_Device *copy) {
+    if (index == 0) return dev;
+    snapshot_read_device(0, copy);
+    return copy;
+}
+
+/*
+ * Serializes all site, device, and weather data for device index as the comma-separated dt record.
+ * Used by the dt command and for events pushed to control-port subscribers.
+ * dev and weatherData must be snapshot copies (see snapshot_read_device), never the live structs.
+ */
+void serialize_dt(char *response, size_t response_size, GlobalConfig *site, int index, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    sanitize_copies(dev, weatherData);
+    SQM_LE_Device primary_copy;
+    const SQM_LE_Device *primary = site_device(index, dev, &primary_copy);
     // Debug: build response incrementally, one variable at a time
     size_t offset = 0;
     offset += snprintf(response + offset, response_size - offset, "%s,", site->siteName);
     offset += snprintf(response + offset, response_size - offset, "%f,", site->latitude);
     offset += snprintf(response + offset, response_size - offset, "%f,", site->longitude);
     offset += snprintf(response + offset, response_size - offset, "%f,", site->elevation);
-    offset += snprintf(response + offset, response_size - offset, "%d,", site->sqmModel);
-    offset += snprintf(response + offset, response_size - offset, "%d,", site->sqmSerial);
+    offset += snprintf(response + offset, response_size - offset, "%d,", primary->sqmModel);
+    offset += snprintf(response + offset, response_size - offset, "%d,", primary->sqmSerial);
     offset += snprintf(response + offset, response_size - offset, "%s,", site->sqmIP);
     offset += snprintf(response + offset, response_size - offset, "%u,", site->sqmPort);
     offset += snprintf(response + offset, response_size - offset, "%s,", site->dbName);
     offset += snprintf(response + offset, response_size - offset, "%u,", site->readingInterval);
     offset += snprintf(response + offset, response_size - offset, "%u,", site->controlPort);
-    offset += snprintf(response + offset, response_size - offset, "%s,", site->sqmHealthy ? "true" : "false");
+    offset += snprintf(response + offset, response_size - offset, "%s,", primary->healthy ? "true" : "false");
     offset += snprintf(response + offset, response_size - offset, "%u,", site->sqmHeartbeatInterval);
     offset += snprintf(response + offset, response_size - offset, "%u,", site->sqmReadTimeout);
-    offset += snprintf(response + offset, response_size - offset, "%s,", site->enableSQMread ? "true" : "false");
+    offset += snprintf(response + offset, response_size - offset, "%s,", snapshot_sqm_read() ? "true" : "false");
     offset += snprintf(response + offset, response_size - offset, "%s,", site->enableReadOnStartup ? "true" : "false");
     offset += snprintf(response + offset, response_size - offset, "%u,", site->AmbientWeatherUpdateInterval);
     offset += snprintf(response + offset, response_size - offset, "%s,", site->AmbientWeatherAPIKey);
@@ -190,41 +254,267 @@ void command_dt(char *words[], int nwords, char *response, size_t response_size,
     offset += snprintf(response + offset, response_size - offset, "%d", weatherData->weatherReady ? 1 : 0);
     response[response_size-1] = '\0';
 }
+
 /*
- * Handles a command string received over TCP and writes a response to the response buffer.
- * Uses parse_fields from parser.c to split the command into words, trims each word, and dispatches.
+ * Encodes the dt record for device index in its binary form (see dt_record.h).
+ * dev and weatherData must be snapshot copies, as for serialize_dt.
+ * Returns the record length, or 0 if buf is too small.
  */
-void handle_command(const char *cmd, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+size_t serialize_dt_bin(void *buf, size_t buf_size, GlobalConfig *site, int index, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    sanitize_copies(dev, weatherData);
+    size_t name_len = strnlen(site->siteName, DT_RECORD_MAX_NAME);
+    size_t ip_len = strnlen(dev->ip, sizeof(dev->ip));
+    if (buf_size < sizeof(DtRecord) + name_len + ip_len) return 0;
+    SQM_LE_Device primary_copy;
+    const SQM_LE_Device *primary = site_device(index, dev, &primary_copy);
+    DtRecord *rec = (DtRecord *)buf;
+    memset(rec, 0, sizeof(*rec));
+    rec->flags = (primary->healthy ? DT_FLAG_SITE_HEALTHY : 0) |
+                 (snapshot_sqm_read() ? DT_FLAG_SQM_READ : 0) |
+                 (site->enableReadOnStartup ? DT_FLAG_READ_ON_STARTUP : 0) |
+                 (site->enableWeather ? DT_FLAG_WEATHER : 0) |
+                 (site->enableDataSend ? DT_FLAG_DATA_SEND : 0) |
+                 (dev->reading_ready ? DT_FLAG_READING_READY : 0) |
+                 (dev->healthy ? DT_FLAG_DEVICE_HEALTHY : 0) |
+                 (weatherData->weatherReady ? DT_FLAG_WEATHER_READY : 0);
+    rec->device_index = (uint16_t)index;
+    rec->num_devices = (uint16_t)site->numDevices;
+    rec->latitude = site->latitude;
+    rec->longitude = site->longitude;
+    rec->elevation = site->elevation;
+    rec->reading_interval = site->readingInterval;
+    rec->heartbeat_interval = site->sqmHeartbeatInterval;
+    rec->read_timeout = site->sqmReadTimeout;
+    rec->weather_interval = site->AmbientWeatherUpdateInterval;
+    rec->control_port = site->controlPort;
+    rec->sqm_port = dev->port;
+    rec->sqm_model = dev->sqmModel;
+    rec->sqm_serial = dev->sqmSerial;
+    rec->calibration = dev->calibration;
+    rec->mpsqa = dev->mpsqa;
+    rec->sensor_freq = dev->sensorFreq;
+    rec->sensor_period_count = dev->sensorPeriodCount;
+    rec->sensor_period_secs = dev->sensorPeriodSecs;
+    rec->sensor_temp = dev->sensorTemp;
+    rec->temperature_f = weatherData->temperature_f;
+    rec->humidity = weatherData->humidity;
+    rec->wind_speed_mph = weatherData->wind_speed_mph;
+    rec->wind_gust_mph = weatherData->wind_gust_mph;
+    rec->pressure_in = weatherData->pressure_in;
+    rec->rainfall_in = weatherData->rainfall_in;
+    strncpy(rec->reading_timestamp, dev->last_reading_timestamp, sizeof(rec->reading_timestamp) - 1);
+    strncpy(rec->weather_timestamp, weatherData->timestamp, sizeof(rec->weather_timestamp) - 1);
+    char *names = (char *)buf + sizeof(DtRecord);
+    memcpy(names, site->siteName, name_len);
+    memcpy(names + name_len, dev->ip, ip_len);
+    return dt_record_finish(rec, name_len, ip_len);
+}
+
+// Serialized dt records, one per device, rebuilt only when the device, the weather, the
+// site config, or the site state they show have been published again. Used only by the
+// control-server thread.
+typedef struct {
+    bool valid;
+    unsigned int device_version;
+    unsigned int weather_version;
+    unsigned int site_generation; // site_config_generation of the config it was built from
+    unsigned int site_version;    // snapshot_site_version: primary device health, start/stop
+    size_t len;
+    char text[DT_CACHE_SIZE];
+    size_t bin_len;
+    unsigned char bin[DT_CACHE_SIZE];
+} DtCache;
+
+static DtCache dt_cache[NW_MAX_DEVICES];
+
+// command: dt - Data Transmit - transmit all data to the client
+// "dt <n>" transmits the record for device n; plain "dt" uses the primary device.
+// "dt bin [n]" transmits the same record in the binary form described in dt_record.h.
+// The device and weather come from their published snapshots, so every field is from one update.
+static size_t command_dt(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)dev; (void)weatherData;
+    bool binary = nwords > 1 && strcasecmp(words[1], "bin") == 0;
+    int arg = binary ? 2 : 1;
+    int index = 0;
+    if (nwords > arg) index = atoi(words[arg]);
+    if (index < 0 || index >= site->numDevices) {
+        snprintf(response, response_size, "DT: No such device\n");
+        return strlen(response);
+    }
+    DtCache *cache = &dt_cache[index];
+    // The config is keyed by its own generation, so a reload published after the caller
+    // acquired site cannot be cached as current. Versions are read before the state they cover.
+    unsigned int site_generation = site_config_generation(site);
+    unsigned int site_version = snapshot_site_version();
+    if (!cache->valid || cache->device_version != snapshot_device_version(index) ||
+        cache->weather_version != snapshot_weather_version() ||
+        cache->site_generation != site_generation || cache->site_version != site_version) {
+        SQM_LE_Device dev_copy;
+        AW_WeatherData weather_copy;
+        cache->device_version = snapshot_read_device(index, &dev_copy);
+        cache->weather_version = snapshot_read_weather(&weather_copy);
+        cache->site_generation = site_generation;
+        cache->site_version = site_version;
+        serialize_dt(cache->text, sizeof(cache->text), site, index, &dev_copy, &weather_copy);
+        cache->len = strlen(cache->text);
+        cache->bin_len = serialize_dt_bin(cache->bin, sizeof(cache->bin), site, index, &dev_copy, &weather_copy);
+        cache->valid = true;
+    }
+    const void *record = binary ? (const void *)cache->bin : (const void *)cache->text;
+    size_t len = binary ? cache->bin_len : cache->len;
+    if (len >= response_size) len = response_size - 1;
+    memcpy(response, record, len);
+    response[len] = '\0';
+    return len;
+}
+
+// Command: metrics
+// Operation counts and latency percentiles since start, plus current gauges:
+// Metric:<op>:count=..:ok=..:fail=..:timeout=..:mean_us=..:p50_us=..:p90_us=..:p99_us=..:p999_us=..:max_us=..\n
+// Gauge:<name>:<value>\n
+static size_t command_metrics(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)words; (void)nwords; (void)site; (void)dev; (void)weatherData;
+    return metrics_format(response, response_size);
+}
+
+// Command: devices
+// Lists every configured SQM-LE, one per line:
+// Device:<index>:<name>:<ip>:<port>:<healthy>:<reading ready>:<mpsqa>:<sensorTemp>\n
+static size_t command_devices(char *words[], int nwords, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    (void)weatherData;
+    (void)words; (void)nwords; (void)dev;
+    size_t offset = 0;
+    response[0] = '\0';
+    for (int i = 0; i < site->numDevices && offset < response_size; ++i) {
+        SQM_LE_Device d;
+        snapshot_read_device(i, &d);
+        offset += snprintf(response + offset, response_size - offset, "Device:%d:%s:%s:%u:%s:%s:%f:%f\n",
+                           i, site->devices[i].name, site->devices[i].ip, site->devices[i].port,
+                           d.healthy ? "true" : "false", d.reading_ready ? "true" : "false",
+                           d.mpsqa, d.sensorTemp);
+    }
+    return strlen(response);
+}
+/*
+ * Recognizes "db export <start> <end> [csv|binary] [average|min|max] [step=<seconds>] [gzip[=<level>]] [device]"
+ * and opens the export. The options may come in any order. Times are parsed like "db range".
+ * The export itself is streamed by the control server.
+ * Returns 0 if cmd is not an export command; otherwise 1, with *export set on success or
+ * an error message written to response.
+ */
+int command_db_export(const char *cmd, char *response, size_t response_size, GlobalConfig *site, DBExport **export) {
+    // Every command passes through here first; skip the split unless it starts with "db"
+    while (isspace((unsigned char)*cmd)) cmd++;
+    if (strncasecmp(cmd, "db", 2) != 0 || !isspace((unsigned char)cmd[2])) return 0;
     char word_bufs[8][64];
     char *words[8] = { word_bufs[0], word_bufs[1], word_bufs[2], word_bufs[3], word_bufs[4], word_bufs[5], word_bufs[6], word_bufs[7] };
     int nwords = parse_fields(cmd, ' ', words, 8, 64);
     for (int i = 0; i < nwords; ++i) {
         trim_whitespace(words[i]);
+        for (char *p = words[i]; *p; ++p) *p = tolower((unsigned char)*p);
+    }
+    if (nwords < 2 || strcmp(words[0], "db") != 0 || strcmp(words[1], "export") != 0) return 0;
+    *export = NULL;
+    if (nwords < 4) {
+        snprintf(response, response_size, "DB: Usage: db export <start> <end> [csv|binary] [average|min|max] [step=<seconds>] [gzip[=<level>]] [device]\n");
+        return 1;
+    }
+    bool binary = false;
+    const char *cf = "AVERAGE";
+    unsigned long step = 0;
+    int gzip_level = 0;
+    int index = 0;
+    for (int i = 4; i < nwords; ++i) {
+        if (strcmp(words[i], "binary") == 0) binary = true;
+        else if (strcmp(words[i], "csv") == 0) binary = false;
+        else if (strcmp(words[i], "average") == 0) cf = "AVERAGE";
+        else if (strcmp(words[i], "min") == 0) cf = "MIN";
+        else if (strcmp(words[i], "max") == 0) cf = "MAX";
+        else if (strncmp(words[i], "step=", 5) == 0) step = strtoul(words[i] + 5, NULL, 10);
+        else if (strcmp(words[i], "gzip") == 0) gzip_level = DB_EXPORT_GZIP_LEVEL;
+        else if (strncmp(words[i], "gzip=", 5) == 0) gzip_level = atoi(words[i] + 5);
+        else index = atoi(words[i]);
+    }
+    if (index < 0 || index >= site->numDevices) {
+        snprintf(response, response_size, "DB: No such device\n");
+        return 1;
     }
-    if (nwords == 0 || strlen(words[0]) == 0) {
+    time_t now = time(NULL);
+    *export = db_export_open(site->devices[index].dbName, parse_db_time(words[2], now), parse_db_time(words[3], now),
+                             cf, step, binary, gzip_level);
+    if (!*export) snprintf(response, response_size, "DB: Export failed\n");
+    return 1;
+}
+
+// Returns the length of the response written; binary responses may contain NUL bytes
+typedef size_t (*CommandFn)(char *words[], int nwords, char *response, size_t response_size,
+                          GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData);
+
+typedef struct {
+    const char *name;
+    CommandFn fn;
+} CommandEntry;
+
+// Sorted by name for bsearch
+static const CommandEntry command_table[] = {
+    { "db",      command_db },
+    { "devices", command_devices },
+    { "dt",      command_dt },
+    { "metrics", command_metrics },
+    { "quit",    command_quit },
+    { "reload",  command_reload },
+    { "set",     command_set },
+    { "show",    command_show },
+    { "start",   command_start },
+    { "status",  command_status },
+    { "stop",    command_stop },
+};
+
+static int command_entry_compare(const void *key, const void *entry) {
+    return strcmp((const char *)key, ((const CommandEntry *)entry)->name);
+}
+
+// Helper: split line in place at runs of whitespace. Unused word slots point at "".
+static int split_words(char *line, char *words[], int max_words) {
+    int nwords = 0;
+    char *p = line;
+    while (*p && nwords < max_words) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        words[nwords++] = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        if (*p) *p++ = '\0';
+    }
+    for (int i = nwords; i < max_words; ++i) words[i] = "";
+    return nwords;
+}
+
+/*
+ * Handles a command string received over TCP and writes a response to the response buffer.
+ * The command is split into words in one local copy and routed through command_table.
+ * Returns the response length; "dt bin" responses are binary and may contain NUL bytes.
+ */
+size_t handle_command(const char *cmd, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    char line[CONTROL_READ_BUF_SIZE];
+    char *words[COMMAND_MAX_WORDS];
+    uint64_t start = metrics_now();
+    snprintf(line, sizeof(line), "%s", cmd);
+    int nwords = split_words(line, words, COMMAND_MAX_WORDS);
+    if (nwords == 0) {
         snprintf(response, response_size, "No command received");
-        return;
+        return strlen(response);
     }
     // Normalize first word to lowercase
     for (char *p = words[0]; *p; ++p) *p = tolower((unsigned char)*p);
-    printf("[DEBUG] Command word: '%s'\n", words[0]);
-    if (strcmp(words[0], "status") == 0) {
-        command_status(words, nwords, response, response_size, site, dev, weatherData);
-    } else if (strcmp(words[0], "show") == 0) {
-        command_show(words, nwords, response, response_size, site, dev, weatherData);
-    } else if (strcmp(words[0], "set") == 0) {
-        command_set(words, nwords, response, response_size, site, dev);
-    } else if (strcmp(words[0], "start") == 0) {
-        command_start(words, nwords, response, response_size, site, dev);
-    } else if (strcmp(words[0], "stop") == 0) {
-        command_stop(words, nwords, response, response_size, site, dev);
-    } else if (strcmp(words[0], "db") == 0) {
-        command_db(words, nwords, response, response_size, site, dev);
-    } else if (strcmp(words[0], "quit") == 0) {
-        command_quit(words, nwords, response, response_size, site, dev);
-    } else if (strcmp(words[0], "dt") == 0) {
-        command_dt(words, nwords, response, response_size, site, dev, weatherData);
+    const CommandEntry *entry = bsearch(words[0], command_table, sizeof(command_table) / sizeof(command_table[0]),
+                                        sizeof(command_table[0]), command_entry_compare);
+    size_t len;
+    if (entry) {
+        len = entry->fn(words, nwords, response, response_size, site, dev, weatherData);
     } else {
         snprintf(response, response_size, "Unknown command: %s", words[0]);
+        len = strlen(response);
     }
+    metrics_record(METRIC_COMMAND, start, entry ? METRIC_OK : METRIC_FAIL);
+    return len;
 }
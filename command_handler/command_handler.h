@@ -9,7 +9,21 @@
 
 #include <stddef.h>
 
+#define COMMAND_MAX_WORDS 8     // Words of a command passed to its handler
+#define DT_CACHE_SIZE     2048  // Largest cached dt record
+
 // Handles a command string received over TCP and writes a response to the response buffer.
-void handle_command(const char *cmd, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData);
+// Returns the response length, which callers must use instead of strlen (binary responses contain NULs).
+size_t handle_command(const char *cmd, char *response, size_t response_size, GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData);
+
+// Serializes all site, device, and weather data for device index as the comma-separated dt record.
+void serialize_dt(char *response, size_t response_size, GlobalConfig *site, int index, SQM_LE_Device *dev, AW_WeatherData *weatherData);
+
+// Encodes the dt record for device index as a binary DtRecord. Returns its length, or 0 if buf is too small.
+size_t serialize_dt_bin(void *buf, size_t buf_size, GlobalConfig *site, int index, SQM_LE_Device *dev, AW_WeatherData *weatherData);
+
+// Recognizes "db export ..." and opens the export for the control server to stream.
+// Returns 0 if cmd is not an export command, 1 if it was handled (*export set, or an error in response).
+int command_db_export(const char *cmd, char *response, size_t response_size, GlobalConfig *site, DBExport **export);
 
 #endif // COMMAND_HANDLER_H
@@ -18,7 +18,9 @@
  */
 static void trim(char *str) {
     char *end;
-    while (*str == ' ' || *str == '\t') str++;
+    char *start = str;
+    while (*start == ' ' || *start == '\t') start++;
+    if (start != str) memmove(str, start, strlen(start) + 1);
     end = str + strlen(str) - 1;
     while (end > str && (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r')) *end-- = '\0';
 }
@@ -38,6 +40,59 @@ void encode_mac(const char* mac, char* encoded_mac, size_t size, GlobalConfig *s
     encoded_mac[j] = '\0';
 }
 
+/*
+ * Parses an sqmDevice value of the form name,ip,port[,dbName] and appends it to cfg->devices.
+ * When dbName is omitted the device's readings go to <dbName>_<name>.
+ * Returns: 0 on success, -1 if the value is malformed or too many devices are configured.
+ */
+static int parse_device(GlobalConfig *cfg, const char *val) {
+    if (cfg->numDevices >= NW_MAX_DEVICES) return -1;
+    char field_bufs[4][256];
+    char *fields[4] = { field_bufs[0], field_bufs[1], field_bufs[2], field_bufs[3] };
+    int nfields = parse_fields(val, ',', fields, 4, 256);
+    if (nfields < 3) return -1;
+    SQM_DeviceConfig *d = &cfg->devices[cfg->numDevices];
+    memset(d, 0, sizeof(*d));
+    for (int i = 0; i < nfields; ++i) trim(fields[i]);
+    strncpy(d->name, fields[0], sizeof(d->name)-1);
+    strncpy(d->ip, fields[1], sizeof(d->ip)-1);
+    d->port = (uint16_t)atoi(fields[2]);
+    if (nfields == 4 && fields[3][0]) strncpy(d->dbName, fields[3], sizeof(d->dbName)-1);
+    else d->dbName[0] = '\0'; // Filled in once dbName is known
+    cfg->numDevices++;
+    return 0;
+}
+
+/*
+ * Reconciles the device list with the single-device keys. Without any sqmDevice lines the
+ * legacy sqmIP/sqmPort/dbName keys describe device 0; otherwise device 0 is mirrored back
+ * into them so single-device consumers keep working.
+ */
+static void finalize_devices(GlobalConfig *cfg) {
+    if (cfg->numDevices == 0) {
+        SQM_DeviceConfig *d = &cfg->devices[0];
+        memset(d, 0, sizeof(*d));
+        strncpy(d->name, "sqm", sizeof(d->name)-1);
+        strncpy(d->ip, cfg->sqmIP, sizeof(d->ip)-1);
+        d->port = cfg->sqmPort;
+        strncpy(d->dbName, cfg->dbName, sizeof(d->dbName)-1);
+        cfg->numDevices = 1;
+        return;
+    }
+    for (int i = 0; i < cfg->numDevices; ++i) {
+        SQM_DeviceConfig *d = &cfg->devices[i];
+        if (d->dbName[0] == '\0') {
+            // Formatted apart from cfg: snprintf must not read from the object it writes
+            char db_name[sizeof(d->dbName)];
+            snprintf(db_name, sizeof(db_name), "%.200s_%.31s", cfg->dbName, d->name);
+            memcpy(d->dbName, db_name, sizeof(d->dbName));
+        }
+    }
+    strncpy(cfg->sqmIP, cfg->devices[0].ip, sizeof(cfg->sqmIP)-1);
+    cfg->sqmPort = cfg->devices[0].port;
+    strncpy(cfg->dbName, cfg->devices[0].dbName, sizeof(cfg->dbName)-1);
+}
+
 /*
  * Reads a configuration file in key:value format and populates a GlobalConfig struct.
  * Parameters: cfg - pointer to GlobalConfig struct to populate.
@@ -49,6 +104,7 @@ int read_config(GlobalConfig *cfg, const char *filename) {
     if (stat(filename, &st) != 0) return -1; // File does not exist
     FILE *f = fopen(filename, "r");
     if (!f) return -2;
+    cfg->numDevices = 0;
     char line[512];
     while (fgets(line, sizeof(line), f)) {
         char *sep = strchr(line, ':');
@@ -67,6 +123,7 @@ int read_config(GlobalConfig *cfg, const char *filename) {
         else if (strcmp(key, "sqmPort") == 0) cfg->sqmPort = (uint16_t)atoi(val);
         else if (strcmp(key, "dbName") == 0) strncpy(cfg->dbName, val, sizeof(cfg->dbName)-1);
         else if (strcmp(key, "readingInterval") == 0) cfg->readingInterval = (unsigned int)atoi(val);
+        else if (strcmp(key, "readingIntervalMs") == 0) cfg->readingIntervalMs = (unsigned int)atoi(val);
         else if (strcmp(key, "controlPort") == 0) cfg->controlPort = (uint16_t)atoi(val);
         else if (strcmp(key, "sqmHeartbeatInterval") == 0) cfg->sqmHeartbeatInterval = (unsigned int)atoi(val);
         else if (strcmp(key, "sqmReadTimeout") == 0) cfg->sqmReadTimeout = (unsigned int)atoi(val);
@@ -76,10 +133,27 @@ int read_config(GlobalConfig *cfg, const char *filename) {
         else if (strcmp(key, "AmbientWeatherAppKey") == 0) strncpy(cfg->AmbientWeatherAppKey, val, sizeof(cfg->AmbientWeatherAppKey)-1);
         else if (strcmp(key, "AmbientWeatherUpdateInterval") == 0) cfg->AmbientWeatherUpdateInterval = (unsigned int)atoi(val);
         else if (strcmp(key, "AmbientWeatherDeviceMAC") == 0) strncpy(cfg->AmbientWeatherDeviceMAC, val, sizeof(cfg->AmbientWeatherDeviceMAC));
+        else if (strcmp(key, "AmbientWeatherURL") == 0) strncpy(cfg->AmbientWeatherURL, val, sizeof(cfg->AmbientWeatherURL)-1);
+        else if (strcmp(key, "AmbientWeatherTimeout") == 0) cfg->AmbientWeatherTimeout = (unsigned int)atoi(val);
         else if (strcmp(key, "enableWeather") == 0) cfg->enableWeather = (strcmp(val, "true") == 0 || strcmp(val, "1") == 0);
         else if (strcmp(key, "enableDataSend") == 0) cfg->enableDataSend = (strcmp(val, "true") == 0 || strcmp(val, "1") == 0);
+        else if (strcmp(key, "sqmDevice") == 0) {
+            if (parse_device(cfg, val) != 0) LOGGER_WARN(LOG_MOD_CONFIG, "Ignoring invalid sqmDevice entry: %s", val);
+        }
+        else if (strcmp(key, "workerThreads") == 0) cfg->workerThreads = (unsigned int)atoi(val);
+        else if (strcmp(key, "dbBatchSize") == 0) cfg->dbBatchSize = (unsigned int)atoi(val);
+        else if (strcmp(key, "dbFlushInterval") == 0) cfg->dbFlushInterval = (unsigned int)atoi(val);
+        else if (strcmp(key, "rrdcachedAddress") == 0) strncpy(cfg->rrdcachedAddress, val, sizeof(cfg->rrdcachedAddress)-1);
+        else if (strcmp(key, "dbArchives") == 0) strncpy(cfg->dbArchives, val, sizeof(cfg->dbArchives)-1);
+        else if (strcmp(key, "historySize") == 0) cfg->historySize = (unsigned int)atoi(val);
+        else if (strcmp(key, "spoolFile") == 0) strncpy(cfg->spoolFile, val, sizeof(cfg->spoolFile)-1);
+        else if (strcmp(key, "uploadBatchSize") == 0) cfg->uploadBatchSize = (unsigned int)atoi(val);
+        else if (strcmp(key, "logTarget") == 0) strncpy(cfg->logTarget, val, sizeof(cfg->logTarget)-1);
+        else if (strcmp(key, "logLevel") == 0) strncpy(cfg->logLevel, val, sizeof(cfg->logLevel)-1);
+        else if (strcmp(key, "logModules") == 0) strncpy(cfg->logModules, val, sizeof(cfg->logModules)-1);
     }
     fclose(f);
+    finalize_devices(cfg);
     encode_mac(cfg->AmbientWeatherDeviceMAC, cfg->AmbientWeatherEncodedMAC, sizeof(cfg->AmbientWeatherEncodedMAC), &cfg);
     return 0;
 }
@@ -103,12 +177,30 @@ int write_config(const GlobalConfig *cfg, const char *filename) {
     fprintf(f, "sqmPort:%u\n", cfg->sqmPort);
     fprintf(f, "dbName:%s\n", cfg->dbName);
     fprintf(f, "readingInterval:%u\n", cfg->readingInterval);
+    fprintf(f, "readingIntervalMs:%u\n", cfg->readingIntervalMs);
     fprintf(f, "controlPort:%u\n", cfg->controlPort);
     fprintf(f, "sqmHeartbeatInterval:%u\n", cfg->sqmHeartbeatInterval);
     fprintf(f, "sqmReadTimeout:%u\n", cfg->sqmReadTimeout);
     fprintf(f, "sqmWriteTimeout:%u\n", cfg->sqmWriteTimeout);
     fprintf(f, "enableReadOnStartup:%s\n", cfg->enableReadOnStartup ? "true" : "false");
     fprintf(f, "enableDataSend:%s\n", cfg->enableDataSend ? "true" : "false");
+    fprintf(f, "AmbientWeatherURL:%s\n", cfg->AmbientWeatherURL);
+    fprintf(f, "AmbientWeatherTimeout:%u\n", cfg->AmbientWeatherTimeout);
+    fprintf(f, "workerThreads:%u\n", cfg->workerThreads);
+    fprintf(f, "dbBatchSize:%u\n", cfg->dbBatchSize);
+    fprintf(f, "dbFlushInterval:%u\n", cfg->dbFlushInterval);
+    fprintf(f, "rrdcachedAddress:%s\n", cfg->rrdcachedAddress);
+    fprintf(f, "dbArchives:%s\n", cfg->dbArchives);
+    fprintf(f, "historySize:%u\n", cfg->historySize);
+    fprintf(f, "spoolFile:%s\n", cfg->spoolFile);
+    fprintf(f, "uploadBatchSize:%u\n", cfg->uploadBatchSize);
+    fprintf(f, "logTarget:%s\n", cfg->logTarget);
+    fprintf(f, "logLevel:%s\n", cfg->logLevel);
+    fprintf(f, "logModules:%s\n", cfg->logModules);
+    for (int i = 0; i < cfg->numDevices; ++i) {
+        const SQM_DeviceConfig *d = &cfg->devices[i];
+        fprintf(f, "sqmDevice:%s,%s,%u,%s\n", d->name, d->ip, d->port, d->dbName);
+    }
     fclose(f);
     return 0;
 }
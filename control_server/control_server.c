@@ -0,0 +1,815 @@
+/*
+ * Project: NightWatcher
+ * File: control_server.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#define _GNU_SOURCE
+#include "nightwatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <strings.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * A "db export" being streamed to one connection. Its chunks are produced one at a time by
+ * jobs on the worker pool, so flushing the database and each rrd_fetch_r never run on the
+ * event loop. While busy the export belongs to the job (or waits for a job slot); the
+ * finished job hands it back to the loop through g_export_fd with the next chunk.
+ */
+typedef struct ControlExport {
+    DBExport *export;
+    struct ControlConn *conn;         // NULL once the connection has closed; freed when its job returns
+    bool busy;                        // Waiting for or running a job
+    bool started;                     // db_export_start succeeded
+    int ret;                          // Last job's result: 1 chunk, 0 complete, -1 failed, -2 could not start
+    const void *data;                 // Chunk from the last job, valid until the next job starts
+    size_t len;
+    struct ControlExport *next;       // Wait list or finished list link
+} ControlExport;
+
+// State for one client connection on the control port
+typedef struct ControlConn {
+    int fd;
+    char rbuf[CONTROL_READ_BUF_SIZE]; // Bytes received but not yet handled
+    size_t rlen;
+    char *wbuf;                       // Bytes queued for the client
+    size_t wlen;                      // Bytes in wbuf
+    size_t woff;                      // Bytes of wbuf already written
+    size_t wcap;                      // Allocated size of wbuf
+    bool close_after_write;           // Close once wbuf has been drained
+    bool session;                     // Persistent connection with framed responses
+    bool read_paused;                 // Input left unread until the client drains its responses
+    bool subscribed;                  // Receives pushed events
+    struct ControlConn *sub_prev;     // Subscriber list links
+    struct ControlConn *sub_next;
+    ControlExport *export;            // "db export" being streamed; other commands wait until it ends
+    bool closed;                      // Socket closed; freed once the current batch of events is done
+    struct ControlConn *closed_next;
+} ControlConn;
+
+// One published event, serialized once and shared by every subscriber
+typedef struct ControlEvent {
+    struct ControlEvent *next;
+    size_t len;
+    char payload[];
+} ControlEvent;
+
+// Shared context for the event loop
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    ControlConn *subscribers;         // Head of the subscriber list
+    WorkerPool *pool;                 // Runs export jobs
+    ControlExport *export_wait;       // Exports waiting for a job slot, oldest first
+    ControlExport *export_wait_tail;
+    int export_jobs;                  // Export jobs queued, running, or not yet collected
+    ControlConn *closed;              // Connections closed during the current batch
+    SQM_LE_Device *dev;
+    AW_WeatherData *weatherData;
+    char response[CONTROL_RESPONSE_SIZE]; // Scratch buffer; the loop is single threaded
+} ControlServer;
+
+// Events handed from publishing threads to the event loop
+static pthread_mutex_t g_event_lock = PTHREAD_MUTEX_INITIALIZER;
+static ControlEvent *g_event_head = NULL;
+static ControlEvent *g_event_tail = NULL;
+static int g_event_fd = -1;
+static volatile int g_subscriber_count = 0;
+
+// Exports handed back to the event loop by finished jobs
+static pthread_mutex_t g_export_lock = PTHREAD_MUTEX_INITIALIZER;
+static ControlExport *g_export_done = NULL;
+static int g_export_fd = -1;
+
+// Sentinel epoll data for the event and export notification descriptors
+static char g_event_marker;
+static char g_export_marker;
+
+/*
+ * Creates the non-blocking listening socket for the control port.
+ * Returns: the socket descriptor, or -1 on error.
+ */
+static int control_listen(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOGGER_ERROR(LOG_MOD_CONTROL, "socket: %s", strerror(errno));
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOGGER_ERROR(LOG_MOD_CONTROL, "bind port %u: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) < 0) {
+        LOGGER_ERROR(LOG_MOD_CONTROL, "listen: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Removes a connection from the event loop and closes it. The ControlConn itself is
+ * freed by free_closed_conns once the current batch of events has been handled, since
+ * later events in the same batch may still point to it.
+ */
+static void conn_unsubscribe(ControlServer *srv, ControlConn *conn);
+static void export_release(ControlServer *srv, ControlExport *ex);
+
+static void conn_close(ControlServer *srv, ControlConn *conn) {
+    if (conn->closed) return;
+    conn_unsubscribe(srv, conn);
+    export_release(srv, conn->export);
+    epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    metrics_gauge_add(METRIC_GAUGE_CONTROL_CONNECTIONS, -1);
+    free(conn->wbuf);
+    conn->wbuf = NULL;
+    conn->wlen = conn->woff = conn->wcap = 0;
+    conn->export = NULL;
+    conn->closed = true;
+    conn->closed_next = srv->closed;
+    srv->closed = conn;
+}
+
+/*
+ * Frees the connections closed during the batch of events just handled.
+ */
+static void free_closed_conns(ControlServer *srv) {
+    while (srv->closed) {
+        ControlConn *next = srv->closed->closed_next;
+        free(srv->closed);
+        srv->closed = next;
+    }
+}
+
+/*
+ * Appends bytes to the connection's write buffer, growing it as needed.
+ * Returns: 0 on success, -1 if memory could not be allocated.
+ */
+static int conn_queue(ControlConn *conn, const void *data, size_t len) {
+    if (conn->woff > 0 && conn->woff == conn->wlen) {
+        conn->woff = 0;
+        conn->wlen = 0;
+    }
+    if (conn->wlen + len > conn->wcap) {
+        size_t cap = conn->wcap ? conn->wcap : 4096;
+        while (cap < conn->wlen + len) cap *= 2;
+        char *p = realloc(conn->wbuf, cap);
+        if (!p) return -1;
+        conn->wbuf = p;
+        conn->wcap = cap;
+    }
+    memcpy(conn->wbuf + conn->wlen, data, len);
+    conn->wlen += len;
+    return 0;
+}
+
+/*
+ * Writes as much of the pending output as the socket accepts.
+ * Returns: 0 if the connection is still usable, -1 if it should be closed.
+ */
+static int conn_flush(ControlConn *conn) {
+    while (conn->woff < conn->wlen) {
+        // MSG_NOSIGNAL: a client that hangs up gets EPIPE here instead of killing the daemon
+        ssize_t n = send(conn->fd, conn->wbuf + conn->woff, conn->wlen - conn->woff, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->woff += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0; // EPOLLOUT will fire when the socket drains
+        } else {
+            return -1;
+        }
+    }
+    conn->woff = conn->wlen = 0;
+    return conn->close_after_write && !conn->export ? -1 : 0;
+}
+
+/*
+ * Returns: the number of queued bytes not yet written to the client.
+ */
+static size_t conn_backlog(const ControlConn *conn) {
+    return conn->wlen - conn->woff;
+}
+
+/*
+ * Queues one framed response: a "<kind> <length>\n" header followed by the payload.
+ * Returns: 0 on success, -1 if memory could not be allocated.
+ */
+static int conn_queue_frame(ControlConn *conn, const char *kind, const void *payload, size_t len) {
+    char header[32];
+    int hlen = snprintf(header, sizeof(header), "%s %zu\n", kind, len);
+    if (conn_queue(conn, header, (size_t)hlen) != 0) return -1;
+    return conn_queue(conn, payload, len);
+}
+
+/*
+ * Worker job: starts the export if this is its first job, then produces its next chunk
+ * and hands the export back to the event loop.
+ */
+static void export_job(void *arg) {
+    ControlExport *ex = (ControlExport *)arg;
+    if (!ex->started && db_export_start(ex->export) != 0) {
+        ex->ret = -2;
+    } else {
+        ex->started = true;
+        do {
+            ex->ret = db_export_next(ex->export, &ex->data, &ex->len);
+        } while (ex->ret > 0 && ex->len == 0);
+    }
+    pthread_mutex_lock(&g_export_lock);
+    ex->next = g_export_done;
+    g_export_done = ex;
+    pthread_mutex_unlock(&g_export_lock);
+    uint64_t one = 1;
+    while (write(g_export_fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+}
+
+/*
+ * Submits waiting exports while fewer than CONTROL_EXPORT_JOBS jobs are out. If the pool
+ * cannot take a job and none is out to come back and retry, the job runs here instead, so
+ * an export never stalls behind a full device queue.
+ */
+static void export_dispatch(ControlServer *srv) {
+    while (srv->export_wait && srv->export_jobs < CONTROL_EXPORT_JOBS) {
+        ControlExport *ex = srv->export_wait;
+        srv->export_wait = ex->next; // Unlinked first: the job reuses next for the finished list
+        srv->export_jobs++;
+        if (srv->pool && worker_pool_submit(srv->pool, export_job, ex) == 0) continue;
+        if (srv->export_jobs > 1) {
+            // Back to the head of the list; retried when one of the jobs out comes back
+            srv->export_jobs--;
+            ex->next = srv->export_wait;
+            if (!srv->export_wait) srv->export_wait_tail = ex;
+            srv->export_wait = ex;
+            return;
+        }
+        export_job(ex);
+    }
+}
+
+/*
+ * Queues a job for the export's next chunk. The previous chunk must have been sent or copied.
+ */
+static void export_request(ControlServer *srv, ControlExport *ex) {
+    ex->busy = true;
+    ex->next = NULL;
+    if (srv->export_wait) srv->export_wait_tail->next = ex;
+    else srv->export_wait = ex;
+    srv->export_wait_tail = ex;
+    export_dispatch(srv);
+}
+
+/*
+ * Detaches an export from its connection. An idle or waiting export is freed now; one
+ * with a job out is freed when the job comes back.
+ */
+static void export_release(ControlServer *srv, ControlExport *ex) {
+    if (!ex) return;
+    ex->conn = NULL;
+    ControlExport *prev = NULL;
+    for (ControlExport *w = srv->export_wait; w; prev = w, w = w->next) {
+        if (w != ex) continue;
+        if (prev) prev->next = ex->next;
+        else srv->export_wait = ex->next;
+        if (srv->export_wait_tail == ex) srv->export_wait_tail = prev;
+        ex->busy = false;
+        break;
+    }
+    if (ex->busy) return;
+    db_export_close(ex->export);
+    free(ex);
+}
+
+/*
+ * Hands an opened export to the worker pool for streaming on conn.
+ * Returns: true if it is streaming, false if it could not be (the export is closed).
+ */
+static bool conn_start_export(ControlServer *srv, ControlConn *conn, DBExport *export) {
+    ControlExport *ex = calloc(1, sizeof(ControlExport));
+    if (!ex) {
+        db_export_close(export);
+        return false;
+    }
+    ex->export = export;
+    ex->conn = conn;
+    conn->export = ex;
+    export_request(srv, ex);
+    return true;
+}
+
+/*
+ * Checks whether a command line is exactly the given word (case and whitespace insensitive).
+ */
+static bool line_is(const char *line, size_t len, const char *word) {
+    size_t wlen = strlen(word);
+    while (len > 0 && isspace((unsigned char)*line)) { line++; len--; }
+    while (len > 0 && isspace((unsigned char)line[len - 1])) len--;
+    return len == wlen && strncasecmp(line, word, wlen) == 0;
+}
+
+/*
+ * Checks whether a command line switches the connection into session mode.
+ * "subscribe" implies a session, since pushed events use the same framing.
+ */
+static bool is_session_command(const char *line, size_t len) {
+    return line_is(line, len, "session") || line_is(line, len, "subscribe");
+}
+
+/*
+ * Adds a connection to the subscriber list.
+ */
+static void conn_subscribe(ControlServer *srv, ControlConn *conn) {
+    if (conn->subscribed) return;
+    conn->subscribed = true;
+    conn->sub_prev = NULL;
+    conn->sub_next = srv->subscribers;
+    if (srv->subscribers) srv->subscribers->sub_prev = conn;
+    srv->subscribers = conn;
+    __atomic_add_fetch(&g_subscriber_count, 1, __ATOMIC_RELEASE);
+    metrics_gauge_add(METRIC_GAUGE_SUBSCRIBERS, 1);
+}
+
+/*
+ * Removes a connection from the subscriber list.
+ */
+static void conn_unsubscribe(ControlServer *srv, ControlConn *conn) {
+    if (!conn->subscribed) return;
+    conn->subscribed = false;
+    if (conn->sub_prev) conn->sub_prev->sub_next = conn->sub_next;
+    else srv->subscribers = conn->sub_next;
+    if (conn->sub_next) conn->sub_next->sub_prev = conn->sub_prev;
+    conn->sub_prev = conn->sub_next = NULL;
+    __atomic_sub_fetch(&g_subscriber_count, 1, __ATOMIC_RELEASE);
+    metrics_gauge_add(METRIC_GAUGE_SUBSCRIBERS, -1);
+}
+
+/*
+ * Handles everything received so far as a single command, queues the response,
+ * and marks the connection to close once the response has been sent.
+ */
+static void conn_handle_input(ControlServer *srv, ControlConn *conn) {
+    conn->rbuf[conn->rlen] = '\0';
+    srv->response[0] = '\0';
+    conn->rlen = 0;
+    GlobalConfig *site = site_config_acquire();
+    DBExport *export = NULL;
+    if (command_db_export(conn->rbuf, srv->response, sizeof(srv->response), site, &export) && export) {
+        site_config_release(site);
+        if (conn_start_export(srv, conn, export)) return; // Streamed by conn_stream_export; the connection closes when it ends
+        snprintf(srv->response, sizeof(srv->response), "DB: Export failed\n");
+        site = NULL;
+    }
+    size_t len = strlen(srv->response);
+    if (len == 0) {
+        len = handle_command(conn->rbuf, srv->response, sizeof(srv->response), site, srv->dev, srv->weatherData);
+    }
+    if (site) site_config_release(site);
+    conn_queue(conn, srv->response, len);
+    conn->close_after_write = true;
+}
+
+/*
+ * Answers an HTTP request on the control port, so Prometheus can scrape "GET /metrics"
+ * without a separate listener. Any other path gets a 404. The connection closes afterwards.
+ */
+static void conn_handle_http(ControlServer *srv, ControlConn *conn) {
+    conn->rbuf[conn->rlen] = '\0';
+    conn->rlen = 0;
+    char header[256];
+    size_t body_len;
+    const char *status = "200 OK";
+    if (strncmp(conn->rbuf, "GET /metrics ", 13) == 0 || strncmp(conn->rbuf, "GET /metrics?", 13) == 0) {
+        body_len = metrics_format_prometheus(srv->response, sizeof(srv->response));
+    } else {
+        status = "404 Not Found";
+        body_len = (size_t)snprintf(srv->response, sizeof(srv->response), "Not found\n");
+    }
+    int hlen = snprintf(header, sizeof(header),
+                        "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                        status, body_len);
+    conn_queue(conn, header, (size_t)hlen);
+    conn_queue(conn, srv->response, body_len);
+    conn->close_after_write = true;
+}
+
+/*
+ * Runs one command line on a session connection and queues its framed response.
+ */
+static void conn_session_command(ControlServer *srv, ControlConn *conn, char *line, size_t len) {
+    srv->response[0] = '\0';
+    size_t response_len = 0;
+    if (line_is(line, len, "session")) {
+        snprintf(srv->response, sizeof(srv->response), "Session: active\n");
+    } else if (line_is(line, len, "subscribe")) {
+        conn_subscribe(srv, conn);
+        snprintf(srv->response, sizeof(srv->response), "Subscribe: active\n");
+    } else if (line_is(line, len, "unsubscribe")) {
+        conn_unsubscribe(srv, conn);
+        snprintf(srv->response, sizeof(srv->response), "Unsubscribe: done\n");
+    } else {
+        GlobalConfig *site = site_config_acquire();
+        DBExport *export = NULL;
+        if (command_db_export(line, srv->response, sizeof(srv->response), site, &export)) {
+            site_config_release(site);
+            if (export) {
+                if (conn_start_export(srv, conn, export)) return; // Sent as DAT frames, then an RSP frame with the row count
+                snprintf(srv->response, sizeof(srv->response), "DB: Export failed\n");
+            }
+        } else {
+            response_len = handle_command(line, srv->response, sizeof(srv->response), site, srv->dev, srv->weatherData);
+            site_config_release(site);
+        }
+    }
+    if (response_len == 0) response_len = strlen(srv->response);
+    conn_queue_frame(conn, "RSP", srv->response, response_len);
+}
+
+/*
+ * Handles buffered input. A connection starts in one-shot mode, where the first chunk
+ * received is a single command that is answered before the socket is closed. If the
+ * first line is "session" or "subscribe" the connection stays open instead, and every newline
+ * terminated line is a command whose response is sent as a framed "RSP <length>" block.
+ * Lines are handled in order, so clients may pipeline several commands in one write.
+ * Parameters: eof - true if the peer has finished sending.
+ */
+static void conn_process_input(ControlServer *srv, ControlConn *conn, bool eof) {
+    if (conn->rlen == 0 || conn->close_after_write || conn->export) return;
+    if (!conn->session) {
+        // An HTTP request is answered once its headers are complete, so none of it is left unread
+        size_t method_len = conn->rlen < 4 ? conn->rlen : 4;
+        if (memcmp(conn->rbuf, "GET ", method_len) == 0) {
+            bool complete = memmem(conn->rbuf, conn->rlen, "\r\n\r\n", 4) || memmem(conn->rbuf, conn->rlen, "\n\n", 2);
+            if (complete || eof || conn->rlen == sizeof(conn->rbuf) - 1) conn_handle_http(srv, conn);
+            return;
+        }
+        char *nl = memchr(conn->rbuf, '\n', conn->rlen);
+        size_t first_len = nl ? (size_t)(nl - conn->rbuf) : conn->rlen;
+        if (!is_session_command(conn->rbuf, first_len)) {
+            conn_handle_input(srv, conn);
+            return;
+        }
+        conn->session = true;
+    }
+    size_t start = 0;
+    while (start < conn->rlen && conn_backlog(conn) < CONTROL_WRITE_HIGH_WATER && !conn->export) {
+        char *line = conn->rbuf + start;
+        char *nl = memchr(line, '\n', conn->rlen - start);
+        if (!nl && !eof) break;
+        size_t len = nl ? (size_t)(nl - line) : conn->rlen - start;
+        line[len] = '\0';
+        if (len > 0) conn_session_command(srv, conn, line, len);
+        start += len + (nl ? 1 : 0);
+    }
+    if (start > 0) {
+        memmove(conn->rbuf, conn->rbuf + start, conn->rlen - start);
+        conn->rlen -= start;
+    }
+    if (conn->rlen == sizeof(conn->rbuf) - 1 && !memchr(conn->rbuf, '\n', conn->rlen)) {
+        const char *msg = "Error: command line too long\n";
+        conn_queue_frame(conn, "RSP", msg, strlen(msg));
+        conn->rlen = 0;
+        conn->close_after_write = true;
+    }
+}
+
+/*
+ * Drains the socket into the read buffer (edge triggered, so read until EAGAIN) and
+ * handles complete commands as they arrive. Reading pauses while a session client has
+ * more than CONTROL_WRITE_HIGH_WATER bytes of unread responses queued.
+ * Returns: 0 if the connection is still usable, -1 if it should be closed.
+ */
+static int conn_read(ControlServer *srv, ControlConn *conn) {
+    conn->read_paused = false;
+    conn_process_input(srv, conn, false);
+    while (!conn->close_after_write) {
+        size_t room = sizeof(conn->rbuf) - 1 - conn->rlen;
+        if (room == 0 || conn_backlog(conn) >= CONTROL_WRITE_HIGH_WATER) {
+            conn->read_paused = true;
+            return 0;
+        }
+        ssize_t n = read(conn->fd, conn->rbuf + conn->rlen, room);
+        if (n > 0) {
+            conn->rlen += (size_t)n;
+            conn_process_input(srv, conn, false);
+        } else if (n == 0) {
+            conn_process_input(srv, conn, true);
+            if (conn_backlog(conn) == 0 && !conn->export) return -1;
+            conn->close_after_write = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Sends the chunk the export's last job produced, then queues the job for the next one, so
+ * the worker formats it while this one drains. The chunk is written straight from the
+ * export's buffer with sendmsg, behind a "DAT <length>" header in session mode; only the
+ * unwritten tail of a partial write is copied into the write buffer. When the export has
+ * ended, the row count (session mode) or the close is queued instead.
+ * Returns: 0 if the connection is still usable, -1 if it should be closed.
+ */
+static int conn_stream_export(ControlServer *srv, ControlConn *conn) {
+    ControlExport *ex = conn->export;
+    if (ex->ret <= 0) {
+        int ret = ex->ret;
+        if (ret == -2) snprintf(srv->response, sizeof(srv->response), "DB: Export failed\n");
+        else snprintf(srv->response, sizeof(srv->response), ret == 0 ? "Export: %lu rows\n" : "Export: Failed after %lu rows\n",
+                      db_export_rows(ex->export));
+        export_release(srv, ex);
+        conn->export = NULL;
+        if (conn->session) {
+            conn_queue_frame(conn, "RSP", srv->response, strlen(srv->response));
+            conn->read_paused = true; // Pick up commands pipelined behind the export
+        } else {
+            if (ret == -2) conn_queue(conn, srv->response, strlen(srv->response)); // Nothing was sent yet
+            conn->close_after_write = true;
+        }
+        return 0;
+    }
+    char header[32];
+    struct iovec iov[2];
+    int iovcnt = 0;
+    size_t total = ex->len;
+    if (conn->session) {
+        int hlen = snprintf(header, sizeof(header), "DAT %zu\n", ex->len);
+        iov[iovcnt].iov_base = header;
+        iov[iovcnt++].iov_len = (size_t)hlen;
+        total += (size_t)hlen;
+    }
+    iov[iovcnt].iov_base = (void *)ex->data;
+    iov[iovcnt++].iov_len = ex->len;
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)iovcnt;
+    ssize_t n;
+    do {
+        n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        n = 0;
+    }
+    if ((size_t)n < total) {
+        size_t skip = (size_t)n;
+        for (int i = 0; i < iovcnt; ++i) {
+            if (skip >= iov[i].iov_len) {
+                skip -= iov[i].iov_len;
+                continue;
+            }
+            if (conn_queue(conn, (const char *)iov[i].iov_base + skip, iov[i].iov_len - skip) != 0) return -1;
+            skip = 0;
+        }
+    }
+    export_request(srv, ex);
+    return 0;
+}
+
+/*
+ * Accepts every pending connection on the listening socket and registers it with epoll.
+ */
+static void accept_clients(ControlServer *srv) {
+    while (1) {
+        int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) LOGGER_ERROR(LOG_MOD_CONTROL, "accept: %s", strerror(errno));
+            return;
+        }
+        ControlConn *conn = calloc(1, sizeof(ControlConn));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            LOGGER_ERROR(LOG_MOD_CONTROL, "epoll_ctl: %s", strerror(errno));
+            close(fd);
+            free(conn);
+            continue;
+        }
+        metrics_gauge_add(METRIC_GAUGE_CONTROL_CONNECTIONS, 1);
+    }
+}
+
+/*
+ * Services one readiness event for a client connection.
+ */
+static void conn_event(ControlServer *srv, ControlConn *conn, uint32_t events) {
+    if (conn->closed) return; // Closed earlier in this batch
+    if (events & EPOLLERR) {
+        conn_close(srv, conn);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+        if (conn_read(srv, conn) != 0) {
+            conn_close(srv, conn);
+            return;
+        }
+    }
+    while (1) {
+        if (conn->wlen > conn->woff || conn->close_after_write) {
+            if (conn_flush(conn) != 0) {
+                conn_close(srv, conn);
+                return;
+            }
+        }
+        if (conn->export && !conn->export->busy && conn_backlog(conn) == 0) {
+            if (conn_stream_export(srv, conn) != 0) {
+                conn_close(srv, conn);
+                return;
+            }
+            if (conn->export) break;
+            continue; // Finished: send the trailer, then resume input
+        }
+        // Resume a paused session once its responses have been drained
+        if (!conn->read_paused || conn_backlog(conn) > 0) break;
+        if (conn_read(srv, conn) != 0) {
+            conn_close(srv, conn);
+            return;
+        }
+    }
+}
+
+/*
+ * Delivers queued events to every subscriber. Each event was serialized once by its
+ * publisher; here it is only copied into the subscribers' write buffers. A subscriber
+ * that has fallen more than CONTROL_SUBSCRIBER_MAX_BACKLOG bytes behind misses events
+ * until it catches up.
+ */
+static void deliver_events(ControlServer *srv) {
+    uint64_t count;
+    while (read(g_event_fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+
+    pthread_mutex_lock(&g_event_lock);
+    ControlEvent *events = g_event_head;
+    g_event_head = g_event_tail = NULL;
+    pthread_mutex_unlock(&g_event_lock);
+
+    for (ControlEvent *ev = events; ev; ev = ev->next) {
+        for (ControlConn *conn = srv->subscribers; conn; conn = conn->sub_next) {
+            if (conn_backlog(conn) > CONTROL_SUBSCRIBER_MAX_BACKLOG) continue;
+            conn_queue_frame(conn, "EVT", ev->payload, ev->len);
+        }
+    }
+    while (events) {
+        ControlEvent *next = events->next;
+        free(events);
+        events = next;
+    }
+
+    ControlConn *conn = srv->subscribers;
+    while (conn) {
+        ControlConn *next = conn->sub_next;
+        if (conn_backlog(conn) > 0 && conn_flush(conn) != 0) conn_close(srv, conn);
+        conn = next;
+    }
+}
+
+/*
+ * Collects exports whose jobs have finished, sends their chunks, and submits the jobs
+ * that were waiting for a slot. An export whose connection closed meanwhile is freed.
+ */
+static void deliver_exports(ControlServer *srv) {
+    uint64_t count;
+    while (read(g_export_fd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+
+    pthread_mutex_lock(&g_export_lock);
+    ControlExport *done = g_export_done;
+    g_export_done = NULL;
+    pthread_mutex_unlock(&g_export_lock);
+
+    while (done) {
+        ControlExport *ex = done;
+        done = ex->next;
+        ex->busy = false;
+        srv->export_jobs--;
+        if (ex->conn) conn_event(srv, ex->conn, 0);
+        else export_release(srv, ex);
+    }
+    export_dispatch(srv);
+}
+
+bool control_server_has_subscribers(void) {
+    return __atomic_load_n(&g_subscriber_count, __ATOMIC_ACQUIRE) > 0;
+}
+
+void control_server_publish(const char *payload, size_t len) {
+    if (!control_server_has_subscribers() || g_event_fd < 0) return;
+    ControlEvent *ev = malloc(sizeof(ControlEvent) + len);
+    if (!ev) return;
+    ev->next = NULL;
+    ev->len = len;
+    memcpy(ev->payload, payload, len);
+
+    pthread_mutex_lock(&g_event_lock);
+    if (g_event_tail) g_event_tail->next = ev;
+    else g_event_head = ev;
+    g_event_tail = ev;
+    pthread_mutex_unlock(&g_event_lock);
+
+    uint64_t one = 1;
+    while (write(g_event_fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+}
+
+int control_server_run(SQM_LE_Device *dev, AW_WeatherData *weatherData, WorkerPool *pool) {
+    static ControlServer srv;
+    srv.dev = dev;
+    srv.weatherData = weatherData;
+    srv.pool = pool;
+
+    GlobalConfig *site = site_config_acquire();
+    uint16_t port = site->controlPort; // Read once; a reload keeps it until a restart
+    site_config_release(site);
+    srv.listen_fd = control_listen(port);
+    if (srv.listen_fd < 0) return -1;
+    srv.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (srv.epoll_fd < 0) {
+        LOGGER_ERROR(LOG_MOD_CONTROL, "epoll_create1: %s", strerror(errno));
+        close(srv.listen_fd);
+        return -1;
+    }
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; // NULL marks the listening socket
+    if (epoll_ctl(srv.epoll_fd, EPOLL_CTL_ADD, srv.listen_fd, &ev) < 0) {
+        LOGGER_ERROR(LOG_MOD_CONTROL, "epoll_ctl: %s", strerror(errno));
+        close(srv.epoll_fd);
+        close(srv.listen_fd);
+        return -1;
+    }
+
+    int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) {
+        LOGGER_ERROR(LOG_MOD_CONTROL, "eventfd: %s", strerror(errno));
+    } else {
+        ev.events = EPOLLIN;
+        ev.data.ptr = &g_event_marker;
+        epoll_ctl(srv.epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+        g_event_fd = event_fd;
+    }
+    g_export_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.events = EPOLLIN;
+    ev.data.ptr = &g_export_marker;
+    if (g_export_fd < 0 || epoll_ctl(srv.epoll_fd, EPOLL_CTL_ADD, g_export_fd, &ev) < 0) {
+        LOGGER_ERROR(LOG_MOD_CONTROL, "export eventfd: %s", strerror(errno));
+        close(srv.epoll_fd);
+        close(srv.listen_fd);
+        return -1;
+    }
+
+    struct epoll_event events[CONTROL_MAX_EVENTS];
+    while (1) {
+        int n = epoll_wait(srv.epoll_fd, events, CONTROL_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOGGER_ERROR(LOG_MOD_CONTROL, "epoll_wait: %s", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == NULL) {
+                accept_clients(&srv);
+            } else if (events[i].data.ptr == &g_event_marker) {
+                deliver_events(&srv);
+            } else if (events[i].data.ptr == &g_export_marker) {
+                deliver_exports(&srv);
+            } else {
+                conn_event(&srv, (ControlConn*)events[i].data.ptr, events[i].events);
+            }
+        }
+        free_closed_conns(&srv);
+    }
+    close(srv.epoll_fd);
+    close(srv.listen_fd);
+    return -1;
+}
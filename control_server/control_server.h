@@ -0,0 +1,35 @@
+/*
+ * Project: NightWatcher
+ * File: control_server.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define CONTROL_READ_BUF_SIZE   1024   // Per-connection command buffer
+#define CONTROL_RESPONSE_SIZE   (128 * 1024) // Largest single command response
+#define CONTROL_MAX_EVENTS      64     // epoll events handled per wakeup
+#define CONTROL_WRITE_HIGH_WATER (256 * 1024) // Stop reading a session while this much output is queued
+#define CONTROL_SUBSCRIBER_MAX_BACKLOG (1024 * 1024) // Skip events for subscribers this far behind
+#define CONTROL_EXPORT_JOBS     2      // Export chunks produced on the worker pool at once
+
+// Serves the TCP control port on the configured controlPort from a single epoll event loop.
+// Each command sees the site config current when it arrives (see site_config_acquire).
+// "db export" windows are fetched and formatted by jobs on pool, never on the event loop;
+// the pool's queue needs room for CONTROL_EXPORT_JOBS of them.
+// Blocks forever on success; returns nonzero if the listening socket could not be set up.
+int control_server_run(SQM_LE_Device *dev, AW_WeatherData *weatherData, WorkerPool *pool);
+
+// Returns true if any control-port client has sent "subscribe".
+// Publishers check this first so nothing is serialized when nobody is listening.
+bool control_server_has_subscribers(void);
+
+// Pushes an event to every subscriber as an "EVT <length>" frame. Safe to call from any thread;
+// the payload is copied once and shared by all subscribers.
+void control_server_publish(const char *payload, size_t len);
+
+#endif // CONTROL_SERVER_H
@@ -4,47 +4,354 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
+#include <stdbool.h>
+#include <pthread.h>
 #include <rrd.h>
+#include <rrd_client.h>
+#include <zlib.h>
+
+// Data sources stored for every reading
+static const char *db_ds_args[] = {
+    "DS:latitude:GAUGE:120:U:U",
+    "DS:longitude:GAUGE:120:U:U",
+    "DS:elevation:GAUGE:120:U:U",
+    "DS:sqmModel:GAUGE:120:U:U",
+    "DS:sqmSerial:GAUGE:120:U:U",
+    "DS:mpsqa:GAUGE:120:U:U",
+    "DS:sensorTemp:GAUGE:120:U:U",
+    "DS:siteTemp:GAUGE:120:U:U",
+    "DS:sitePressure:GAUGE:120:U:U",
+    "DS:siteHumidity:GAUGE:120:U:U"
+};
+#define DB_NUM_DS (int)(sizeof(db_ds_args) / sizeof(db_ds_args[0]))
+
+// Consolidation functions kept at every resolution
+static const char *db_cfs[] = { "AVERAGE", "MIN", "MAX" };
+#define DB_NUM_CFS (int)(sizeof(db_cfs) / sizeof(db_cfs[0]))
+
+// Archive resolutions: steps of DB_STEP seconds per row, and rows kept
+typedef struct {
+    unsigned long steps;
+    unsigned long rows;
+} DBArchive;
+
+static DBArchive db_archives[DB_MAX_ARCHIVES];
+static int db_num_archives = 0;
+
+int db_configure_archives(const char *spec) {
+    if (!spec || spec[0] == '\0') spec = DB_DEFAULT_ARCHIVES;
+    char fields[DB_MAX_ARCHIVES][32];
+    char *field_ptrs[DB_MAX_ARCHIVES];
+    for (int i = 0; i < DB_MAX_ARCHIVES; ++i) field_ptrs[i] = fields[i];
+    int n = parse_fields(spec, ',', field_ptrs, DB_MAX_ARCHIVES, sizeof(fields[0]));
+    DBArchive archives[DB_MAX_ARCHIVES];
+    int count = 0;
+    for (int i = 0; i < n; ++i) {
+        unsigned long steps, rows;
+        if (sscanf(fields[i], " %lu:%lu", &steps, &rows) != 2 || steps == 0 || rows == 0) {
+            LOGGER_ERROR(LOG_MOD_DB, "Invalid dbArchives entry: %s", fields[i]);
+            return -1;
+        }
+        archives[count].steps = steps;
+        archives[count].rows = rows;
+        count++;
+    }
+    if (count == 0) return -1;
+    memcpy(db_archives, archives, sizeof(archives[0]) * (size_t)count);
+    db_num_archives = count;
+    return 0;
+}
+
+/*
+ * Builds the rrd_create argument list: the data sources followed by one RRA per
+ * configured resolution and consolidation function.
+ * Returns: the number of arguments.
+ */
+static int db_build_create_args(const char **argv, char rra_args[][64]) {
+    if (db_num_archives == 0) db_configure_archives(NULL);
+    int argc = 0;
+    for (int i = 0; i < DB_NUM_DS; ++i) argv[argc++] = db_ds_args[i];
+    int nrra = 0;
+    for (int a = 0; a < db_num_archives; ++a) {
+        for (int c = 0; c < DB_NUM_CFS; ++c) {
+            snprintf(rra_args[nrra], 64, "RRA:%s:0.5:%lu:%lu", db_cfs[c], db_archives[a].steps, db_archives[a].rows);
+            argv[argc++] = rra_args[nrra++];
+        }
+    }
+    return argc;
+}
 
 int db_create(const char *dbName) {
     // Arguments for rrd_create_r
-    const char *ds_args[] = {
-        "DS:latitude:GAUGE:120:U:U",
-        "DS:longitude:GAUGE:120:U:U",
-        "DS:elevation:GAUGE:120:U:U",
-        "DS:sqmModel:GAUGE:120:U:U",
-        "DS:sqmSerial:GAUGE:120:U:U",
-        "DS:mpsqa:GAUGE:120:U:U",
-        "DS:sensorTemp:GAUGE:120:U:U",
-        "DS:siteTemp:GAUGE:120:U:U",
-        "DS:sitePressure:GAUGE:120:U:U",
-        "DS:siteHumidity:GAUGE:120:U:U",
-        "RRA:AVERAGE:0.5:1:1440"
-    };
-    int ds_argc = sizeof(ds_args) / sizeof(ds_args[0]);
+    const char *args[DB_NUM_DS + DB_MAX_ARCHIVES * DB_NUM_CFS];
+    char rra_args[DB_MAX_ARCHIVES * DB_NUM_CFS][64];
+    int argc = db_build_create_args(args, rra_args);
+    optind = 0;
+    rrd_clear_error();
+    if (rrd_create_r(dbName, DB_STEP, 0, argc, args) == -1) {
+        LOGGER_ERROR(LOG_MOD_DB, "RRD create error: %s", rrd_get_error());
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Compares the RRAs of an existing RRD file with the ones db_create would define now:
+ * the same consolidation function, steps per row, and rows, in the same order.
+ * Returns: 1 if they match, 0 if not, or -1 if the file could not be read.
+ */
+static int db_archives_match(const char *dbName) {
+    rrd_clear_error();
+    rrd_info_t *info = rrd_info_r(dbName);
+    if (!info) return -1;
+    int expected = db_num_archives * DB_NUM_CFS;
+    int count = 0;
+    bool match = true;
+    for (rrd_info_t *i = info; i && match; i = i->next) {
+        int index;
+        char field[16];
+        if (sscanf(i->key, "rra[%d].%15s", &index, field) != 2) continue;
+        if (index < 0 || index >= expected) {
+            match = false; // More archives than configured
+            break;
+        }
+        const DBArchive *a = &db_archives[index / DB_NUM_CFS];
+        if (strcmp(field, "cf") == 0) {
+            count++;
+            match = i->type == RD_I_STR && strcmp(i->value.u_str, db_cfs[index % DB_NUM_CFS]) == 0;
+        } else if (strcmp(field, "pdp_per_row") == 0) {
+            match = i->type == RD_I_CNT && i->value.u_cnt == a->steps;
+        } else if (strcmp(field, "rows") == 0) {
+            match = i->type == RD_I_CNT && i->value.u_cnt == a->rows;
+        }
+    }
+    rrd_info_free(info);
+    return match && count == expected ? 1 : 0;
+}
+
+int db_upgrade(const char *dbName) {
+    if (db_num_archives == 0) db_configure_archives(NULL);
+    int match = db_archives_match(dbName);
+    if (match < 0) {
+        LOGGER_ERROR(LOG_MOD_DB, "RRD info error: %s", rrd_get_error());
+        return -1;
+    }
+    if (match) return 0;
+
+    // Rebuild the file with the configured archives, filled from the old file's data
+    LOGGER_INFO(LOG_MOD_DB, "Migrating %s to the %d archives in dbArchives", dbName, db_num_archives * DB_NUM_CFS);
+    char tmpName[300];
+    snprintf(tmpName, sizeof(tmpName), "%s.migrate", dbName);
+    const char *args[DB_NUM_DS + DB_MAX_ARCHIVES * DB_NUM_CFS];
+    char rra_args[DB_MAX_ARCHIVES * DB_NUM_CFS][64];
+    int argc = db_build_create_args(args, rra_args);
+    const char *sources[] = { dbName, NULL };
+    remove(tmpName);
     optind = 0;
     rrd_clear_error();
-    if (rrd_create_r(dbName, 60, 0, ds_argc, ds_args) == -1) {
-        fprintf(stderr, "RRD create error: %s\n", rrd_get_error());
+    if (rrd_create_r2(tmpName, DB_STEP, 0, 0, sources, NULL, argc, args) == -1) {
+        LOGGER_ERROR(LOG_MOD_DB, "RRD migrate error: %s", rrd_get_error());
+        remove(tmpName);
+        return -1;
+    }
+    if (rename(tmpName, dbName) != 0) {
+        LOGGER_ERROR(LOG_MOD_DB, "rename: %s", strerror(errno));
+        remove(tmpName);
+        return -1;
+    }
+    return 0;
+}
+
+// Buffered updates waiting to be written to one RRD file
+typedef struct {
+    char dbName[256];
+    pthread_mutex_t lock;
+    char (*updates)[DB_UPDATE_LEN]; // Formatted "timestamp:v1:...:v10" update strings
+    unsigned int count;
+    time_t last_queued;             // RRD rejects updates that do not move time forward
+    unsigned int failures;          // Failed writes in a row that made no progress
+    bool warned_order;              // Logged a reading that did not move time forward
+} DBWriteBuffer;
+
+static pthread_mutex_t db_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static DBWriteBuffer db_buffers[DB_MAX_BUFFERS];
+static int db_num_buffers = 0;
+static unsigned int db_batch_size = 1;
+static char db_rrdcached_addr[256] = "";
+static bool db_rrdcached_connected = false;
+
+void db_configure_writes(unsigned int batch_size, const char *rrdcached_addr) {
+    pthread_mutex_lock(&db_buffers_lock);
+    db_batch_size = batch_size == 0 ? 1 : batch_size;
+    if (db_batch_size > DB_MAX_BATCH) db_batch_size = DB_MAX_BATCH;
+    strncpy(db_rrdcached_addr, rrdcached_addr ? rrdcached_addr : "", sizeof(db_rrdcached_addr)-1);
+    pthread_mutex_unlock(&db_buffers_lock);
+}
+
+/*
+ * Returns the write buffer for dbName, creating it on first use.
+ * Buffers are never removed, so the returned pointer stays valid.
+ */
+static DBWriteBuffer *db_get_buffer(const char *dbName) {
+    DBWriteBuffer *buf = NULL;
+    pthread_mutex_lock(&db_buffers_lock);
+    for (int i = 0; i < db_num_buffers; ++i) {
+        if (strcmp(db_buffers[i].dbName, dbName) == 0) {
+            buf = &db_buffers[i];
+            break;
+        }
+    }
+    if (!buf && db_num_buffers < DB_MAX_BUFFERS) {
+        DBWriteBuffer *b = &db_buffers[db_num_buffers];
+        b->updates = calloc(DB_MAX_BATCH, sizeof(*b->updates));
+        if (b->updates) {
+            strncpy(b->dbName, dbName, sizeof(b->dbName)-1);
+            pthread_mutex_init(&b->lock, NULL);
+            b->count = 0;
+            // Start after whatever the file already holds, e.g. from before a restart
+            rrd_clear_error();
+            time_t last = rrd_last_r(dbName);
+            b->last_queued = last > 0 ? last : 0;
+            b->failures = 0;
+            b->warned_order = false;
+            buf = b;
+            db_num_buffers++;
+        }
+    }
+    pthread_mutex_unlock(&db_buffers_lock);
+    return buf;
+}
+
+/*
+ * Sends buffered updates to rrdcached, connecting first if needed.
+ * Returns 0 on success, -1 if the daemon could not be reached.
+ */
+static int db_write_rrdcached(const char *dbName, int argc, const char **argv) {
+    pthread_mutex_lock(&db_buffers_lock);
+    if (!db_rrdcached_connected) {
+        rrd_clear_error();
+        db_rrdcached_connected = rrdc_connect(db_rrdcached_addr) == 0;
+        if (!db_rrdcached_connected) LOGGER_ERROR(LOG_MOD_DB, "rrdcached connect error: %s", rrd_get_error());
+    }
+    bool connected = db_rrdcached_connected;
+    pthread_mutex_unlock(&db_buffers_lock);
+    if (!connected) return -1;
+    rrd_clear_error();
+    if (rrdc_update(dbName, argc, (const char * const *)argv) != 0) {
+        LOGGER_ERROR(LOG_MOD_DB, "rrdcached update error: %s", rrd_get_error());
+        pthread_mutex_lock(&db_buffers_lock);
+        rrdc_disconnect();
+        db_rrdcached_connected = false;
+        pthread_mutex_unlock(&db_buffers_lock);
         return -1;
     }
     return 0;
 }
 
+/*
+ * Removes the first n updates from a buffer. Caller holds buf->lock.
+ */
+static void db_buffer_remove(DBWriteBuffer *buf, unsigned int n) {
+    if (n > buf->count) n = buf->count;
+    memmove(buf->updates, buf->updates + n, (buf->count - n) * sizeof(*buf->updates));
+    buf->count -= n;
+}
+
+/*
+ * Writes a buffer's pending updates with a single update call. Caller holds buf->lock.
+ * Falls back to writing the file directly if rrdcached is configured but unreachable.
+ * rrd_update stops at the first update it refuses, so after a failure the updates the
+ * file now holds are removed and the rest are kept for the next write. An update that
+ * is refused DB_WRITE_RETRIES times in a row while the file is readable is dropped,
+ * logged, and counted, so one bad update cannot hold back the ones behind it.
+ * Returns 0 if everything was written, -1 if updates are still buffered.
+ */
+static int db_write_buffer(DBWriteBuffer *buf) {
+    if (buf->count == 0) return 0;
+    const char *upd_args[DB_MAX_BATCH];
+    int upd_argc = (int)buf->count;
+    for (int i = 0; i < upd_argc; ++i) upd_args[i] = buf->updates[i];
+    uint64_t start = metrics_now();
+    if (db_rrdcached_addr[0] && db_write_rrdcached(buf->dbName, upd_argc, upd_args) == 0) {
+        metrics_record(METRIC_RRD_UPDATE, start, METRIC_OK);
+        buf->count = 0;
+        buf->failures = 0;
+        return 0;
+    }
+    optind = 0;
+    rrd_clear_error();
+    if (rrd_update_r(buf->dbName, NULL, upd_argc, upd_args) != -1) {
+        metrics_record(METRIC_RRD_UPDATE, start, METRIC_OK);
+        buf->count = 0;
+        buf->failures = 0;
+        return 0;
+    }
+    LOGGER_ERROR(LOG_MOD_DB, "RRD update error: %s", rrd_get_error());
+    metrics_record(METRIC_RRD_UPDATE, start, METRIC_FAIL);
+
+    rrd_clear_error();
+    time_t last = rrd_last_r(buf->dbName);
+    if (last <= 0) return -1; // File unreadable: keep everything until it is back
+    unsigned int written = 0;
+    while (written < buf->count && strtol(buf->updates[written], NULL, 10) <= last) written++;
+    db_buffer_remove(buf, written);
+    if (written > 0) {
+        buf->failures = 0;
+    } else if (++buf->failures >= DB_WRITE_RETRIES) {
+        LOGGER_ERROR(LOG_MOD_DB, "Dropping reading refused %u times by %s: %.20s",
+                     buf->failures, buf->dbName, buf->updates[0]);
+        metrics_count(METRIC_COUNTER_DB_DROPPED, 1);
+        db_buffer_remove(buf, 1);
+        buf->failures = 0;
+    }
+    return buf->count == 0 ? 0 : -1;
+}
+
 int db_add_entry(const char *dbName, const DBEntry *entry) {
-    // Prepare timestamp (date + time to UNIX timestamp)
-    struct tm tm;
-    memset(&tm, 0, sizeof(tm));
-    strptime(entry->date, "%Y-%m-%d", &tm);
-    strptime(entry->time, "%H:%M:%S", &tm);
-    time_t t = mktime(&tm);
-    char timestamp[32];
-    snprintf(timestamp, sizeof(timestamp), "%ld", (long)t);
+    // Prepare timestamp: use the entry's UNIX time when set, otherwise parse date + time
+    time_t t = entry->timestamp;
+    if (t == 0) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        strptime(entry->date, "%Y-%m-%d", &tm);
+        strptime(entry->time, "%H:%M:%S", &tm);
+        tm.tm_isdst = -1;
+        t = mktime(&tm);
+    }
+    DBWriteBuffer *buf = db_get_buffer(dbName);
+    if (!buf) {
+        LOGGER_ERROR(LOG_MOD_DB, "RRD update error: too many databases");
+        return -1;
+    }
+    int ret = 0;
+    pthread_mutex_lock(&buf->lock);
+    if (t <= buf->last_queued) {
+        // RRD timestamps are whole seconds and must increase, so a second reading in the
+        // same second (readingIntervalMs under 1000) or one from a clock that went back
+        // cannot be stored. The history ring and events still have it.
+        metrics_count(METRIC_COUNTER_DB_DROPPED, 1);
+        if (!buf->warned_order) {
+            LOGGER_WARN(LOG_MOD_DB, "Reading at %ld not stored in %s: last update is %ld (further ones are counted in db_readings_dropped)",
+                        (long)t, dbName, (long)buf->last_queued);
+            buf->warned_order = true;
+        } else {
+            LOGGER_DEBUG(LOG_MOD_DB, "Reading at %ld not stored in %s: last update is %ld",
+                         (long)t, dbName, (long)buf->last_queued);
+        }
+        pthread_mutex_unlock(&buf->lock);
+        return 0;
+    }
+    if (buf->count == DB_MAX_BATCH) {
+        // Writes have failed for a long time; make room by dropping the oldest update
+        LOGGER_ERROR(LOG_MOD_DB, "Write buffer for %s is full, dropping its oldest reading", dbName);
+        metrics_count(METRIC_COUNTER_DB_DROPPED, 1);
+        db_buffer_remove(buf, 1);
+    }
     // Prepare update string
-    char update[512];
-    snprintf(update, sizeof(update), "%s:%.8f:%.8f:%.8f:%d:%d:%.8f:%.8f:%.8f:%.8f:%.8f",
-        timestamp,
+    snprintf(buf->updates[buf->count], DB_UPDATE_LEN, "%ld:%.8f:%.8f:%.8f:%d:%d:%.8f:%.8f:%.8f:%.8f:%.8f",
+        (long)t,
         entry->latitude,
         entry->longitude,
         entry->elevation,
@@ -55,35 +362,254 @@ int db_add_entry(const char *dbName, const DBEntry *entry) {
         entry->siteTemp,
         entry->sitePressure,
         entry->siteHumidity);
-    const char *upd_args[] = { update };
-    int upd_argc = 1;
-    optind = 0;
-    rrd_clear_error();
-    if (rrd_update_r(dbName, NULL, upd_argc, upd_args) == -1) {
-        fprintf(stderr, "RRD update error: %s\n", rrd_get_error());
-        return -1;
+    buf->count++;
+    buf->last_queued = t;
+    if (buf->count >= db_batch_size) ret = db_write_buffer(buf);
+    pthread_mutex_unlock(&buf->lock);
+    return ret;
+}
+
+int db_flush(const char *dbName) {
+    DBWriteBuffer *buf = NULL;
+    pthread_mutex_lock(&db_buffers_lock);
+    for (int i = 0; i < db_num_buffers; ++i) {
+        if (strcmp(db_buffers[i].dbName, dbName) == 0) buf = &db_buffers[i];
     }
-    return 0;
+    pthread_mutex_unlock(&db_buffers_lock);
+    if (!buf) return 0;
+    pthread_mutex_lock(&buf->lock);
+    int ret = db_write_buffer(buf);
+    pthread_mutex_unlock(&buf->lock);
+    return ret;
+}
+
+int db_flush_all(void) {
+    pthread_mutex_lock(&db_buffers_lock);
+    int n = db_num_buffers;
+    pthread_mutex_unlock(&db_buffers_lock);
+    int ret = 0;
+    for (int i = 0; i < n; ++i) {
+        pthread_mutex_lock(&db_buffers[i].lock);
+        if (db_write_buffer(&db_buffers[i]) != 0) ret = -1;
+        pthread_mutex_unlock(&db_buffers[i].lock);
+    }
+    return ret;
+}
+
+void db_close(void) {
+    db_flush_all();
+    pthread_mutex_lock(&db_buffers_lock);
+    if (db_rrdcached_connected) {
+        // Ask rrdcached to write our files to disk before we go
+        for (int i = 0; i < db_num_buffers; ++i) rrdc_flush(db_buffers[i].dbName);
+        rrdc_disconnect();
+        db_rrdcached_connected = false;
+    }
+    pthread_mutex_unlock(&db_buffers_lock);
 }
 
-int db_fetch_entries(const char *dbName, time_t start, time_t end, char ***ds_names, unsigned long *step, unsigned long *nrows, rrd_value_t **data) {
-    // Use rrd_fetch to get data between start and end
-    const char *cf = "AVERAGE";
+struct DBExport {
+    char dbName[256];
+    char cf[8];            // Consolidation function: AVERAGE, MIN, or MAX
+    bool binary;
+    bool header_sent;
+    time_t next_start;     // Start of the next window to fetch
+    time_t end;            // End of the requested range
+    unsigned long step;    // Resolution requested, then the one chosen by the first fetch
+    unsigned long ds_cnt;
+    char **ds_names;
+    rrd_value_t *data;     // Current window, ds_cnt values per row
+    unsigned long rows;    // Rows in the current window
+    unsigned long row;     // Next row of the window to send
+    time_t first_time;     // Timestamp of row 0 of the current window
+    unsigned long total_rows;
+    bool gzip;             // Output goes through zs into ztext
+    bool raw_done;         // All uncompressed output has been handed to zs
+    bool gzip_done;        // zs has written the gzip trailer
+    z_stream zs;
+    char text[DB_EXPORT_CHUNK_SIZE]; // Header and CSV output
+    unsigned char ztext[DB_EXPORT_CHUNK_SIZE]; // Compressed output
+};
+
+/*
+ * Frees the current window's data and data source names.
+ */
+static void db_export_free_window(DBExport *ex) {
+    if (ex->ds_names) {
+        for (unsigned long i = 0; i < ex->ds_cnt; ++i) rrd_freemem(ex->ds_names[i]);
+        rrd_freemem(ex->ds_names);
+        ex->ds_names = NULL;
+    }
+    if (ex->data) {
+        rrd_freemem(ex->data);
+        ex->data = NULL;
+    }
+    ex->rows = ex->row = 0;
+}
+
+/*
+ * Fetches the next window of at most DB_EXPORT_WINDOW_ROWS rows. The first call asks
+ * for a single row at the requested step, so the RRD picks the archive for the start
+ * time; later windows request the step it chose so the whole export has one resolution.
+ * Returns 0 on success, -1 on error.
+ */
+static int db_export_fetch(DBExport *ex) {
+    db_export_free_window(ex);
+    time_t start = ex->next_start;
+    time_t end = ex->header_sent ? start + (time_t)(ex->step * DB_EXPORT_WINDOW_ROWS) : start + (time_t)ex->step;
+    if (end > ex->end) end = ex->end;
+    unsigned long step = ex->step;
+    unsigned long ds_cnt = 0;
     optind = 0;
     rrd_clear_error();
-    *ds_names = NULL;
-    *data = NULL;
-    int ret = rrd_fetch_r(dbName, cf, &start, &end, step, nrows, ds_names, data);
-    if (ret != 0) {
-        fprintf(stderr, "RRD fetch error: %s\n", rrd_get_error());
+    if (rrd_fetch_r(ex->dbName, ex->cf, &start, &end, &step, &ds_cnt, &ex->ds_names, &ex->data) != 0) {
+        LOGGER_ERROR(LOG_MOD_DB, "RRD fetch error: %s", rrd_get_error());
+        ex->ds_names = NULL;
+        ex->data = NULL;
         return -1;
     }
+    ex->step = step;
+    ex->ds_cnt = ds_cnt;
+    ex->rows = step ? (unsigned long)(end - start) / step : 0;
+    ex->first_time = start + (time_t)step;
+    ex->next_start = end;
     return 0;
 }
 
+DBExport *db_export_open(const char *dbName, time_t start, time_t end, const char *cf, unsigned long step, bool binary,
+                         int gzip_level) {
+    if (end <= start) return NULL;
+    DBExport *ex = calloc(1, sizeof(DBExport));
+    if (!ex) return NULL;
+    if (gzip_level > 0) {
+        // windowBits 15 + 16 selects the gzip wrapper; memLevel 8 is zlib's default
+        if (deflateInit2(&ex->zs, gzip_level > 9 ? 9 : gzip_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(ex);
+            return NULL;
+        }
+        ex->gzip = true;
+    }
+    strncpy(ex->dbName, dbName, sizeof(ex->dbName)-1);
+    strncpy(ex->cf, cf, sizeof(ex->cf)-1);
+    ex->step = step ? step : 1;
+    ex->binary = binary;
+    ex->next_start = start;
+    ex->end = end;
+    return ex;
+}
+
+int db_export_start(DBExport *ex) {
+    // Make sure buffered readings are on disk before reading the file
+    db_flush(ex->dbName);
+    pthread_mutex_lock(&db_buffers_lock);
+    if (db_rrdcached_connected) rrdc_flush(ex->dbName);
+    pthread_mutex_unlock(&db_buffers_lock);
+    return db_export_fetch(ex);
+}
+
+/*
+ * Produces the next chunk of uncompressed output (header, CSV lines, or binary rows).
+ * Returns 1 if a chunk was produced, 0 when the export is complete, -1 on error.
+ */
+static int db_export_next_raw(DBExport *ex, const void **data, size_t *len) {
+    if (!ex->header_sent) {
+        // CSV: a column header line. Binary: "NWX1 <first time> <step> <ds count> <names>" followed by the rows.
+        size_t offset = (size_t)snprintf(ex->text, sizeof(ex->text), ex->binary ? "NWX1 %ld %lu %lu " : "time",
+                                         (long)ex->first_time, ex->step, ex->ds_cnt);
+        for (unsigned long i = 0; i < ex->ds_cnt && offset < sizeof(ex->text); ++i) {
+            offset += (size_t)snprintf(ex->text + offset, sizeof(ex->text) - offset, "%s%s",
+                                       ex->binary ? (i ? "," : "") : ",", ex->ds_names[i]);
+        }
+        if (offset >= sizeof(ex->text) - 1) offset = sizeof(ex->text) - 2;
+        ex->text[offset++] = '\n';
+        ex->header_sent = true;
+        *data = ex->text;
+        *len = offset;
+        return 1;
+    }
+    while (ex->row >= ex->rows) {
+        if (ex->next_start >= ex->end) return 0;
+        if (db_export_fetch(ex) != 0) return -1;
+    }
+    size_t row_size = ex->ds_cnt * sizeof(rrd_value_t);
+    if (ex->binary) {
+        unsigned long n = row_size ? DB_EXPORT_CHUNK_SIZE / row_size : ex->rows - ex->row;
+        if (n == 0) n = 1;
+        if (n > ex->rows - ex->row) n = ex->rows - ex->row;
+        *data = (const char *)ex->data + ex->row * row_size;
+        *len = n * row_size;
+        ex->row += n;
+        ex->total_rows += n;
+        return 1;
+    }
+    // CSV: format whole rows until the next one might not fit
+    size_t offset = 0;
+    size_t max_line = 24 + ex->ds_cnt * 26;
+    while (ex->row < ex->rows && offset + max_line < sizeof(ex->text)) {
+        const rrd_value_t *values = ex->data + ex->row * ex->ds_cnt;
+        offset += (size_t)snprintf(ex->text + offset, sizeof(ex->text) - offset, "%ld",
+                                   (long)(ex->first_time + (time_t)(ex->row * ex->step)));
+        for (unsigned long i = 0; i < ex->ds_cnt; ++i) {
+            offset += (size_t)snprintf(ex->text + offset, sizeof(ex->text) - offset, ",%.10g", values[i]);
+        }
+        ex->text[offset++] = '\n';
+        ex->row++;
+        ex->total_rows++;
+    }
+    *data = ex->text;
+    *len = offset;
+    return 1;
+}
+
+/*
+ * Fills ztext with compressed output, pulling uncompressed chunks as zlib consumes them.
+ * A raw chunk only has to stay valid until the next db_export_next_raw call, and zlib
+ * never asks for more input before it has taken all of the current chunk.
+ * Returns 1 if a chunk was produced, 0 when the gzip stream is complete, -1 on error.
+ */
+static int db_export_next_gzip(DBExport *ex, const void **data, size_t *len) {
+    ex->zs.next_out = ex->ztext;
+    ex->zs.avail_out = sizeof(ex->ztext);
+    while (ex->zs.avail_out > 0 && !ex->gzip_done) {
+        if (ex->zs.avail_in == 0 && !ex->raw_done) {
+            const void *raw;
+            size_t raw_len;
+            int ret = db_export_next_raw(ex, &raw, &raw_len);
+            if (ret < 0) return -1;
+            if (ret == 0) {
+                ex->raw_done = true;
+            } else {
+                ex->zs.next_in = (Bytef *)raw;
+                ex->zs.avail_in = (uInt)raw_len;
+            }
+        }
+        int zret = deflate(&ex->zs, ex->raw_done ? Z_FINISH : Z_NO_FLUSH);
+        if (zret == Z_STREAM_END) ex->gzip_done = true;
+        else if (zret == Z_STREAM_ERROR) return -1;
+    }
+    *data = ex->ztext;
+    *len = sizeof(ex->ztext) - ex->zs.avail_out;
+    return *len > 0 ? 1 : 0;
+}
+
+int db_export_next(DBExport *ex, const void **data, size_t *len) {
+    return ex->gzip ? db_export_next_gzip(ex, data, len) : db_export_next_raw(ex, data, len);
+}
+
+unsigned long db_export_rows(const DBExport *ex) {
+    return ex->total_rows;
+}
+
+void db_export_close(DBExport *ex) {
+    if (!ex) return;
+    db_export_free_window(ex);
+    if (ex->gzip) deflateEnd(&ex->zs);
+    free(ex);
+}
+
 int db_delete_entry(const char *dbName, const char *date, const char *time) {
     // Not supported by rrdtool; would require export, edit, and re-import
-    printf("[STUB] Delete entry from %s at %s %s\n", dbName, date, time);
+    LOGGER_WARN(LOG_MOD_DB, "[STUB] Delete entry from %s at %s %s", dbName, date, time);
     return -1;
 }
 
@@ -3,8 +3,20 @@
 
 #include "nightwatcher.h"
 #include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
-#include <rrd.h>
+
+#define DB_STEP          60  // Seconds per primary data point
+#define DB_MAX_ARCHIVES  8   // Resolutions per database
+// Raw for 2 days, 5 minutes for 30 days, hourly for a year, daily for 10 years
+#define DB_DEFAULT_ARCHIVES "1:2880,5:8640,60:8760,1440:3650"
+#define DB_UPDATE_LEN    192 // Longest formatted rrd_update argument
+#define DB_MAX_BATCH     256 // Most updates buffered per database
+#define DB_WRITE_RETRIES 5   // Failed writes of the same update before it is dropped
+#define DB_MAX_BUFFERS   (NW_MAX_DEVICES + 8) // Databases with a write buffer
+#define DB_EXPORT_WINDOW_ROWS 4096        // Rows fetched per rrd_fetch_r call during an export
+#define DB_EXPORT_CHUNK_SIZE  (64 * 1024) // Largest chunk an export hands out at once
+#define DB_EXPORT_GZIP_LEVEL  6           // Compression level for "db export ... gzip"
 
 // Structure for a database entry
 typedef struct {
@@ -21,14 +33,50 @@ typedef struct {
     float siteTemp;
     float sitePressure;
     float siteHumidity;
+    time_t timestamp;        // UNIX time of the reading; 0 means derive it from date and time
 } DBEntry;
 
+// Sets the archive resolutions from a "steps:rows,steps:rows,..." list (NULL or empty for the
+// default). Each resolution keeps AVERAGE, MIN, and MAX. Returns 0 on success, -1 if invalid.
+int db_configure_archives(const char *spec);
 // Create a new RRD database with the given name (site.dbName)
 int db_create(const char *dbName);
-// Add an entry to the database
+// Rebuilds an existing database whose archives (consolidation function, steps, and rows) differ
+// from the configured set, carrying its data over. Returns 0 if the file is current or was
+// migrated, -1 on error.
+int db_upgrade(const char *dbName);
+// Sets up the write path: batch_size updates are buffered per database and written with one
+// rrd_update call (1 writes every entry immediately). A non-empty rrdcached_addr sends the
+// updates to rrdcached instead, falling back to direct writes if it cannot be reached.
+void db_configure_writes(unsigned int batch_size, const char *rrdcached_addr);
+// Add an entry to the database (buffered; written once the batch is full)
 int db_add_entry(const char *dbName, const DBEntry *entry);
-// Fetch entries using rrd_fetch()
-int db_fetch_entries(const char *dbName, time_t start, time_t end, char ***ds_names, unsigned long *step, unsigned long *nrows, rrd_value_t **data);
+// Write any buffered entries for one database
+int db_flush(const char *dbName);
+// Write buffered entries for every database
+int db_flush_all(void);
+// Flush everything and disconnect from rrdcached; call before exiting
+void db_close(void);
+// Streaming export of a time range, fetched from the RRD one window at a time
+typedef struct DBExport DBExport;
+// Starts an export of dbName between start and end from the archives with consolidation
+// function cf. step asks for a resolution in seconds (0 = finest archive covering start);
+// the RRD picks the closest archive. binary selects raw rows of doubles (rrd_value_t) in native byte order instead of CSV. gzip_level 1-9
+// compresses the whole output as one gzip stream (0 = uncompressed). Nothing is read here, so it is cheap enough
+// for the control server's event loop. Returns NULL on error.
+DBExport *db_export_open(const char *dbName, time_t start, time_t end, const char *cf, unsigned long step, bool binary,
+                         int gzip_level);
+// Flushes buffered readings for the database and fetches the first window, so a bad database or range
+// is reported before anything is sent. Call once before db_export_next. Returns 0 on success, -1 on error.
+int db_export_start(DBExport *ex);
+// Produces the next chunk of output in *data/*len; the data stays valid until the next call.
+// Binary chunks point straight into the fetched matrix. Returns 1 if a chunk was produced,
+// 0 when the export is complete, -1 on error.
+int db_export_next(DBExport *ex, const void **data, size_t *len);
+// Number of rows produced so far
+unsigned long db_export_rows(const DBExport *ex);
+// Frees an export, finished or not
+void db_export_close(DBExport *ex);
 // Delete an entry (by date/time or index)
 int db_delete_entry(const char *dbName, const char *date, const char *time);
 // Delete the entire database
@@ -0,0 +1,174 @@
+/*
+ * Project: NightWatcher
+ * File: dt_record_bench.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * dt record benchmark: encodes and decodes the binary record (dt_record.h) and, for
+ * comparison, the comma-separated text record with the same fields as serialize_dt,
+ * parsed with strtok the way nwconsole used to. Reports nanoseconds per record and
+ * record sizes.
+ */
+#include "dt_record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define BENCH_TEXT_FIELDS 64 // Most comma-separated tokens kept; the raw rx and ix responses add commas of their own
+#define BENCH_TEXT_SIZE   2048
+
+// A dt record's worth of site, device, and weather values
+typedef struct {
+    char site_name[64];
+    char ip[32];
+    float latitude, longitude, elevation;
+    unsigned int reading_interval, heartbeat_interval, read_timeout, weather_interval;
+    unsigned int control_port, sqm_port;
+    int sqm_model, sqm_serial;
+    float calibration, mpsqa, sensor_period_secs, sensor_temp;
+    int sensor_freq, sensor_period_count;
+    double temperature_f, humidity, wind_speed_mph, wind_gust_mph, pressure_in, rainfall_in;
+    char reading_timestamp[20];
+    char weather_timestamp[32];
+} BenchValues;
+
+static volatile double sink; // Keeps decoded values from being optimized away
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void fill_values(BenchValues *v) {
+    memset(v, 0, sizeof(*v));
+    strcpy(v->site_name, "Kitt Peak Dark Sky Site");
+    strcpy(v->ip, "192.168.1.40");
+    v->latitude = 31.9583f; v->longitude = -111.5967f; v->elevation = 2096.0f;
+    v->reading_interval = 60; v->heartbeat_interval = 30; v->read_timeout = 5; v->weather_interval = 300;
+    v->control_port = 8080; v->sqm_port = 10001;
+    v->sqm_model = 3; v->sqm_serial = 2921;
+    v->calibration = 19.86f; v->mpsqa = 21.37f; v->sensor_period_secs = 0.000043f; v->sensor_temp = 12.5f;
+    v->sensor_freq = 22921; v->sensor_period_count = 20;
+    v->temperature_f = 48.2; v->humidity = 31.0; v->wind_speed_mph = 3.4; v->wind_gust_mph = 7.9;
+    v->pressure_in = 23.01; v->rainfall_in = 0.0;
+    strcpy(v->reading_timestamp, "2026-10-18 03:14:15");
+    strcpy(v->weather_timestamp, "2026-10-18T03:10:00.000Z");
+}
+
+/*
+ * Encodes the binary record. Returns its length.
+ */
+static size_t encode_bin(unsigned char *buf, const BenchValues *v, int i) {
+    DtRecord *rec = (DtRecord *)buf;
+    memset(rec, 0, sizeof(*rec));
+    rec->flags = DT_FLAG_SITE_HEALTHY | DT_FLAG_SQM_READ | DT_FLAG_WEATHER | DT_FLAG_READING_READY | DT_FLAG_DEVICE_HEALTHY;
+    rec->num_devices = 1;
+    rec->latitude = v->latitude; rec->longitude = v->longitude; rec->elevation = v->elevation;
+    rec->reading_interval = v->reading_interval; rec->heartbeat_interval = v->heartbeat_interval;
+    rec->read_timeout = v->read_timeout; rec->weather_interval = v->weather_interval;
+    rec->control_port = (uint16_t)v->control_port; rec->sqm_port = (uint16_t)v->sqm_port;
+    rec->sqm_model = v->sqm_model; rec->sqm_serial = v->sqm_serial;
+    rec->calibration = v->calibration; rec->mpsqa = v->mpsqa + (float)(i & 7);
+    rec->sensor_freq = v->sensor_freq; rec->sensor_period_count = v->sensor_period_count;
+    rec->sensor_period_secs = v->sensor_period_secs; rec->sensor_temp = v->sensor_temp;
+    rec->temperature_f = v->temperature_f; rec->humidity = v->humidity;
+    rec->wind_speed_mph = v->wind_speed_mph; rec->wind_gust_mph = v->wind_gust_mph;
+    rec->pressure_in = v->pressure_in; rec->rainfall_in = v->rainfall_in;
+    memcpy(rec->reading_timestamp, v->reading_timestamp, strnlen(v->reading_timestamp, sizeof(rec->reading_timestamp) - 1));
+    memcpy(rec->weather_timestamp, v->weather_timestamp, strnlen(v->weather_timestamp, sizeof(rec->weather_timestamp) - 1));
+    size_t name_len = strlen(v->site_name), ip_len = strlen(v->ip);
+    memcpy(buf + sizeof(DtRecord), v->site_name, name_len);
+    memcpy(buf + sizeof(DtRecord) + name_len, v->ip, ip_len);
+    return dt_record_finish(rec, name_len, ip_len);
+}
+
+/*
+ * Encodes the text record with serialize_dt's fields and formats. Returns its length.
+ */
+static size_t encode_text(char *buf, const BenchValues *v, int i) {
+    int n = snprintf(buf, BENCH_TEXT_SIZE,
+        "%s,%f,%f,%f,%d,%d,%s,%u,%s,%u,%u,%s,%u,%u,%s,%s,%u,%s,%s,%d,%d,"
+        "%d,%d,%s,%d,%d,%s,%s,%d,%f,%s,%f,%d,%d,%f,%f,"
+        "%f,%f,%f,%f,%f,%f,%s,%d",
+        v->site_name, v->latitude, v->longitude, v->elevation, v->sqm_model, v->sqm_serial, v->ip, v->sqm_port,
+        "./nightwatcher.rrd", v->reading_interval, v->control_port, "true", v->heartbeat_interval, v->read_timeout,
+        "true", "true", v->weather_interval, "0123456789abcdef0123456789abcdef", "fedcba9876543210fedcba9876543210", 1, 0,
+        v->sqm_model, v->sqm_serial, v->ip, v->sqm_port, 7, "r, 21.37m,0000022921Hz,0000000020c,0000000.000s, 012.5C",
+        v->reading_timestamp, 1, v->calibration, "i,00000004,00000003,00000023,00002921", v->mpsqa + (float)(i & 7),
+        v->sensor_freq, v->sensor_period_count, v->sensor_period_secs, v->sensor_temp,
+        v->temperature_f, v->humidity, v->wind_speed_mph, v->wind_gust_mph, v->pressure_in, v->rainfall_in,
+        v->weather_timestamp, 1);
+    return n > 0 ? (size_t)n : 0;
+}
+
+/*
+ * Decodes the binary record and returns a value from it.
+ */
+static double decode_bin(const unsigned char *buf, size_t len) {
+    DtRecord rec;
+    char site_name[DT_RECORD_MAX_NAME + 1];
+    if (dt_record_decode(buf, len, &rec, site_name, NULL) != 0) return -1;
+    return rec.mpsqa + rec.temperature_f + site_name[0];
+}
+
+/*
+ * Splits the text record with strtok and converts the fields nwconsole shows.
+ */
+static double decode_text(const char *text, size_t len) {
+    char copy[BENCH_TEXT_SIZE];
+    memcpy(copy, text, len + 1);
+    char *fields[BENCH_TEXT_FIELDS];
+    int n = 0;
+    for (char *tok = strtok(copy, ","); tok && n < BENCH_TEXT_FIELDS; tok = strtok(NULL, ",")) fields[n++] = tok;
+    if (n < 44) return -1;
+    return atof(fields[31]) + atof(fields[36]) + atof(fields[1]) + atof(fields[2]) + atof(fields[35]) +
+           atof(fields[37]) + atof(fields[40]) + atoi(fields[22]) + fields[0][0];
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 1000000;
+    int c;
+    while ((c = getopt(argc, argv, "n:h")) != -1) {
+        switch (c) {
+        case 'n': iterations = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-n ITERATIONS] (default 1000000)\n", argv[0]);
+            return c == 'h' ? 0 : 2;
+        }
+    }
+    if (iterations < 1) return 2;
+    BenchValues v;
+    fill_values(&v);
+    unsigned char bin[sizeof(DtRecord) + 2 * DT_RECORD_MAX_NAME];
+    char text[BENCH_TEXT_SIZE];
+    size_t bin_len = 0, text_len = 0;
+    double total = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; ++i) bin_len = encode_bin(bin, &v, i);
+    double bin_encode = (double)(now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) total += decode_bin(bin, bin_len);
+    double bin_decode = (double)(now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) text_len = encode_text(text, &v, i);
+    double text_encode = (double)(now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) total += decode_text(text, text_len);
+    double text_decode = (double)(now_ns() - start) / iterations;
+    sink = total;
+
+    printf("iterations:  %d\n", iterations);
+    printf("             %10s %10s %10s\n", "bytes", "encode ns", "decode ns");
+    printf("binary:      %10zu %10.1f %10.1f\n", bin_len, bin_encode, bin_decode);
+    printf("text:        %10zu %10.1f %10.1f\n", text_len, text_encode, text_decode);
+    printf("binary/text: %9.0f%% %9.0f%% %9.0f%%\n", 100.0 * bin_len / text_len,
+           100.0 * bin_encode / text_encode, 100.0 * bin_decode / text_decode);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Project: NightWatcher
+ * File: dt_record.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "dt_record.h"
+#include <string.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static void swap16(void *p) { uint16_t v; memcpy(&v, p, 2); v = __builtin_bswap16(v); memcpy(p, &v, 2); }
+static void swap32(void *p) { uint32_t v; memcpy(&v, p, 4); v = __builtin_bswap32(v); memcpy(p, &v, 4); }
+static void swap64(void *p) { uint64_t v; memcpy(&v, p, 8); v = __builtin_bswap64(v); memcpy(p, &v, 8); }
+
+/*
+ * Converts the multi-byte fields of a record between host and little-endian order.
+ * Only compiled on big-endian hosts; on little-endian hosts the wire form is the host form.
+ */
+static void dt_record_swap(DtRecord *rec) {
+    swap16(&rec->version); swap16(&rec->length); swap32(&rec->flags);
+    swap16(&rec->device_index); swap16(&rec->num_devices);
+    swap32(&rec->latitude); swap32(&rec->longitude); swap32(&rec->elevation);
+    swap32(&rec->reading_interval); swap32(&rec->heartbeat_interval);
+    swap32(&rec->read_timeout); swap32(&rec->weather_interval);
+    swap16(&rec->control_port); swap16(&rec->sqm_port);
+    swap32(&rec->sqm_model); swap32(&rec->sqm_serial);
+    swap32(&rec->calibration); swap32(&rec->mpsqa);
+    swap32(&rec->sensor_freq); swap32(&rec->sensor_period_count);
+    swap32(&rec->sensor_period_secs); swap32(&rec->sensor_temp);
+    swap64(&rec->temperature_f); swap64(&rec->humidity);
+    swap64(&rec->wind_speed_mph); swap64(&rec->wind_gust_mph);
+    swap64(&rec->pressure_in); swap64(&rec->rainfall_in);
+}
+#else
+#define dt_record_swap(rec) ((void)(rec))
+#endif
+
+size_t dt_record_finish(DtRecord *rec, size_t site_name_len, size_t ip_len) {
+    size_t len = sizeof(DtRecord) + site_name_len + ip_len;
+    memcpy(rec->magic, DT_RECORD_MAGIC, sizeof(rec->magic));
+    rec->version = DT_RECORD_VERSION;
+    rec->length = (uint16_t)len;
+    rec->site_name_len = (uint8_t)site_name_len;
+    rec->ip_len = (uint8_t)ip_len;
+    dt_record_swap(rec);
+    return len;
+}
+
+int dt_record_decode(const void *buf, size_t len, DtRecord *rec, char *site_name, char *ip) {
+    if (len < sizeof(DtRecord)) return -1;
+    memcpy(rec, buf, sizeof(DtRecord));
+    dt_record_swap(rec);
+    if (memcmp(rec->magic, DT_RECORD_MAGIC, sizeof(rec->magic)) != 0 || rec->version != DT_RECORD_VERSION) return -1;
+    if (rec->length != sizeof(DtRecord) + rec->site_name_len + rec->ip_len || rec->length > len) return -1;
+    const char *names = (const char *)buf + sizeof(DtRecord);
+    if (site_name) {
+        memcpy(site_name, names, rec->site_name_len);
+        site_name[rec->site_name_len] = '\0';
+    }
+    if (ip) {
+        memcpy(ip, names + rec->site_name_len, rec->ip_len);
+        ip[rec->ip_len] = '\0';
+    }
+    return 0;
+}
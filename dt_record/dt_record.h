@@ -0,0 +1,77 @@
+/*
+ * Project: NightWatcher
+ * File: dt_record.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef DT_RECORD_H
+#define DT_RECORD_H
+
+// Binary form of the dt record, sent for "dt bin [n]". Every field is little-endian.
+// This header stands alone so clients such as nwconsole can decode records without the daemon's headers.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DT_RECORD_MAGIC   "NWDT"
+#define DT_RECORD_VERSION 1
+#define DT_RECORD_MAX_NAME 255  // Longest site name or device address carried in a record
+
+// DtRecord.flags bits
+#define DT_FLAG_SITE_HEALTHY     0x0001 // healthy flag of the primary device (index 0)
+#define DT_FLAG_SQM_READ         0x0002 // Periodic readings on (start/stop, snapshot_sqm_read)
+#define DT_FLAG_READ_ON_STARTUP  0x0004 // site->enableReadOnStartup
+#define DT_FLAG_WEATHER          0x0008 // site->enableWeather
+#define DT_FLAG_DATA_SEND        0x0010 // site->enableDataSend
+#define DT_FLAG_READING_READY    0x0020 // dev->reading_ready
+#define DT_FLAG_DEVICE_HEALTHY   0x0040 // dev->healthy
+#define DT_FLAG_WEATHER_READY    0x0080 // weather->weatherReady
+
+// Fixed part of a version 1 record. It is followed by site_name_len bytes of site name
+// and then ip_len bytes of device address, neither NUL-terminated.
+typedef struct __attribute__((__packed__)) {
+    char     magic[4];             // DT_RECORD_MAGIC
+    uint16_t version;              // DT_RECORD_VERSION
+    uint16_t length;               // Whole record in bytes, names included
+    uint32_t flags;                // DT_FLAG_* bits
+    uint16_t device_index;
+    uint16_t num_devices;
+    float    latitude;
+    float    longitude;
+    float    elevation;
+    uint32_t reading_interval;     // Seconds
+    uint32_t heartbeat_interval;   // Seconds
+    uint32_t read_timeout;         // Seconds
+    uint32_t weather_interval;     // Seconds
+    uint16_t control_port;
+    uint16_t sqm_port;
+    int32_t  sqm_model;
+    int32_t  sqm_serial;
+    float    calibration;
+    float    mpsqa;
+    int32_t  sensor_freq;          // Hz
+    int32_t  sensor_period_count;
+    float    sensor_period_secs;
+    float    sensor_temp;          // C
+    double   temperature_f;
+    double   humidity;
+    double   wind_speed_mph;
+    double   wind_gust_mph;
+    double   pressure_in;
+    double   rainfall_in;
+    char     reading_timestamp[20]; // "YYYY-MM-DD HH:MM:SS", NUL-padded
+    char     weather_timestamp[32]; // As reported by the weather service, NUL-padded
+    uint8_t  site_name_len;
+    uint8_t  ip_len;
+} DtRecord;
+
+// Finishes a record filled in host byte order: sets the header and converts it to little-endian.
+// The names must already follow the fixed part. Returns the record length.
+size_t dt_record_finish(DtRecord *rec, size_t site_name_len, size_t ip_len);
+
+// Checks the record in buf (len bytes) and copies its fixed part into rec in host byte order.
+// site_name and ip, when not NULL, receive the names NUL-terminated (DT_RECORD_MAX_NAME + 1 bytes each).
+// Returns 0 on success, -1 if buf is not a complete version 1 record.
+int dt_record_decode(const void *buf, size_t len, DtRecord *rec, char *site_name, char *ip);
+
+#endif // DT_RECORD_H
@@ -0,0 +1,207 @@
+/*
+ * Project: NightWatcher
+ * File: dt_record_test.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * Round-trip tests for the binary dt record: records encoded with dt_record_finish decode
+ * to the same fields and names, the wire layout stays what version 1 clients expect, and
+ * truncated or malformed records are refused. Exits nonzero if any check fails.
+ */
+#include "dt_record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#define DT_RECORD_V1_SIZE 182 // Fixed part of a version 1 record on the wire
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    checks++; \
+    if (!(cond)) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+/*
+ * Builds a record with the given names and values derived from seed.
+ * Returns the encoded length.
+ */
+static size_t build_record(unsigned char *buf, const char *site_name, const char *ip, int seed) {
+    DtRecord *rec = (DtRecord *)buf;
+    memset(rec, 0, sizeof(*rec));
+    rec->flags = DT_FLAG_SITE_HEALTHY | DT_FLAG_WEATHER | DT_FLAG_READING_READY | (seed & 1 ? DT_FLAG_DATA_SEND : 0);
+    rec->device_index = (uint16_t)(seed % 16);
+    rec->num_devices = 16;
+    rec->latitude = 31.9583f + (float)seed;
+    rec->longitude = -111.5967f;
+    rec->elevation = 2096.0f;
+    rec->reading_interval = 60;
+    rec->heartbeat_interval = 30;
+    rec->read_timeout = 5;
+    rec->weather_interval = 300;
+    rec->control_port = 8080;
+    rec->sqm_port = 10001;
+    rec->sqm_model = 3;
+    rec->sqm_serial = 2921 + seed;
+    rec->calibration = 19.86f;
+    rec->mpsqa = 21.37f + (float)seed / 100.0f;
+    rec->sensor_freq = 22921;
+    rec->sensor_period_count = INT32_MIN + seed;
+    rec->sensor_period_secs = 0.000043f;
+    rec->sensor_temp = -12.5f;
+    rec->temperature_f = 48.2 + seed;
+    rec->humidity = 31.0;
+    rec->wind_speed_mph = 3.4;
+    rec->wind_gust_mph = 7.9;
+    rec->pressure_in = 23.01;
+    rec->rainfall_in = 0.0;
+    strncpy(rec->reading_timestamp, "2026-10-18 03:14:15", sizeof(rec->reading_timestamp));
+    strncpy(rec->weather_timestamp, "2026-10-18T03:10:00.000Z", sizeof(rec->weather_timestamp));
+    size_t name_len = strlen(site_name), ip_len = strlen(ip);
+    memcpy(buf + sizeof(DtRecord), site_name, name_len);
+    memcpy(buf + sizeof(DtRecord) + name_len, ip, ip_len);
+    return dt_record_finish(rec, name_len, ip_len);
+}
+
+// Helper: reads a little-endian value from the wire form
+static uint32_t le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void test_round_trip(const char *site_name, const char *ip, int seed) {
+    unsigned char buf[sizeof(DtRecord) + 2 * DT_RECORD_MAX_NAME];
+    size_t len = build_record(buf, site_name, ip, seed);
+    CHECK(len == DT_RECORD_V1_SIZE + strlen(site_name) + strlen(ip));
+
+    DtRecord rec;
+    char name_out[DT_RECORD_MAX_NAME + 1], ip_out[DT_RECORD_MAX_NAME + 1];
+    CHECK(dt_record_decode(buf, len, &rec, name_out, ip_out) == 0);
+    CHECK(strcmp(name_out, site_name) == 0);
+    CHECK(strcmp(ip_out, ip) == 0);
+    CHECK(rec.version == DT_RECORD_VERSION);
+    CHECK(rec.length == len);
+    CHECK(rec.site_name_len == strlen(site_name));
+    CHECK(rec.ip_len == strlen(ip));
+
+    // Every value decodes to exactly what was encoded
+    CHECK(rec.flags == (DT_FLAG_SITE_HEALTHY | DT_FLAG_WEATHER | DT_FLAG_READING_READY | (seed & 1 ? DT_FLAG_DATA_SEND : 0)));
+    CHECK(rec.device_index == seed % 16);
+    CHECK(rec.num_devices == 16);
+    CHECK(rec.latitude == 31.9583f + (float)seed);
+    CHECK(rec.longitude == -111.5967f);
+    CHECK(rec.elevation == 2096.0f);
+    CHECK(rec.reading_interval == 60 && rec.heartbeat_interval == 30);
+    CHECK(rec.read_timeout == 5 && rec.weather_interval == 300);
+    CHECK(rec.control_port == 8080 && rec.sqm_port == 10001);
+    CHECK(rec.sqm_model == 3 && rec.sqm_serial == 2921 + seed);
+    CHECK(rec.calibration == 19.86f);
+    CHECK(rec.mpsqa == 21.37f + (float)seed / 100.0f);
+    CHECK(rec.sensor_freq == 22921);
+    CHECK(rec.sensor_period_count == INT32_MIN + seed);
+    CHECK(rec.sensor_period_secs == 0.000043f);
+    CHECK(rec.sensor_temp == -12.5f);
+    CHECK(rec.temperature_f == 48.2 + seed);
+    CHECK(rec.humidity == 31.0 && rec.wind_speed_mph == 3.4 && rec.wind_gust_mph == 7.9);
+    CHECK(rec.pressure_in == 23.01 && rec.rainfall_in == 0.0);
+    CHECK(strcmp(rec.reading_timestamp, "2026-10-18 03:14:15") == 0);
+    CHECK(strcmp(rec.weather_timestamp, "2026-10-18T03:10:00.000Z") == 0);
+}
+
+static void test_wire_layout(void) {
+    CHECK(sizeof(DtRecord) == DT_RECORD_V1_SIZE);
+    CHECK(offsetof(DtRecord, mpsqa) == 60);
+    CHECK(offsetof(DtRecord, temperature_f) == 80);
+    CHECK(offsetof(DtRecord, site_name_len) == 180);
+
+    unsigned char buf[sizeof(DtRecord) + 2 * DT_RECORD_MAX_NAME];
+    size_t len = build_record(buf, "Site", "10.0.0.2", 0);
+    CHECK(memcmp(buf, "NWDT", 4) == 0);
+    CHECK(buf[4] == DT_RECORD_VERSION && buf[5] == 0);           // version, little-endian
+    CHECK(buf[6] == (len & 0xff) && buf[7] == (len >> 8));        // length, little-endian
+    CHECK(le32(buf + offsetof(DtRecord, sqm_serial)) == 2921);
+    float mpsqa;
+    uint32_t bits = le32(buf + offsetof(DtRecord, mpsqa));
+    memcpy(&mpsqa, &bits, sizeof(mpsqa));
+    CHECK(mpsqa == 21.37f);
+    CHECK(buf[offsetof(DtRecord, site_name_len)] == 4 && buf[offsetof(DtRecord, ip_len)] == 8);
+    CHECK(memcmp(buf + DT_RECORD_V1_SIZE, "Site10.0.0.2", 12) == 0);
+}
+
+static void test_special_values(void) {
+    unsigned char buf[sizeof(DtRecord) + 2 * DT_RECORD_MAX_NAME];
+    size_t len = build_record(buf, "x", "y", 0);
+    DtRecord rec;
+    CHECK(dt_record_decode(buf, len, &rec, NULL, NULL) == 0);
+    // Values the daemon uses for missing weather and unknown readings survive unchanged
+    rec.temperature_f = 999.9;
+    rec.humidity = NAN;
+    rec.wind_speed_mph = -INFINITY;
+    memcpy(buf, &rec, sizeof(rec));
+    len = dt_record_finish((DtRecord *)buf, 1, 1);
+    DtRecord out;
+    CHECK(dt_record_decode(buf, len, &out, NULL, NULL) == 0);
+    CHECK(out.temperature_f == 999.9);
+    CHECK(isnan(out.humidity));
+    CHECK(isinf(out.wind_speed_mph) && out.wind_speed_mph < 0);
+}
+
+static void test_rejected(void) {
+    unsigned char buf[sizeof(DtRecord) + 2 * DT_RECORD_MAX_NAME];
+    unsigned char bad[sizeof(buf)];
+    size_t len = build_record(buf, "Kitt Peak, AZ", "192.168.1.40", 3);
+    DtRecord rec;
+    char name_out[DT_RECORD_MAX_NAME + 1];
+
+    // Every truncation is refused, including one that cuts only the names
+    int accepted = 0;
+    for (size_t cut = 0; cut < len; ++cut) {
+        if (dt_record_decode(buf, cut, &rec, name_out, NULL) == 0) accepted++;
+    }
+    CHECK(accepted == 0);
+    // Trailing bytes after a complete record are not part of it
+    CHECK(dt_record_decode(buf, sizeof(buf), &rec, name_out, NULL) == 0);
+    CHECK(rec.length == len && strcmp(name_out, "Kitt Peak, AZ") == 0);
+
+    memcpy(bad, buf, len);
+    bad[0] = 'X';
+    CHECK(dt_record_decode(bad, len, &rec, NULL, NULL) == -1);
+
+    memcpy(bad, buf, len);
+    bad[4] = DT_RECORD_VERSION + 1;
+    CHECK(dt_record_decode(bad, len, &rec, NULL, NULL) == -1);
+
+    memcpy(bad, buf, len);
+    bad[6]++; // Length no longer matches the names
+    CHECK(dt_record_decode(bad, len + 1, &rec, NULL, NULL) == -1);
+
+    memcpy(bad, buf, len);
+    bad[offsetof(DtRecord, ip_len)] = 200; // Names claim more bytes than the record holds
+    CHECK(dt_record_decode(bad, sizeof(bad), &rec, NULL, NULL) == -1);
+}
+
+int main(void) {
+    char long_name[DT_RECORD_MAX_NAME + 1];
+    memset(long_name, 'n', DT_RECORD_MAX_NAME);
+    long_name[DT_RECORD_MAX_NAME] = '\0';
+    char long_ip[DT_RECORD_MAX_NAME + 1];
+    memset(long_ip, '1', DT_RECORD_MAX_NAME);
+    long_ip[DT_RECORD_MAX_NAME] = '\0';
+
+    test_round_trip("Kitt Peak, AZ", "192.168.1.40", 0);   // A comma broke the text form
+    test_round_trip("", "", 1);
+    test_round_trip(long_name, long_ip, 2);
+    test_round_trip("Observatoire de Haute-Provence \xc3\xa9", "sqm-le.example.org", 7);
+    test_wire_layout();
+    test_special_values();
+    test_rejected();
+
+    printf("%d checks, %d failed\n%s\n", checks, failures, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
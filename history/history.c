@@ -0,0 +1,250 @@
+/*
+ * Project: NightWatcher
+ * File: history.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "nightwatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+// Recent readings kept as one array per field, so a query over the
+// time column touches only the timestamps it needs.
+typedef struct {
+    pthread_rwlock_t lock;
+    unsigned int capacity;
+    unsigned int head;     // Slot of the oldest record
+    unsigned int count;
+    time_t *time;
+    short *device;
+    float *mpsqa;
+    float *sensorTemp;
+    float *siteTemp;
+    float *sitePressure;
+    float *siteHumidity;
+} HistoryRing;
+
+static HistoryRing history = { .lock = PTHREAD_RWLOCK_INITIALIZER };
+
+// One record copied out of the ring, so it can be formatted without holding the lock
+typedef struct {
+    time_t time;
+    short device;
+    float mpsqa;
+    float sensorTemp;
+    float siteTemp;
+    float sitePressure;
+    float siteHumidity;
+} HistoryRecord;
+
+#define HISTORY_MIN_LINE 24 // Fewer bytes than any formatted record, so copies beyond out_size / 24 could never be shown
+
+// Queries copy into one array allocated by history_init, sized for the most records a
+// control response could show. scratch_lock is held by one query at a time and never by
+// history_add, so formatting does not hold up writers.
+static HistoryRecord *scratch;
+static unsigned int scratch_size;
+static pthread_mutex_t scratch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int history_init(unsigned int capacity) {
+    if (capacity == 0) capacity = HISTORY_DEFAULT_SIZE;
+    pthread_rwlock_wrlock(&history.lock);
+    if (history.capacity) {
+        pthread_rwlock_unlock(&history.lock);
+        return 0;
+    }
+    history.time = calloc(capacity, sizeof(time_t));
+    history.device = calloc(capacity, sizeof(short));
+    history.mpsqa = calloc(capacity, sizeof(float));
+    history.sensorTemp = calloc(capacity, sizeof(float));
+    history.siteTemp = calloc(capacity, sizeof(float));
+    history.sitePressure = calloc(capacity, sizeof(float));
+    history.siteHumidity = calloc(capacity, sizeof(float));
+    scratch_size = CONTROL_RESPONSE_SIZE / HISTORY_MIN_LINE + 1;
+    if (scratch_size > capacity) scratch_size = capacity;
+    scratch = calloc(scratch_size, sizeof(HistoryRecord));
+    if (!history.time || !history.device || !history.mpsqa || !history.sensorTemp ||
+        !history.siteTemp || !history.sitePressure || !history.siteHumidity || !scratch) {
+        free(history.time); free(history.device); free(history.mpsqa); free(history.sensorTemp);
+        free(history.siteTemp); free(history.sitePressure); free(history.siteHumidity);
+        free(scratch);
+        scratch = NULL;
+        pthread_rwlock_unlock(&history.lock);
+        return -1;
+    }
+    history.capacity = capacity;
+    history.head = 0;
+    history.count = 0;
+    pthread_rwlock_unlock(&history.lock);
+    return 0;
+}
+
+// Helper: physical slot of logical position i (0 = oldest)
+static unsigned int history_slot(unsigned int i) {
+    return (history.head + i) % history.capacity;
+}
+
+void history_add(time_t t, int device, float mpsqa, float sensorTemp, float siteTemp, float sitePressure, float siteHumidity) {
+    pthread_rwlock_wrlock(&history.lock);
+    if (history.capacity == 0) {
+        pthread_rwlock_unlock(&history.lock);
+        return;
+    }
+    if (history.count == history.capacity) {
+        // A full ring drops its oldest record, unless the new one is older still
+        if (t < history.time[history.head]) {
+            pthread_rwlock_unlock(&history.lock);
+            return;
+        }
+        history.head = history_slot(1);
+        history.count--;
+    }
+    // Worker threads can finish out of order; shift newer records up so the ring stays
+    // sorted by time. Late records are only a reading or two behind, so few move.
+    unsigned int pos = history.count;
+    while (pos > 0 && history.time[history_slot(pos - 1)] > t) {
+        unsigned int from = history_slot(pos - 1), to = history_slot(pos);
+        history.time[to] = history.time[from];
+        history.device[to] = history.device[from];
+        history.mpsqa[to] = history.mpsqa[from];
+        history.sensorTemp[to] = history.sensorTemp[from];
+        history.siteTemp[to] = history.siteTemp[from];
+        history.sitePressure[to] = history.sitePressure[from];
+        history.siteHumidity[to] = history.siteHumidity[from];
+        pos--;
+    }
+    unsigned int slot = history_slot(pos);
+    history.count++;
+    history.time[slot] = t;
+    history.device[slot] = (short)device;
+    history.mpsqa[slot] = mpsqa;
+    history.sensorTemp[slot] = sensorTemp;
+    history.siteTemp[slot] = siteTemp;
+    history.sitePressure[slot] = sitePressure;
+    history.siteHumidity[slot] = siteHumidity;
+    pthread_rwlock_unlock(&history.lock);
+}
+
+/*
+ * Copies records first..first+n-1 (logical positions, 0 = oldest) out of the ring.
+ * Caller holds the read lock.
+ */
+static void history_copy(unsigned int first, unsigned int n, HistoryRecord *dst) {
+    for (unsigned int i = 0; i < n; ++i) {
+        unsigned int slot = history_slot(first + i);
+        dst[i].time = history.time[slot];
+        dst[i].device = history.device[slot];
+        dst[i].mpsqa = history.mpsqa[slot];
+        dst[i].sensorTemp = history.sensorTemp[slot];
+        dst[i].siteTemp = history.siteTemp[slot];
+        dst[i].sitePressure = history.sitePressure[slot];
+        dst[i].siteHumidity = history.siteHumidity[slot];
+    }
+}
+
+// Helper: formats one record as a DB: line. Returns its length.
+static size_t history_format_line(char *line, size_t size, const HistoryRecord *r) {
+    int len = snprintf(line, size, "DB:%ld,%d,%.2f,%.1f,%.1f,%.2f,%.1f\n", (long)r->time, r->device,
+                       r->mpsqa, r->sensorTemp, r->siteTemp, r->sitePressure, r->siteHumidity);
+    return len > 0 ? (size_t)len : 0;
+}
+
+#define HISTORY_TRUNCATED_ROOM 32 // Room kept for the "DB:Truncated:<n>" line
+
+/*
+ * Formats ncopied copied records of a result of total records, oldest first. If the output
+ * buffer fills, the newest records are kept when keep_newest is set and the oldest otherwise,
+ * and a "DB:Truncated:<records left out>" line ends the output.
+ * Returns the number of records written.
+ */
+static int history_format(const HistoryRecord *records, unsigned int ncopied, unsigned int total,
+                          bool keep_newest, char *out, size_t out_size) {
+    out[0] = '\0';
+    if (out_size <= HISTORY_TRUNCATED_ROOM) return 0;
+    size_t room = out_size - HISTORY_TRUNCATED_ROOM;
+    size_t offset = 0;
+    unsigned int written = 0;
+    char line[160];
+    if (keep_newest) {
+        // Fill the buffer from its end, newest record last, then move the lines to the front
+        size_t start = room;
+        while (written < ncopied) {
+            size_t len = history_format_line(line, sizeof(line), &records[ncopied - 1 - written]);
+            if (len > start) break;
+            start -= len;
+            memcpy(out + start, line, len);
+            written++;
+        }
+        offset = room - start;
+        memmove(out, out + start, offset);
+    } else {
+        while (written < ncopied) {
+            size_t len = history_format_line(line, sizeof(line), &records[written]);
+            if (offset + len > room) break;
+            memcpy(out + offset, line, len);
+            offset += len;
+            written++;
+        }
+    }
+    out[offset] = '\0';
+    if (written < total) snprintf(out + offset, out_size - offset, "DB:Truncated:%u\n", total - written);
+    return (int)written;
+}
+
+/*
+ * Copies ncopied records starting at first under the read lock (caller holds it and this
+ * releases it), then formats them with the lock released so writers are not held up. The
+ * copy goes to the scratch array, which holds at least as many records as could fit in a
+ * control response. total is the size of the whole result.
+ * Returns the number of records written.
+ */
+static int history_copy_and_format(unsigned int first, unsigned int ncopied, unsigned int total,
+                                   bool keep_newest, char *out, size_t out_size) {
+    pthread_mutex_lock(&scratch_lock);
+    history_copy(first, ncopied, scratch);
+    pthread_rwlock_unlock(&history.lock);
+    int written = history_format(scratch, ncopied, total, keep_newest, out, out_size);
+    pthread_mutex_unlock(&scratch_lock);
+    return written;
+}
+
+// Helper: the most records worth copying for an out_size buffer
+static unsigned int history_copy_limit(size_t out_size) {
+    size_t limit = out_size / HISTORY_MIN_LINE + 1;
+    return limit < scratch_size ? (unsigned int)limit : scratch_size;
+}
+
+int history_format_last(unsigned int n, char *out, size_t out_size) {
+    pthread_rwlock_rdlock(&history.lock);
+    if (history.capacity == 0) {
+        pthread_rwlock_unlock(&history.lock);
+        return -1;
+    }
+    if (n > history.count) n = history.count;
+    // Only the newest records that could fit are copied
+    unsigned int ncopied = n < history_copy_limit(out_size) ? n : history_copy_limit(out_size);
+    return history_copy_and_format(history.count - ncopied, ncopied, n, true, out, out_size);
+}
+
+int history_format_range(time_t start, time_t end, char *out, size_t out_size) {
+    pthread_rwlock_rdlock(&history.lock);
+    if (history.capacity == 0) {
+        pthread_rwlock_unlock(&history.lock);
+        return -1;
+    }
+    // history_add keeps the ring in time order, so binary search for the first record at or after start
+    unsigned int lo = 0, hi = history.count;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (history.time[history_slot(mid)] < start) lo = mid + 1;
+        else hi = mid;
+    }
+    unsigned int last = lo;
+    while (last < history.count && history.time[history_slot(last)] <= end) last++;
+    unsigned int total = last - lo;
+    unsigned int ncopied = total < history_copy_limit(out_size) ? total : history_copy_limit(out_size);
+    return history_copy_and_format(lo, ncopied, total, false, out, out_size);
+}
@@ -0,0 +1,36 @@
+/*
+ * Project: NightWatcher
+ * File: history.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <time.h>
+
+#define HISTORY_DEFAULT_SIZE 8192 // Records kept when historySize is not set
+#define HISTORY_WEATHER      -1   // Device index recorded for weather-only updates
+
+// Allocates the in-memory history ring with room for capacity records, and the buffer queries copy into.
+// Returns 0 on success, -1 on error.
+int history_init(unsigned int capacity);
+
+// Adds a record in time order, overwriting the oldest once the ring is full (a record older
+// than everything in a full ring is dropped). Safe to call from any thread.
+// Weather-only updates pass HISTORY_WEATHER as the device and NAN for mpsqa and sensorTemp.
+void history_add(time_t t, int device, float mpsqa, float sensorTemp, float siteTemp, float sitePressure, float siteHumidity);
+
+// Writes the newest n records, oldest first, as "DB:<time>,<device>,<mpsqa>,<sensorTemp>,<siteTemp>,<sitePressure>,<siteHumidity>" lines.
+// If out fills, the newest records that fit are written, followed by "DB:Truncated:<records left out>".
+// Records are copied under the lock into a buffer allocated by history_init and formatted after it is released.
+// Returns the number of records written, or -1 if the history is not initialized.
+int history_format_last(unsigned int n, char *out, size_t out_size);
+
+// Writes the records with start <= time <= end in the same format as history_format_last.
+// If out fills, the oldest records that fit are written, followed by "DB:Truncated:<records left out>".
+// Returns the number of records written, or -1 if the history is not initialized.
+int history_format_range(time_t start, time_t end, char *out, size_t out_size);
+
+#endif // HISTORY_H
@@ -0,0 +1,198 @@
+/*
+ * Project: NightWatcher
+ * File: history_test.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * Tests for the in-memory reading history: records added out of order come back in time
+ * order, a full ring drops its oldest records, "db last" keeps the newest records and
+ * "db range" the oldest when the output is too small, and queries racing writers (as the
+ * control server races the device workers) only ever see sorted, whole records.
+ * Exits nonzero if any check fails.
+ */
+#include "history.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define TEST_CAPACITY 16
+#define TEST_WRITERS  4
+#define TEST_READERS  2
+#define TEST_OUT_SIZE 4096
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    checks++; \
+    if (!(cond)) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+static int stop_threads = 0; // Set by the main thread when the threads should return
+static int race_failures = 0; // Counted by the threads, checked once they are joined
+
+/*
+ * Parses the DB: lines in out into times (at most max). Returns the number of records,
+ * and sets *truncated to the count on a DB:Truncated line (0 if there is none).
+ */
+static int parse_times(const char *out, long *times, int max, unsigned int *truncated) {
+    int n = 0;
+    *truncated = 0;
+    for (const char *line = out; *line; ) {
+        long t;
+        int device;
+        if (sscanf(line, "DB:Truncated:%u", truncated) == 1) {
+            // Always the last line
+        } else if (sscanf(line, "DB:%ld,%d,", &t, &device) == 2 && n < max) {
+            times[n++] = t;
+        } else {
+            return -1;
+        }
+        const char *nl = strchr(line, '\n');
+        if (!nl) return -1; // Every line is whole
+        line = nl + 1;
+    }
+    return n;
+}
+
+// Helper: adds a reading at time t for device 0
+static void add(time_t t) {
+    history_add(t, 0, 21.0f, 12.0f, 50.0f, 23.0f, 30.0f);
+}
+
+// Adds 100..119 with 110 and 111 swapped, so the ring keeps 104..119 in order.
+static void test_order_and_overwrite(void) {
+    char out[TEST_OUT_SIZE];
+    long times[64];
+    unsigned int truncated;
+    for (time_t t = 100; t < 110; ++t) add(t);
+    add(111);
+    add(110);
+    for (time_t t = 112; t < 120; ++t) add(t);
+
+    CHECK(history_format_range(0, 1000, out, sizeof(out)) == TEST_CAPACITY);
+    int n = parse_times(out, times, 64, &truncated);
+    CHECK(n == TEST_CAPACITY && truncated == 0);
+    for (int i = 0; i < n; ++i) CHECK(times[i] == 104 + i);
+
+    // Older than everything in a full ring: dropped
+    add(50);
+    CHECK(history_format_range(0, 1000, out, sizeof(out)) == TEST_CAPACITY);
+    n = parse_times(out, times, 64, &truncated);
+    CHECK(n == TEST_CAPACITY && times[0] == 104);
+
+    CHECK(history_format_range(110, 112, out, sizeof(out)) == 3);
+    n = parse_times(out, times, 64, &truncated);
+    CHECK(n == 3 && times[0] == 110 && times[2] == 112);
+    CHECK(history_format_range(200, 300, out, sizeof(out)) == 0 && out[0] == '\0');
+}
+
+static void test_last(void) {
+    char out[TEST_OUT_SIZE];
+    long times[64];
+    unsigned int truncated;
+    CHECK(history_format_last(3, out, sizeof(out)) == 3);
+    int n = parse_times(out, times, 64, &truncated);
+    CHECK(n == 3 && truncated == 0 && times[0] == 117 && times[1] == 118 && times[2] == 119);
+
+    // More than are kept: every record, oldest first
+    CHECK(history_format_last(100, out, sizeof(out)) == TEST_CAPACITY);
+    n = parse_times(out, times, 64, &truncated);
+    CHECK(n == TEST_CAPACITY && times[0] == 104 && times[n - 1] == 119);
+    CHECK(history_format_last(0, out, sizeof(out)) == 0 && out[0] == '\0');
+}
+
+// With room for two and a half lines, "last" keeps the newest two and "range" the oldest two
+static void test_truncation(void) {
+    char out[TEST_OUT_SIZE];
+    long times[64];
+    unsigned int truncated;
+    history_format_last(1, out, sizeof(out));
+    size_t line = strlen(out);
+    size_t small = 32 + 2 * line + line / 2; // 32 is the room history.c keeps for the truncation line
+
+    CHECK(history_format_last(10, out, small) == 2);
+    int n = parse_times(out, times, 64, &truncated);
+    CHECK(n == 2 && times[0] == 118 && times[1] == 119 && truncated == 8);
+    CHECK(strlen(out) < small);
+
+    CHECK(history_format_range(0, 1000, out, small) == 2);
+    n = parse_times(out, times, 64, &truncated);
+    CHECK(n == 2 && times[0] == 104 && times[1] == 105 && truncated == TEST_CAPACITY - 2);
+
+    // Too small for any record
+    CHECK(history_format_last(10, out, 16) == 0);
+}
+
+/*
+ * Writer thread: adds readings one to two seconds behind the newest, as workers that
+ * finish out of order do.
+ */
+static void *writer(void *arg) {
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    time_t t = 1000;
+    while (!__atomic_load_n(&stop_threads, __ATOMIC_RELAXED)) {
+        t++;
+        history_add(t - (time_t)(rand_r(&seed) % 3), (int)(uintptr_t)arg, 20.0f, 10.0f, 40.0f, 23.0f, 30.0f);
+    }
+    return NULL;
+}
+
+// Reader thread: every result must be whole lines in nondecreasing time order
+static void *reader(void *arg) {
+    (void)arg;
+    char out[TEST_OUT_SIZE];
+    long times[64];
+    unsigned int truncated;
+    int bad = 0;
+    for (unsigned int i = 0; !__atomic_load_n(&stop_threads, __ATOMIC_RELAXED); ++i) {
+        int written = i & 1 ? history_format_last(TEST_CAPACITY, out, sizeof(out))
+                            : history_format_range(0, 1 << 30, out, sizeof(out));
+        int n = parse_times(out, times, 64, &truncated);
+        if (n < 0 || n != written || n > TEST_CAPACITY) bad++;
+        for (int k = 1; k < n; ++k) {
+            if (times[k] < times[k - 1]) bad++;
+        }
+    }
+    __atomic_add_fetch(&race_failures, bad, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void test_concurrent(int seconds) {
+    pthread_t writers[TEST_WRITERS], readers[TEST_READERS];
+    for (uintptr_t i = 0; i < TEST_WRITERS; ++i) pthread_create(&writers[i], NULL, writer, (void *)(i + 1));
+    for (int i = 0; i < TEST_READERS; ++i) pthread_create(&readers[i], NULL, reader, NULL);
+    sleep((unsigned int)seconds);
+    __atomic_store_n(&stop_threads, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < TEST_WRITERS; ++i) pthread_join(writers[i], NULL);
+    for (int i = 0; i < TEST_READERS; ++i) pthread_join(readers[i], NULL);
+    CHECK(race_failures == 0);
+}
+
+int main(int argc, char *argv[]) {
+    int seconds = 1;
+    int c;
+    while ((c = getopt(argc, argv, "d:h")) != -1) {
+        switch (c) {
+        case 'd': seconds = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-d SECONDS] (default 1, for the concurrent part)\n", argv[0]);
+            return c == 'h' ? 0 : 2;
+        }
+    }
+    char out[64];
+    CHECK(history_format_last(1, out, sizeof(out)) == -1); // Not initialized yet
+    CHECK(history_init(TEST_CAPACITY) == 0);
+    test_order_and_overwrite();
+    test_last();
+    test_truncation();
+    if (seconds > 0) test_concurrent(seconds);
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,570 @@
+/*
+ * Project: NightWatcher
+ * File: logger.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "nightwatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <syslog.h>
+
+// One queued message. Producers copy the format pointer and raw arguments into a record and
+// the writer thread does the printf formatting, so the calling thread never formats floats,
+// touches stdio, or waits on the output fd.
+typedef struct {
+    size_t seq;             // Ring position this slot is ready for (see logger_write)
+    struct timespec ts;     // CLOCK_REALTIME when the message was logged
+    const char *fmt;        // Format whose arguments are packed in data, or NULL if data is the text
+    unsigned char level;
+    unsigned char module;
+    uint16_t len;           // Bytes used in data
+    unsigned char data[LOGGER_MSG_SIZE];
+} __attribute__((aligned(64))) LogRecord;
+
+typedef enum { TARGET_STDERR, TARGET_SYSLOG, TARGET_FILE } LogTarget;
+
+unsigned char logger_levels[LOG_MOD_COUNT] = {
+    LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO,
+    LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO
+};
+
+static const char *level_names[LOG_LEVEL_COUNT] = { "ERROR", "WARN", "INFO", "DEBUG" };
+static const int syslog_priorities[LOG_LEVEL_COUNT] = { LOG_ERR, LOG_WARNING, LOG_INFO, LOG_DEBUG };
+static const char *module_names[LOG_MOD_COUNT] = {
+    "main", "sqm", "weather", "db", "api", "control", "config"
+};
+
+static LogRecord ring[LOGGER_RING_SIZE];
+static size_t enqueue_pos __attribute__((aligned(64)));  // Next position a producer claims
+static uint64_t dropped __attribute__((aligned(64)));
+static bool running;            // Writer thread is up; before and after it, messages go straight to stderr
+static bool stopping;
+static int writer_sleeping;     // Producers only signal when the writer is waiting
+static pthread_t writer_thread;
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+
+// Drain state: the writer thread's, and logger_close's once it has joined the writer
+static char batch[LOGGER_BATCH_SIZE];
+static size_t drain_pos;        // Next ring position to write out
+static uint64_t reported_drops; // Dropped messages already reported
+
+// Output target, held by the writer while it drains a batch and by logger_configure to change it
+static pthread_mutex_t target_lock = PTHREAD_MUTEX_INITIALIZER;
+static LogTarget target = TARGET_STDERR;
+static int target_fd = STDERR_FILENO;
+
+// Helper: writes a whole buffer, retrying short writes
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+// One printf conversion in a log format
+typedef struct {
+    const char *end;  // Character after the conversion
+    int stars;        // '*' widths and precisions, each taking an int argument
+    int precision;    // Literal precision, or -1
+    bool star_precision; // Precision is the last '*' argument
+    char kind;        // 'i' signed, 'u' unsigned, 'f' double, 's' string, 'p' pointer, '%' literal, 0 not packed
+    char length;      // Length modifier: 0, 'H' (hh), 'h', 'l', 'q' (ll), 'z', 'j', or 't'
+} FormatSpec;
+
+// Helper: parses the conversion starting at the '%' p points to
+static void parse_spec(const char *p, FormatSpec *spec) {
+    spec->stars = 0;
+    spec->precision = -1;
+    spec->star_precision = false;
+    spec->length = 0;
+    p++;
+    while (*p && strchr("-+ #0'", *p)) p++;
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            spec->star_precision = true;
+            p++;
+        } else {
+            spec->precision = 0;
+            while (*p >= '0' && *p <= '9') spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+    }
+    if (p[0] == 'h' && p[1] == 'h') { spec->length = 'H'; p += 2; }
+    else if (p[0] == 'l' && p[1] == 'l') { spec->length = 'q'; p += 2; }
+    else if (*p && strchr("hlzjtL", *p)) spec->length = *p++;
+    switch (*p) {
+    case 'd': case 'i': case 'c': spec->kind = 'i'; break;
+    case 'u': case 'o': case 'x': case 'X': spec->kind = 'u'; break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': spec->kind = 'f'; break;
+    case 's': spec->kind = 's'; break;
+    case 'p': spec->kind = 'p'; break;
+    case '%': spec->kind = '%'; break;
+    default: spec->kind = 0; break; // %n, wide characters, and the like are formatted by the caller
+    }
+    if (spec->length == 'L' || (spec->kind == 's' && spec->length) || (spec->kind == 'i' && *p == 'c' && spec->length)) spec->kind = 0;
+    spec->end = *p ? p + 1 : p;
+}
+
+/*
+ * Copies the arguments for fmt into buf so the writer thread can format them later.
+ * Integers are widened to 64 bits and strings are copied, so nothing in buf points
+ * into the caller's stack.
+ * Parameters: buf, size - destination; fmt - format; ap - the caller's arguments.
+ * Returns: bytes used, or -1 if the arguments do not fit or fmt has a conversion that is not packed.
+ */
+static int pack_args(unsigned char *buf, size_t size, const char *fmt, va_list *ap) {
+    size_t used = 0;
+#define PACK(value) do { \
+        __typeof__(value) v_ = (value); \
+        if (used + sizeof(v_) > size) return -1; \
+        memcpy(buf + used, &v_, sizeof(v_)); \
+        used += sizeof(v_); \
+    } while (0)
+    for (const char *p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+        FormatSpec spec;
+        parse_spec(p, &spec);
+        p = spec.end;
+        if (spec.kind == 0) return -1;
+        if (spec.kind == '%') continue;
+        int precision = spec.precision;
+        for (int i = 0; i < spec.stars; ++i) {
+            int star = va_arg(*ap, int);
+            PACK(star);
+            if (i == spec.stars - 1 && spec.star_precision) precision = star;
+        }
+        switch (spec.kind) {
+        case 'i':
+            switch (spec.length) {
+            case 'l': PACK((long long)va_arg(*ap, long)); break;
+            case 'q': PACK((long long)va_arg(*ap, long long)); break;
+            case 'z': PACK((long long)va_arg(*ap, ssize_t)); break;
+            case 'j': PACK((long long)va_arg(*ap, intmax_t)); break;
+            case 't': PACK((long long)va_arg(*ap, ptrdiff_t)); break;
+            default: PACK((long long)va_arg(*ap, int)); break;
+            }
+            break;
+        case 'u':
+            switch (spec.length) {
+            case 'l': PACK((unsigned long long)va_arg(*ap, unsigned long)); break;
+            case 'q': PACK((unsigned long long)va_arg(*ap, unsigned long long)); break;
+            case 'z': PACK((unsigned long long)va_arg(*ap, size_t)); break;
+            case 'j': PACK((unsigned long long)va_arg(*ap, uintmax_t)); break;
+            case 't': PACK((unsigned long long)va_arg(*ap, ptrdiff_t)); break;
+            default: PACK((unsigned long long)va_arg(*ap, unsigned int)); break;
+            }
+            break;
+        case 'f':
+            PACK(va_arg(*ap, double));
+            break;
+        case 'p':
+            PACK(va_arg(*ap, void *));
+            break;
+        case 's': {
+            const char *str = va_arg(*ap, const char *);
+            if (!str) str = "(null)";
+            // A precision bounds the read, so "%.*s" of an unterminated buffer is safe
+            size_t n = precision >= 0 ? strnlen(str, (size_t)precision) : strlen(str);
+            if (used + n + 1 > size) return -1;
+            memcpy(buf + used, str, n);
+            buf[used + n] = '\0';
+            used += n + 1;
+            break;
+        }
+        }
+    }
+#undef PACK
+    return (int)used;
+}
+
+/*
+ * Formats a record's message: runs the format over the packed arguments one conversion
+ * at a time, or copies the text if the producer formatted it.
+ * Parameters: rec - record; text, size - destination.
+ * Returns: length of the message, truncated to size - 1.
+ */
+static size_t expand_record(const LogRecord *rec, char *text, size_t size) {
+    size_t len = 0;
+    if (!rec->fmt) {
+        len = rec->len < size ? rec->len : size - 1;
+        memcpy(text, rec->data, len);
+    } else {
+        const unsigned char *arg = rec->data;
+        const char *p = rec->fmt;
+        while (*p && len < size - 1) {
+            const char *pct = strchr(p, '%');
+            size_t lit = pct ? (size_t)(pct - p) : strlen(p);
+            if (lit > size - 1 - len) lit = size - 1 - len;
+            memcpy(text + len, p, lit);
+            len += lit;
+            if (!pct) break;
+            FormatSpec spec;
+            parse_spec(pct, &spec);
+            p = spec.end;
+            char conv[32];
+            size_t conv_len = (size_t)(spec.end - pct);
+            if (conv_len >= sizeof(conv)) break;
+            memcpy(conv, pct, conv_len);
+            conv[conv_len] = '\0';
+            int star[2] = { 0, 0 };
+            for (int i = 0; i < spec.stars; ++i) {
+                memcpy(&star[i], arg, sizeof(int));
+                arg += sizeof(int);
+            }
+            char *out = text + len;
+            size_t room = size - len;
+            int n = 0;
+#define EMIT(value) (spec.stars == 2 ? snprintf(out, room, conv, star[0], star[1], value) : \
+                     spec.stars == 1 ? snprintf(out, room, conv, star[0], value) : snprintf(out, room, conv, value))
+            if (spec.kind == '%') {
+                n = snprintf(out, room, "%%");
+            } else if (spec.kind == 's') {
+                const char *str = (const char *)arg;
+                arg += strlen(str) + 1;
+                n = EMIT(str);
+            } else if (spec.kind == 'f') {
+                double v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                n = EMIT(v);
+            } else if (spec.kind == 'p') {
+                void *v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                n = EMIT(v);
+            } else if (spec.kind == 'i') {
+                long long v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                switch (spec.length) {
+                case 'l': n = EMIT((long)v); break;
+                case 'q': n = EMIT(v); break;
+                case 'z': n = EMIT((ssize_t)v); break;
+                case 'j': n = EMIT((intmax_t)v); break;
+                case 't': n = EMIT((ptrdiff_t)v); break;
+                default: n = EMIT((int)v); break;
+                }
+            } else {
+                unsigned long long v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                switch (spec.length) {
+                case 'l': n = EMIT((unsigned long)v); break;
+                case 'q': n = EMIT(v); break;
+                case 'z': n = EMIT((size_t)v); break;
+                case 'j': n = EMIT((uintmax_t)v); break;
+                case 't': n = EMIT((ptrdiff_t)v); break;
+                default: n = EMIT((unsigned int)v); break;
+                }
+            }
+#undef EMIT
+            if (n > 0) len += (size_t)n < room ? (size_t)n : room - 1;
+        }
+    }
+    while (len > 0 && text[len - 1] == '\n') len--;
+    text[len] = '\0';
+    return len;
+}
+
+// Helper: formats one message as a log line. stamp caches the date and time of the last
+// second formatted, so localtime_r runs at most once per second of log output.
+static size_t format_line(char *buf, size_t size, const struct timespec *ts, int level, int mod,
+                          const char *text, size_t len) {
+    static time_t stamp_sec = -1;
+    static char stamp[32];
+    if (ts->tv_sec != stamp_sec) {
+        struct tm tm;
+        localtime_r(&ts->tv_sec, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        stamp_sec = ts->tv_sec;
+    }
+    int n = snprintf(buf, size, "%s.%03ld %-5s %s: %.*s\n", stamp, ts->tv_nsec / 1000000,
+                     level_names[level], module_names[mod], (int)len, text);
+    if (n < 0) return 0;
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
+
+// Helper: sends one message to the current target, either straight to syslog or appended to batch
+static void emit(char *batch, size_t *used, const struct timespec *ts, int level, int mod, const char *text, size_t len) {
+    if (target == TARGET_SYSLOG) {
+        syslog(syslog_priorities[level], "%s: %.*s", module_names[mod], (int)len, text);
+        return;
+    }
+    if (LOGGER_BATCH_SIZE - *used < LOGGER_LINE_SIZE) {
+        write_all(target_fd, batch, *used);
+        *used = 0;
+    }
+    *used += format_line(batch + *used, LOGGER_BATCH_SIZE - *used, ts, level, mod, text, len);
+}
+
+// Helper: returns the record at pos if a producer has finished it
+static LogRecord *ready_record(size_t pos) {
+    LogRecord *rec = &ring[pos & (LOGGER_RING_SIZE - 1)];
+    return __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) == pos + 1 ? rec : NULL;
+}
+
+/*
+ * Writes every finished record from drain_pos on as one batch, followed by a warning
+ * if messages have been dropped since the last one.
+ */
+static void drain_ring(void) {
+    char text[LOGGER_LINE_SIZE - 64];
+    pthread_mutex_lock(&target_lock);
+    size_t used = 0;
+    LogRecord *rec;
+    while ((rec = ready_record(drain_pos)) != NULL) {
+        size_t len = expand_record(rec, text, sizeof(text));
+        emit(batch, &used, &rec->ts, rec->level, rec->module, text, len);
+        // Hand the slot back to producers for the next lap around the ring
+        __atomic_store_n(&rec->seq, drain_pos + LOGGER_RING_SIZE, __ATOMIC_RELEASE);
+        drain_pos++;
+    }
+    uint64_t drops = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+    if (drops != reported_drops) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        int len = snprintf(text, sizeof(text), "%llu log messages dropped, logging is falling behind",
+                           (unsigned long long)(drops - reported_drops));
+        emit(batch, &used, &ts, LOG_LEVEL_WARN, LOG_MOD_MAIN, text, (size_t)len);
+        reported_drops = drops;
+    }
+    if (used > 0) write_all(target_fd, batch, used);
+    pthread_mutex_unlock(&target_lock);
+}
+
+/*
+ * Writer thread: drains the ring, formatting records into one buffer per batch,
+ * and sleeps when it is empty. Exits once stopping is set and the ring is empty.
+ */
+static void *writer_main(void *arg) {
+    (void)arg;
+    while (1) {
+        drain_ring();
+
+        pthread_mutex_lock(&wake_lock);
+        __atomic_store_n(&writer_sleeping, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        bool done = false;
+        if (!ready_record(drain_pos)) {
+            if (stopping) {
+                done = true;
+            } else {
+                // The timeout only matters if a wakeup is missed; producers signal below
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += 1;
+                pthread_cond_timedwait(&wake, &wake_lock, &deadline);
+            }
+        }
+        __atomic_store_n(&writer_sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&wake_lock);
+        if (done) break;
+    }
+    return NULL;
+}
+
+/*
+ * Queues one log message in a bounded multi-producer ring (Vyukov's design). Each slot
+ * carries a sequence number: a producer claims position pos with one compare-and-swap
+ * once the slot's sequence equals pos, fills it, and publishes it by setting the sequence
+ * to pos + 1. The writer frees it again by setting pos + LOGGER_RING_SIZE.
+ * Parameters: mod, level - message module and level (already checked against logger_levels);
+ *             fmt - printf-style format, which must outlive the process (a string literal).
+ */
+void logger_write(LogModule mod, LogLevel level, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        flockfile(stderr); // One whole line, even with several threads falling back at once
+        fprintf(stderr, "%s %s: ", level_names[level], module_names[mod]);
+        vfprintf(stderr, fmt, ap);
+        fputc('\n', stderr);
+        funlockfile(stderr);
+        va_end(ap);
+        return;
+    }
+    size_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    LogRecord *rec;
+    while (1) {
+        rec = &ring[pos & (LOGGER_RING_SIZE - 1)];
+        size_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            // The writer has not freed this slot yet: the ring is full
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            va_end(ap);
+            return;
+        } else {
+            pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    clock_gettime(CLOCK_REALTIME, &rec->ts);
+    rec->level = (unsigned char)level;
+    rec->module = (unsigned char)mod;
+    va_list args;
+    va_copy(args, ap);
+    int n = pack_args(rec->data, sizeof(rec->data), fmt, &args);
+    va_end(args);
+    if (n >= 0) {
+        rec->fmt = fmt;
+    } else {
+        // Long strings or unusual conversions: format here instead
+        rec->fmt = NULL;
+        n = vsnprintf((char *)rec->data, sizeof(rec->data), fmt, ap);
+        if (n < 0) n = 0;
+        if (n >= (int)sizeof(rec->data)) n = (int)sizeof(rec->data) - 1;
+    }
+    va_end(ap);
+    rec->len = (uint16_t)n;
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&writer_sleeping, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&wake_lock);
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&wake_lock);
+    }
+}
+
+int logger_init(void) {
+    if (running) return 0;
+    for (size_t i = 0; i < LOGGER_RING_SIZE; ++i) ring[i].seq = i;
+    enqueue_pos = 0;
+    drain_pos = 0;
+    reported_drops = 0;
+    stopping = false;
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) return -1;
+    __atomic_store_n(&running, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Helper: looks up a level name of length len. Returns the level, or -1 if unknown.
+static int parse_level(const char *name, size_t len) {
+    for (int i = 0; i < LOG_LEVEL_COUNT; ++i) {
+        if (strlen(level_names[i]) == len && strncasecmp(name, level_names[i], len) == 0) return i;
+    }
+    if (len == 7 && strncasecmp(name, "warning", len) == 0) return LOG_LEVEL_WARN;
+    return -1;
+}
+
+// Helper: switches the output target. Called with target_lock held.
+static int set_target(const char *name) {
+    if (strcmp(name, "stderr") == 0) {
+        if (target == TARGET_FILE) close(target_fd);
+        if (target == TARGET_SYSLOG) closelog();
+        target = TARGET_STDERR;
+        target_fd = STDERR_FILENO;
+        return 0;
+    }
+    if (strcmp(name, "syslog") == 0) {
+        if (target == TARGET_FILE) close(target_fd);
+        if (target != TARGET_SYSLOG) openlog("nightwatcher", LOG_PID, LOG_DAEMON);
+        target = TARGET_SYSLOG;
+        target_fd = -1;
+        return 0;
+    }
+    int fd = open(name, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return -1; // Keep logging where we were
+    if (target == TARGET_FILE) close(target_fd);
+    if (target == TARGET_SYSLOG) closelog();
+    target = TARGET_FILE;
+    target_fd = fd;
+    return 0;
+}
+
+int logger_configure(const char *target_name, const char *level, const char *modules) {
+    int ret = 0;
+    unsigned char levels[LOG_MOD_COUNT];
+    int base = LOG_LEVEL_INFO;
+    if (level && level[0]) {
+        base = parse_level(level, strlen(level));
+        if (base < 0) {
+            base = LOG_LEVEL_INFO;
+            ret = -1;
+        }
+    }
+    memset(levels, base, sizeof(levels));
+    if (modules && modules[0]) {
+        char buf[256];
+        strncpy(buf, modules, sizeof(buf) - 1);
+        buf[sizeof(buf) - 1] = '\0';
+        char *save = NULL;
+        for (char *entry = strtok_r(buf, ", ", &save); entry; entry = strtok_r(NULL, ", ", &save)) {
+            char *eq = strchr(entry, '=');
+            int mod = -1;
+            if (eq) {
+                for (int i = 0; i < LOG_MOD_COUNT; ++i) {
+                    if ((size_t)(eq - entry) == strlen(module_names[i]) && strncmp(entry, module_names[i], eq - entry) == 0) mod = i;
+                }
+            }
+            int mod_level = eq ? parse_level(eq + 1, strlen(eq + 1)) : -1;
+            if (mod < 0 || mod_level < 0) {
+                ret = -1;
+                continue;
+            }
+            levels[mod] = (unsigned char)mod_level;
+        }
+    }
+    for (int i = 0; i < LOG_MOD_COUNT; ++i) __atomic_store_n(&logger_levels[i], levels[i], __ATOMIC_RELAXED);
+    if (target_name && target_name[0]) {
+        pthread_mutex_lock(&target_lock);
+        if (set_target(target_name) != 0) ret = -1;
+        pthread_mutex_unlock(&target_lock);
+    }
+    return ret;
+}
+
+uint64_t logger_dropped(void) {
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+void logger_close(void) {
+    if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) return;
+    // Cleared first, so messages logged from here on go straight to stderr instead of
+    // into a ring nobody will read again
+    __atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&wake_lock);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&wake_lock);
+    pthread_join(writer_thread, NULL);
+
+    // Callers that saw running just before it was cleared may still be filling the slots
+    // they claimed; give them up to LOGGER_CLOSE_WAIT_MS, then write out what they left
+    struct timespec tick = { 0, 1000000 };
+    for (int waited = 0; waited < LOGGER_CLOSE_WAIT_MS; ++waited) {
+        drain_ring();
+        if (drain_pos == __atomic_load_n(&enqueue_pos, __ATOMIC_ACQUIRE)) break;
+        nanosleep(&tick, NULL);
+    }
+    pthread_mutex_lock(&target_lock);
+    set_target("stderr");
+    pthread_mutex_unlock(&target_lock);
+}
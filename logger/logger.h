@@ -0,0 +1,71 @@
+/*
+ * Project: NightWatcher
+ * File: logger.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+
+#define LOGGER_RING_SIZE   1024  // Messages queued for the writer thread; must be a power of two
+#define LOGGER_MSG_SIZE    216   // Packed arguments carried by one message; text that will not pack is cut to this length
+#define LOGGER_LINE_SIZE   1024  // Longest log line written; longer messages are truncated
+#define LOGGER_BATCH_SIZE  (64 * 1024) // Formatted output written with one write()
+#define LOGGER_CLOSE_WAIT_MS 100 // How long logger_close waits for messages still being queued
+
+typedef enum {
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_COUNT
+} LogLevel;
+
+// Parts of the daemon that can be filtered separately with logModules
+typedef enum {
+    LOG_MOD_MAIN,     // Startup, scheduling, worker threads
+    LOG_MOD_SQM,      // SQM-LE readings and heartbeats
+    LOG_MOD_WEATHER,  // Ambient Weather requests
+    LOG_MOD_DB,       // RRD databases and reading history
+    LOG_MOD_API,      // NightWatcher API uploads and the spool
+    LOG_MOD_CONTROL,  // Control port
+    LOG_MOD_CONFIG,   // Configuration files
+    LOG_MOD_COUNT
+} LogModule;
+
+// Most verbose level written for each module. Checked inline, so a filtered-out call
+// costs one load and compare and never evaluates its arguments.
+extern unsigned char logger_levels[LOG_MOD_COUNT];
+
+#define LOGGER_LOG(mod, level, ...) do { \
+        if ((level) <= __atomic_load_n(&logger_levels[mod], __ATOMIC_RELAXED)) logger_write(mod, level, __VA_ARGS__); \
+    } while (0)
+#define LOGGER_ERROR(mod, ...) LOGGER_LOG(mod, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOGGER_WARN(mod, ...)  LOGGER_LOG(mod, LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOGGER_INFO(mod, ...)  LOGGER_LOG(mod, LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOGGER_DEBUG(mod, ...) LOGGER_LOG(mod, LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// Starts the writer thread, logging at info level to stderr. Returns 0 on success.
+int logger_init(void);
+
+// Applies the logTarget, logLevel, and logModules settings. target is "stderr", "syslog",
+// or a file path (opened for append, and reopened on every call so rotated logs are picked up).
+// level is error, warn, info, or debug; modules overrides it per module as name=level,...
+// Empty strings keep the defaults. Returns 0 on success, -1 if a setting was not understood.
+int logger_configure(const char *target, const char *level, const char *modules);
+
+// Queues one message. The writer thread does the formatting, so fmt must be a string literal;
+// string arguments are copied. Never blocks: if the writer has fallen a full ring behind,
+// the message is dropped and counted. Use the LOGGER_* macros rather than calling this directly.
+void logger_write(LogModule mod, LogLevel level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+// Returns the number of messages dropped because the ring was full.
+uint64_t logger_dropped(void);
+
+// Stops the writer thread and writes everything queued. Messages logged while or after
+// it runs go straight to stderr.
+void logger_close(void);
+
+#endif // LOGGER_H
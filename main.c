@@ -12,24 +12,28 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <signal.h>
+#include <poll.h>
+#include <sys/signalfd.h>
 #include <stdlib.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <fcntl.h>
+#include <math.h>
 #include <errno.h>
+#include <sys/eventfd.h>
 
 
 char default_config_file[] = "./conf/nwconf.conf";
 
+#define DEFAULT_DB_FLUSH_INTERVAL 300 // Seconds, when dbFlushInterval is not set
+
+static volatile sig_atomic_t shutdown_requested = 0;
+
 /*
  * Handles SIGHUP (hangup) signal.
  * Parameter: signum - the signal number.
  */
 void handle_sighup(int signum) {
     (void)signum;
-    printf("Received SIGHUP (reload configuration or reinitialize as needed).\n");
-    // Add logic to reload configuration or reinitialize if needed
+    LOGGER_INFO(LOG_MOD_CONFIG, "Received SIGHUP, reloading %s", default_config_file);
+    queue_site_config_reload();
 }
 
 /*
@@ -38,135 +42,134 @@ void handle_sighup(int signum) {
  */
 void handle_sigterm(int signum) {
     (void)signum;
-    printf("Received SIGTERM (shutting down gracefully).\n");
-    // Add logic to clean up and exit gracefully
-    exit(0);
+    // The main loop flushes buffered database writes and exits
+    shutdown_requested = 1;
 }
 
 void handle_sigint(int signum) {
     (void)signum;
-    printf("Received SIGINT (shutting down gracefully).\n");
-    // Add logic to clean up and exit gracefully
-    exit(0);
+    shutdown_requested = 1;
 }
 
 // Struct to pass to thread
 typedef struct {
     SQM_LE_Device *dev;
-    GlobalConfig *site;
     AW_WeatherData *weatherData;
 } ThreadArgs;
 
-// Struct to pass to thread
+// Per-device polling state shared with the worker pool. Jobs take the current site
+// config when they start, so a reload applies from each device's next job.
 typedef struct {
-    int client_fd;
-    GlobalConfig *site;
+    int index;                   // Position in site->devices
     SQM_LE_Device *dev;
-    AW_WeatherData *weatherData;
-} ClientHandlerArgs;
-
+    pthread_mutex_t state_lock;  // Held by whichever job is updating dev, so each published copy is whole
+    int reading_busy;            // A reading job is queued or running
+    int heartbeat_busy;          // A heartbeat job is queued or running
+} DeviceJob;
 
-void* client_handler_thread(void* arg) {
-    ClientHandlerArgs* args = (ClientHandlerArgs*)arg;
-    int client_fd = args->client_fd;
-    GlobalConfig* site = args->site;
-    SQM_LE_Device* dev = args->dev;
-    AW_WeatherData* weatherData = args->weatherData;
-    free(args);
+static SQM_LE_Device devices[NW_MAX_DEVICES];
+static DeviceJob device_jobs[NW_MAX_DEVICES];
+static WorkerPool *worker_pool = NULL;
+static bool spool_running = false; // Uploads were enabled at startup, so enableDataSend can be turned on by a reload
 
-    char buf[256] = {0};
-    ssize_t n = read(client_fd, buf, sizeof(buf) - 1);
-    if (n > 0) {
-        buf[n] = '\0';
-        char response[2048] = {0};
-        size_t response_size = sizeof(response); // set response size to the buffer size
-        handle_command(buf, response, response_size, site, dev, weatherData);
-        write(client_fd, response, strlen(response));
-    }
-    close(client_fd);
-    return NULL;
+/*
+ * Publishes a device's state. The site-level health, model, and serial shown by status and
+ * dt are the primary device's (index 0), so a change to it also marks the site as changed.
+ */
+static void publish_device(int index, SQM_LE_Device *dev) {
+    snapshot_publish_device(index, dev);
+    if (index == 0) snapshot_site_changed();
 }
 
 // TCP listener thread function
+// Serves the control port from a single epoll event loop; no thread is created per client.
 void* tcp_listener_thread(void* arg) {
     ThreadArgs* args = (ThreadArgs*)arg;
     SQM_LE_Device* dev = args->dev;
-    GlobalConfig* site = args->site;
     AW_WeatherData* weatherData = args->weatherData;
+    free(args);
 
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        perror("socket");
-        free(args);
-        pthread_exit(NULL);
-    }
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(site->controlPort);
-    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        perror("bind");
-        close(server_fd);
-        free(args);
-        pthread_exit(NULL);
-    }
-    listen(server_fd, 5);
-    fcntl(server_fd, F_SETFL, O_NONBLOCK);
-
-        while (1) {
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
-            int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-            if (client_fd >= 0) {
-                ClientHandlerArgs* args = malloc(sizeof(ClientHandlerArgs));
-                args->client_fd = client_fd;
-                args->site = site;
-                args->dev = dev;
-                args->weatherData = weatherData;
-
-                pthread_t client_thread;
-                pthread_create(&client_thread, NULL, client_handler_thread, args);
-                pthread_detach(client_thread); // Automatically reclaim resources when thread exits
-            }
-            usleep(10000); // Sleep 10ms to avoid busy loop
-        }
+    if (control_server_run(dev, weatherData, worker_pool) != 0) {
+        LOGGER_ERROR(LOG_MOD_CONTROL, "Failed to start control server");
+    }
+    pthread_exit(NULL);
 }
 
 /*
- * Thread function to perform a reading from the SQM-LE device and add the result to the database.
- * Parameters: arg - pointer to ThreadArgs containing device and site configuration.
- * Returns: NULL.
+ * Pushes the published dt record for a device to control-port subscribers, prefixed with
+ * the event kind. The record is serialized once here no matter how many clients are subscribed.
  */
-void* sqm_reading_thread(void* arg) {
-    ThreadArgs* args = (ThreadArgs*)arg;
-    SQM_LE_Device* dev = args->dev;
-    GlobalConfig* site = args->site;
-    AW_WeatherData* weatherData = args->weatherData;
+void publish_dt_event(const char *kind, GlobalConfig *site, int index) {
+    if (!control_server_has_subscribers()) return;
+    SQM_LE_Device dev;
+    AW_WeatherData weather;
+    snapshot_read_device(index, &dev);
+    snapshot_read_weather(&weather);
+    char record[CONTROL_RESPONSE_SIZE];
+    int n = snprintf(record, sizeof(record), "%s:", kind);
+    serialize_dt(record + n, sizeof(record) - n - 1, site, index, &dev, &weather);
+    strcat(record, "\n");
+    control_server_publish(record, strlen(record));
+}
 
+/*
+ * Pushes a Health event to control-port subscribers when the primary device's health or
+ * weatherReady has changed since the last call.
+ */
+void publish_health_changes(void) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static int last_sqm_healthy = -1;
+    static int last_weather_ready = -1;
+    SQM_LE_Device primary;
+    AW_WeatherData weather;
+    snapshot_read_device(0, &primary);
+    snapshot_read_weather(&weather);
+    int sqm_healthy = primary.healthy ? 1 : 0;
+    int weather_ready = weather.weatherReady ? 1 : 0;
+    pthread_mutex_lock(&lock);
+    bool changed = sqm_healthy != last_sqm_healthy || weather_ready != last_weather_ready;
+    last_sqm_healthy = sqm_healthy;
+    last_weather_ready = weather_ready;
+    pthread_mutex_unlock(&lock);
+    if (!changed) return;
+    char event[128];
+    snprintf(event, sizeof(event), "Health:sqmHealthy:%s,weatherReady:%s\n",
+             sqm_healthy ? "true" : "false", weather_ready ? "true" : "false");
+    control_server_publish(event, strlen(event));
+}
+
+/*
+ * Performs a reading from the SQM-LE device and adds the result to the database.
+ * The device I/O is bounded by the configured read/write timeouts, so this runs
+ * directly on the caller's thread. The caller holds the device's state_lock.
+ * Parameters: dev - device to read, site - site configuration.
+ */
+void take_sqm_reading(SQM_LE_Device *dev, GlobalConfig *site) {
+    int index = (int)(dev - devices);
+    const SQM_DeviceConfig *cfg = &site->devices[index];
+    AW_WeatherData weather;
+    snapshot_read_weather(&weather);
+    AW_WeatherData *weatherData = &weather;
     dev->reading_ready = false;
 
-    int ret = getReading(dev, site);
+    int ret = getReading(dev);
     if (ret == 0) {
-        printf("Site name: %s\n", site->siteName);
-        printf("SQM-LE Reading: %s\n", dev->last_reading);
-        printf("Magnitude per square arc second (mpsqa): %f\n", dev->mpsqa);
-        printf("Sensor temperature (C): %f\n", dev->sensorTemp);
+        LOGGER_DEBUG(LOG_MOD_SQM, "%s (%s) reading: %s", site->siteName, cfg->name, dev->last_reading);
+        LOGGER_INFO(LOG_MOD_SQM, "%s: %.2f mpsqa, sensor %.1f C", cfg->name, dev->mpsqa, dev->sensorTemp);
 
         // Prepare DBEntry and add to database
         DBEntry entry = {0};
-        // Set date and time to current system time
-        time_t now = time(NULL);
-        struct tm *tm_now = localtime(&now);
-        strftime(entry.date, sizeof(entry.date), "%Y-%m-%d", tm_now);
-        strftime(entry.time, sizeof(entry.time), "%H:%M:%S", tm_now);
+        // Stamp the entry with the current system time; no date/time strings to format and re-parse
+        entry.timestamp = time(NULL);
+        struct tm reading_tm;
+        localtime_r(&entry.timestamp, &reading_tm);
+        strftime(dev->last_reading_timestamp, sizeof(dev->last_reading_timestamp), "%Y-%m-%d %H:%M:%S", &reading_tm);
         strncpy(entry.siteName, site->siteName, sizeof(entry.siteName));
         entry.latitude = site->latitude;
         entry.longitude = site->longitude;
         entry.elevation = site->elevation;
-        entry.sqmModel = site->sqmModel;
-        entry.sqmSerial = site->sqmSerial;
+        entry.sqmModel = dev->sqmModel;
+        entry.sqmSerial = dev->sqmSerial;
         entry.mpsqa = dev->mpsqa;
         entry.sensorTemp = dev->sensorTemp;
         if (weatherData->weatherReady) {
@@ -178,36 +181,76 @@ void* sqm_reading_thread(void* arg) {
             entry.sitePressure = 999.9;
             entry.siteHumidity = 999.9;
         }
-        if (db_add_entry(site->dbName, &entry) != 0) {
-            printf("Failed to add entry to database\n");
+        history_add(entry.timestamp, index, entry.mpsqa, entry.sensorTemp,
+                    entry.siteTemp, entry.sitePressure, entry.siteHumidity);
+        if (db_add_entry(cfg->dbName, &entry) != 0) {
+            LOGGER_ERROR(LOG_MOD_DB, "Failed to add entry to database %s", cfg->dbName);
         }
         dev->reading_ready = true;
+        publish_device(index, dev);
+        publish_dt_event("Reading", site, index);
     } else {
-        printf("Failed to get reading, error code: %d\n", ret);
+        LOGGER_WARN(LOG_MOD_SQM, "Failed to get reading from %s, error code: %d", cfg->name, ret);
+        publish_device(index, dev);
     }
+    publish_health_changes();
     // After reading is complete, attempt to send data if ready
     send_data(site, dev, weatherData);
-    free(args);
-    return NULL;
 }
 
-// Send data to WordPress REST API if both weather and reading are ready
+// Queue the reading for the WordPress REST API if both weather and reading are ready.
+// The spool uploader sends it; nothing here waits on the network.
 void send_data(GlobalConfig *site, SQM_LE_Device *dev, AW_WeatherData *weatherData) {
     if (weatherData->weatherReady && dev->reading_ready) {
         // Only send if enabled
         if (site->enableDataSend) {
-            struct nightwatcher_api_config cfg = {0};
-            if (nightwatcher_load_api_config("gilinskyresearch.conf", &cfg)) {
-                char response[256];
-                nightwatcher_send_data(cfg.url, cfg.username, cfg.password, site, dev, weatherData, response, sizeof(response));
-                printf("Sent data to NightWatcher API.\n");
-            } else {
-                printf("Failed to load API config for data send.\n");
+            char record[1024];
+            size_t len = nightwatcher_format_record(record, sizeof(record), site, dev, weatherData);
+            if (len == 0 || spool_append(record, len) != 0) {
+                LOGGER_ERROR(LOG_MOD_API, "Failed to spool reading for NightWatcher API.");
             }
         }
     }
 }
 
+static NightWatcherClient *api_client;
+
+// atexit handler: closes the API connection once the spool uploader has stopped
+static void close_api_client(void) {
+    nightwatcher_client_destroy(api_client);
+    api_client = NULL;
+}
+
+/*
+ * Spool uploader callback: sends one batch of readings to the NightWatcher API.
+ * Parameters: json, len - JSON array of records; count - records in the array;
+ *             ctx - the NightWatcherClient, which reloads its settings when the file changes.
+ * Returns: SPOOL_SENT, SPOOL_RETRY for network or server errors, SPOOL_REJECTED for client errors.
+ */
+static SpoolResult upload_batch(const char *json, size_t len, size_t count, void *ctx) {
+    NightWatcherClient *client = (NightWatcherClient *)ctx;
+    char response[256];
+    long http_code = 0;
+    if (nightwatcher_client_send_batch(client, json, len, &http_code, response, sizeof(response))) {
+        LOGGER_INFO(LOG_MOD_API, "Sent %zu readings to NightWatcher API.", count);
+        return SPOOL_SENT;
+    }
+    // A server without the batch route still takes readings one at a time
+    if (http_code == 404) {
+        size_t sent = nightwatcher_client_send_each(client, json, len, &http_code, response, sizeof(response));
+        if (sent == count) {
+            LOGGER_INFO(LOG_MOD_API, "Sent %zu readings to NightWatcher API (no batch endpoint).", count);
+            return SPOOL_SENT;
+        }
+    }
+    // 408 and 429 are worth retrying; other 4xx responses will not change on a resend
+    if (http_code >= 400 && http_code < 500 && http_code != 408 && http_code != 429) {
+        LOGGER_WARN(LOG_MOD_API, "NightWatcher API rejected batch (HTTP %ld): %s", http_code, response);
+        return SPOOL_REJECTED;
+    }
+    return SPOOL_RETRY;
+}
+
 
 /*
  * Loads the site configuration from the default config file into the provided GlobalConfig struct.
@@ -219,105 +262,364 @@ int load_site_config(GlobalConfig *site) {
 }
 
 /*
- * Launches the SQM reading thread if the device is healthy and reading is enabled.
- * Handles timeout and updates health status.
+ * Brings a device's link settings up to date with the site config. Only a changed address
+ * closes the connection; the next command then connects to the new one. The caller holds
+ * the device's state_lock.
+ * Parameters: job - device state, site - current site configuration.
  */
-void launch_sqm_read_thread(SQM_LE_Device *dev, GlobalConfig *site, AW_WeatherData *weatherData) {
-    if (site->sqmHealthy == true && site->enableSQMread == true) {
-        ThreadArgs *args = malloc(sizeof(ThreadArgs));
-        args->dev = dev;
-        args->site = site;
-        args->weatherData = weatherData;
-        pthread_t tid;
-        pthread_create(&tid, NULL, sqm_reading_thread, args);
-
-        // Timeout mechanism
-        struct timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec += site->sqmReadTimeout;
-
-    #if defined(_GNU_SOURCE)
-        int join_ret = pthread_timedjoin_np(tid, NULL, &ts);
-    #else
-        // Fallback: poll with sleep (not as precise, but portable)
-        int join_ret = 1;
-        for (unsigned int waited = 0; waited < site.sqmReadTimeout; ++waited) {
-            if (pthread_tryjoin_np(tid, NULL) == 0) {
-                join_ret = 0;
-                break;
-            }
-            sleep(1);
-        }
-    #endif
-        if (join_ret != 0) {
-            printf("Thread timed out, cancelling...\n");
-            pthread_cancel(tid);
-            pthread_join(tid, NULL);
-            site->sqmHealthy = false;
+static void apply_device_config(DeviceJob *job, const GlobalConfig *site) {
+    const SQM_DeviceConfig *cfg = &site->devices[job->index];
+    SQM_LE_Device *dev = job->dev;
+    dev->read_timeout_ms = site->sqmReadTimeout ? site->sqmReadTimeout * 1000 : SQM_LE_DEFAULT_TIMEOUT_MS;
+    dev->write_timeout_ms = site->sqmWriteTimeout ? site->sqmWriteTimeout * 1000 : SQM_LE_DEFAULT_TIMEOUT_MS;
+    if (strcmp(dev->ip, cfg->ip) != 0 || dev->port != cfg->port) {
+        LOGGER_INFO(LOG_MOD_SQM, "%s: connecting to %s:%u", cfg->name, cfg->ip, cfg->port);
+        sqm_le_set_address(dev, cfg->ip, cfg->port);
+    }
+}
+
+/*
+ * Worker pool job: takes one reading from a device.
+ * Parameters: arg - pointer to the device's DeviceJob.
+ */
+static void device_reading_job(void *arg) {
+    DeviceJob *job = (DeviceJob *)arg;
+    GlobalConfig *site = site_config_acquire();
+    pthread_mutex_lock(&job->state_lock);
+    apply_device_config(job, site);
+    take_sqm_reading(job->dev, site);
+    pthread_mutex_unlock(&job->state_lock);
+    site_config_release(site);
+    __atomic_store_n(&job->reading_busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Worker pool job: checks a device's health with getUnitInformation.
+ * Parameters: arg - pointer to the device's DeviceJob.
+ */
+static void device_heartbeat_job(void *arg) {
+    DeviceJob *job = (DeviceJob *)arg;
+    GlobalConfig *site = site_config_acquire();
+    pthread_mutex_lock(&job->state_lock);
+    apply_device_config(job, site);
+    getUnitInformation(job->dev);
+    publish_device(job->index, job->dev);
+    LOGGER_DEBUG(LOG_MOD_SQM, "%s healthy: %s", site->devices[job->index].name, job->dev->healthy ? "true" : "false");
+    pthread_mutex_unlock(&job->state_lock);
+    publish_health_changes();
+    site_config_release(site);
+    __atomic_store_n(&job->heartbeat_busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Queues a job for a device unless the same kind of job is still queued or running,
+ * so a slow device never piles up work for itself.
+ * Parameters: busy - the job's busy flag, fn - job function, job - device state.
+ */
+static void submit_device_job(int *busy, WorkerJobFn fn, DeviceJob *job) {
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(busy, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return;
+    if (worker_pool_submit(worker_pool, fn, job) != 0) {
+        __atomic_store_n(busy, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Queues a reading for every device that is healthy and enabled. Called by the scheduler
+ * at each reading boundary. A reading that times out marks its device unhealthy until the
+ * next successful heartbeat.
+ */
+void run_sqm_readings(GlobalConfig *site) {
+    if (!snapshot_sqm_read()) return;
+    for (int i = 0; i < site->numDevices; ++i) {
+        DeviceJob *job = &device_jobs[i];
+        if (job->dev->healthy) {
+            submit_device_job(&job->reading_busy, device_reading_job, job);
         }
-    } else {
-        printf("SQM is not healthy or reading is not enabled. Reading thread will not be started.\n");
     }
 }
 
-void* weather_reading_thread(void* arg) {
+/*
+ * Queues a heartbeat for every device.
+ */
+void run_sqm_heartbeats(GlobalConfig *site) {
+    for (int i = 0; i < site->numDevices; ++i) {
+        submit_device_job(&device_jobs[i].heartbeat_busy, device_heartbeat_job, &device_jobs[i]);
+    }
+}
+
+// Weather polling state shared with the worker pool
+static int weather_busy = 0;
+static ThreadArgs weather_args;
+
+// Settings the weather client was last set up with; only used at startup and by the weather job
+typedef struct {
+    char apiKey[sizeof(((GlobalConfig *)0)->AmbientWeatherAPIKey)];
+    char appKey[sizeof(((GlobalConfig *)0)->AmbientWeatherAppKey)];
+    char encodedMAC[sizeof(((GlobalConfig *)0)->AmbientWeatherEncodedMAC)];
+    char url[sizeof(((GlobalConfig *)0)->AmbientWeatherURL)];
+    unsigned int timeout;
+} WeatherClientSettings;
+
+static WeatherClientSettings weather_client;
+static bool weather_client_ready = false;
+
+/*
+ * Sets up the weather client with the site's keys and endpoint, unless it already uses them.
+ * Keeps its connection when nothing changed.
+ * Returns: true if the client is ready.
+ */
+static bool configure_weather_client(const GlobalConfig *site) {
+    WeatherClientSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    memcpy(settings.apiKey, site->AmbientWeatherAPIKey, sizeof(settings.apiKey));
+    memcpy(settings.appKey, site->AmbientWeatherAppKey, sizeof(settings.appKey));
+    memcpy(settings.encodedMAC, site->AmbientWeatherEncodedMAC, sizeof(settings.encodedMAC));
+    memcpy(settings.url, site->AmbientWeatherURL, sizeof(settings.url));
+    settings.timeout = site->AmbientWeatherTimeout;
+    if (weather_client_ready && memcmp(&settings, &weather_client, sizeof(settings)) == 0) return true;
+    weather_client = settings;
+    aw_set_endpoint(site->AmbientWeatherURL, (long)site->AmbientWeatherTimeout);
+    weather_client_ready = aw_init(site->AmbientWeatherAPIKey, site->AmbientWeatherAppKey, site->AmbientWeatherEncodedMAC);
+    return weather_client_ready;
+}
+
+/*
+ * Worker pool job: fetches the current weather. The request is bounded by
+ * AmbientWeatherTimeout, so it never has to be cancelled. weatherData is this job's
+ * working copy; everything else reads the published snapshot.
+ * Parameters: arg - pointer to the ThreadArgs for the primary device.
+ */
+static void weather_reading_job(void* arg) {
     ThreadArgs* args = (ThreadArgs*)arg;
-    GlobalConfig* site = args->site;
+    GlobalConfig* site = site_config_acquire();
     AW_WeatherData* weatherData = args->weatherData;
 
     weatherData->weatherReady = false;
 
     if (site->enableWeather == true) {
-        if (aw_init(site->AmbientWeatherAPIKey, site->AmbientWeatherAppKey, site->AmbientWeatherEncodedMAC)) {
-            if (aw_get_current_weather(weatherData)) {
-                printf("Weather data retrieved successfully.\n");
-                printf("Temperature: %f\n", weatherData->temperature_f);
-                weatherData->weatherReady = true;
-            } else {
-                printf("Failed to retrieve weather data.\n");
-            }
-            aw_cleanup();
+        configure_weather_client(site); // Picks up new keys or endpoint after a reload
+        if (aw_get_current_weather(weatherData)) {
+            LOGGER_DEBUG(LOG_MOD_WEATHER, "Weather data retrieved, temperature %.1f F", weatherData->temperature_f);
+            weatherData->weatherReady = true;
+            history_add(time(NULL), HISTORY_WEATHER, NAN, NAN, weatherData->temperature_f,
+                        weatherData->pressure_in, weatherData->humidity);
+            snapshot_publish_weather(weatherData);
+            publish_dt_event("Weather", site, (int)(args->dev - devices));
         } else {
-            printf("Failed to initialize AmbientWeather API client.\n");
+            LOGGER_WARN(LOG_MOD_WEATHER, "Failed to retrieve weather data.");
         }
     }
-    free(args);
-    return NULL;
-}
-
-void launch_weather_thread(GlobalConfig *site, AW_WeatherData *weatherData) {
-    ThreadArgs *weatherArgs = malloc(sizeof(ThreadArgs));
-    weatherArgs->site = site;
-    weatherArgs->weatherData = weatherData;
-    pthread_t tid;
-    pthread_create(&tid, NULL, weather_reading_thread, weatherArgs);
-
-  // Timeout mechanism
-        struct timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec += site->sqmReadTimeout;
-
-    #if defined(_GNU_SOURCE)
-        int join_ret = pthread_timedjoin_np(tid, NULL, &ts);
-    #else
-        // Fallback: poll with sleep (not as precise, but portable)
-        int join_ret = 1;
-        for (unsigned int waited = 0; waited < site.sqmReadTimeout; ++waited) {
-            if (pthread_tryjoin_np(tid, NULL) == 0) {
-                join_ret = 0;
-                break;
-            }
-            sleep(1);
+    if (!weatherData->weatherReady) snapshot_publish_weather(weatherData);
+    publish_health_changes();
+    site_config_release(site);
+    __atomic_store_n(&weather_busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Queues a weather update unless the previous one is still running.
+ */
+void run_weather_update(SQM_LE_Device *dev, AW_WeatherData *weatherData) {
+    weather_args.dev = dev;
+    weather_args.weatherData = weatherData;
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&weather_busy, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return;
+    if (worker_pool_submit(worker_pool, weather_reading_job, &weather_args) != 0) {
+        __atomic_store_n(&weather_busy, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// Scheduler tasks: each only queues work for the pool, so a slow device or weather
+// request never holds up the others
+static void reading_task(void *arg) {
+    (void)arg;
+    GlobalConfig *site = site_config_acquire();
+    run_sqm_readings(site);
+    site_config_release(site);
+}
+
+static void heartbeat_task(void *arg) {
+    (void)arg;
+    GlobalConfig *site = site_config_acquire();
+    run_sqm_heartbeats(site);
+    site_config_release(site);
+}
+
+static void weather_task(void *arg) {
+    ThreadArgs *args = (ThreadArgs *)arg;
+    run_weather_update(args->dev, args->weatherData);
+}
+
+// Database: write partially filled batches so readings never sit in memory for long
+static void db_flush_task(void *arg) {
+    (void)arg;
+    db_flush_all();
+}
+
+// Helper: an interval setting in seconds as milliseconds; 0 means every second, as before
+static uint64_t interval_ms(unsigned int seconds) {
+    return seconds ? (uint64_t)seconds * 1000 : 1000;
+}
+
+// Helpers: the interval of each periodic task under a site configuration
+static uint64_t reading_interval_ms(const GlobalConfig *site) {
+    return site->readingIntervalMs ? site->readingIntervalMs : interval_ms(site->readingInterval);
+}
+
+static uint64_t flush_interval_ms(const GlobalConfig *site) {
+    return interval_ms(site->dbFlushInterval ? site->dbFlushInterval : DEFAULT_DB_FLUSH_INTERVAL);
+}
+
+/*
+ * Creates a device's database if it does not exist, or brings its archives up to date.
+ * Returns: 0 on success, -1 on error.
+ */
+static int prepare_database(const char *dbName) {
+    if (access(dbName, F_OK) != 0) {
+        if (db_create(dbName) != 0) {
+            LOGGER_ERROR(LOG_MOD_DB, "Failed to create database: %s", dbName);
+            return -1;
         }
-    #endif
-        if (join_ret != 0) {
-            printf("Thread timed out, cancelling...\n");
-            pthread_cancel(tid);
-            pthread_join(tid, NULL);
-            site->sqmHealthy = false;
-        }   
-} 
+    } else if (db_upgrade(dbName) != 0) {
+        LOGGER_ERROR(LOG_MOD_DB, "Failed to migrate database: %s", dbName);
+        return -1;
+    }
+    return 0;
+}
+
+// Reload state. SIGHUP and the reload command queue reloads for the worker pool; the
+// scheduler is only touched by the main thread, which is woken through reload_event_fd
+// to apply new intervals.
+static pthread_mutex_t reload_lock = PTHREAD_MUTEX_INITIALIZER;
+static int reload_event_fd = -1;
+static int weather_reload_pending = 0; // Weather settings changed; fetch with them at once
+
+/*
+ * Re-reads the configuration file into a new GlobalConfig, compares it with the live one,
+ * and swaps it in whole. Only what changed is restarted: a device whose address changed
+ * reconnects on its next job, new intervals are rescheduled, and new weather settings are
+ * used from the next weather request. Devices whose settings did not change keep reading
+ * throughout. Settings read only at startup (and a changed number of devices) keep their
+ * running values until a restart. The logger is always reconfigured, which also reopens
+ * a log file.
+ * Parameters: summary - receives a description of the result, or NULL; summary_size - its size.
+ * Returns: 0 on success, -1 if the file could not be read or a new database could not be prepared
+ *          (the running configuration is then left as it was).
+ */
+int reload_site_config(char *summary, size_t summary_size) {
+    char changed[512], kept[256], result[1024];
+    int ret = -1;
+    pthread_mutex_lock(&reload_lock);
+    GlobalConfig *old = site_config_acquire();
+    GlobalConfig *cfg = site_config_alloc();
+    if (!cfg || read_config(cfg, default_config_file) != 0) {
+        snprintf(result, sizeof(result), "failed: cannot read %s", default_config_file);
+        goto done;
+    }
+    // Adding or removing devices would need new polling state and worker capacity
+    bool keep_devices = cfg->numDevices != old->numDevices;
+    site_config_keep(cfg, old, SITE_CONFIG_RESTART, kept, sizeof(kept));
+    if (keep_devices) {
+        memcpy(cfg->devices, old->devices, sizeof(cfg->devices));
+        memcpy(cfg->sqmIP, old->sqmIP, sizeof(cfg->sqmIP));
+        memcpy(cfg->dbName, old->dbName, sizeof(cfg->dbName));
+        cfg->sqmPort = old->sqmPort;
+    }
+    if (cfg->enableDataSend && !spool_running) {
+        cfg->enableDataSend = false;
+        snprintf(kept + strlen(kept), sizeof(kept) - strlen(kept), "%senableDataSend", kept[0] ? ", " : "");
+    }
+    unsigned int classes = site_config_diff(old, cfg, changed, sizeof(changed));
+
+    // New database files are ready before any reading is written to them
+    for (int i = 0; i < cfg->numDevices && (classes & SITE_CONFIG_DEVICE); ++i) {
+        if (strcmp(cfg->devices[i].dbName, old->devices[i].dbName) != 0 && prepare_database(cfg->devices[i].dbName) != 0) {
+            snprintf(result, sizeof(result), "failed: cannot prepare database %s", cfg->devices[i].dbName);
+            goto done;
+        }
+    }
+
+    site_config_publish(cfg);
+    // cfg stays live until the next reload, which cannot start while reload_lock is held
+    if (logger_configure(cfg->logTarget, cfg->logLevel, cfg->logModules) != 0) {
+        LOGGER_WARN(LOG_MOD_CONFIG, "Ignoring invalid logTarget, logLevel, or logModules entries");
+    }
+    cfg = NULL;
+    if (classes & SITE_CONFIG_WEATHER) __atomic_store_n(&weather_reload_pending, 1, __ATOMIC_RELEASE);
+    if (reload_event_fd >= 0) {
+        uint64_t one = 1;
+        while (write(reload_event_fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+    }
+    int n = snprintf(result, sizeof(result), "%s%s", classes ? "applied " : "no changes", changed);
+    if (kept[0] && n > 0 && (size_t)n < sizeof(result)) snprintf(result + n, sizeof(result) - n, "; restart needed for %s", kept);
+    ret = 0;
+
+done:
+    if (ret == 0) LOGGER_INFO(LOG_MOD_CONFIG, "Configuration reloaded: %s", result);
+    else LOGGER_ERROR(LOG_MOD_CONFIG, "Configuration reload %s", result);
+    site_config_release(old);
+    site_config_free(cfg);
+    pthread_mutex_unlock(&reload_lock);
+    if (summary && summary_size) snprintf(summary, summary_size, "%s", result);
+    return ret;
+}
+
+static int reload_queued = 0; // A reload job is waiting for a worker
+
+// Worker job: runs a queued reload and pushes its result to control-port subscribers
+static void reload_job(void *arg) {
+    (void)arg;
+    // Cleared first, so a request made while the file is being read queues another pass
+    __atomic_store_n(&reload_queued, 0, __ATOMIC_RELEASE);
+    char summary[1024], event[1100];
+    reload_site_config(summary, sizeof(summary));
+    snprintf(event, sizeof(event), "Reload:%s\n", summary);
+    control_server_publish(event, strlen(event));
+}
+
+/*
+ * Queues a reload on the worker pool, so reading the file and preparing new databases never
+ * hold up the main loop or the control server. The result is logged and pushed as a Reload event.
+ * Returns: 0 if queued, 1 if a reload was already waiting, -1 if the pool could not take it.
+ */
+int queue_site_config_reload(void) {
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&reload_queued, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return 1;
+    if (!worker_pool || worker_pool_submit(worker_pool, reload_job, NULL) != 0) {
+        __atomic_store_n(&reload_queued, 0, __ATOMIC_RELEASE);
+        LOGGER_ERROR(LOG_MOD_CONFIG, "Configuration reload not queued: worker queue full");
+        return -1;
+    }
+    return 0;
+}
 
+// Intervals the scheduler is running with; only used by the main thread
+static uint64_t scheduled_reading_ms, scheduled_heartbeat_ms, scheduled_weather_ms, scheduled_flush_ms;
+
+// Helper: moves a task to a new interval if it changed
+static void reschedule(Scheduler *scheduler, SchedulerTaskFn fn, uint64_t *current, uint64_t ms, const char *name) {
+    if (*current == ms) return;
+    if (scheduler_set_interval(scheduler, fn, ms) == 0) {
+        LOGGER_INFO(LOG_MOD_MAIN, "%s interval now %llu ms", name, (unsigned long long)ms);
+        *current = ms;
+    }
+}
+
+/*
+ * Main thread, after a reload: applies new task intervals and starts a weather update if
+ * the weather settings changed, rather than waiting out the old interval.
+ */
+static void apply_reload(Scheduler *scheduler, AW_WeatherData *weatherData) {
+    uint64_t value;
+    while (read(reload_event_fd, &value, sizeof(value)) < 0 && errno == EINTR) {}
+    GlobalConfig *site = site_config_acquire();
+    reschedule(scheduler, reading_task, &scheduled_reading_ms, reading_interval_ms(site), "Reading");
+    reschedule(scheduler, heartbeat_task, &scheduled_heartbeat_ms, interval_ms(site->sqmHeartbeatInterval), "Heartbeat");
+    reschedule(scheduler, weather_task, &scheduled_weather_ms, interval_ms(site->AmbientWeatherUpdateInterval), "Weather");
+    reschedule(scheduler, db_flush_task, &scheduled_flush_ms, flush_interval_ms(site), "Database flush");
+    site_config_release(site);
+    if (__atomic_exchange_n(&weather_reload_pending, 0, __ATOMIC_ACQ_REL)) run_weather_update(&devices[0], weatherData);
+}
 
 /*
  * Main entry point for the NightWatcher application.
@@ -326,96 +628,173 @@ void launch_weather_thread(GlobalConfig *site, AW_WeatherData *weatherData) {
  */
 int main(void) {
 
-    // Register signal handlers for SIGHUP and SIGTERM
-    signal(SIGHUP, handle_sighup);
-    signal(SIGTERM, handle_sigterm);
-    signal(SIGINT, handle_sigint);
-
-    SQM_LE_Device dev;
-    GlobalConfig site;
-    AW_WeatherData weatherData;
-
+    // SIGHUP, SIGTERM, and SIGINT are read from a signalfd by the main loop. They are blocked
+    // before any thread starts so every thread inherits the mask and none of them takes the signal.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    // Log messages are queued for a writer thread; the atexit handler is registered first
+    // so it runs last and writes whatever the other exit handlers log.
+    if (logger_init() == 0) atexit(logger_close);
+
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        LOGGER_ERROR(LOG_MOD_MAIN, "signalfd: %s", strerror(errno));
+        return 1;
+    }
 
+    // The site configuration is published through site_config so a reload can replace it whole;
+    // startup holds a reference until the main loop begins
+    GlobalConfig *site = site_config_alloc();
+    AW_WeatherData weatherData = {0};
 
     // Initialize health variables to false until we get positive indication
-    site.sqmHealthy = false;    // Initialize to false to prevent reading uninitialized data in launched threads
-    dev.reading_ready = false;
     weatherData.weatherReady = false;
 
     // Load site configuration from file
-    if (load_site_config(&site) != 0) {
-        printf("Failed to load site configuration from %s\n", default_config_file);
+    if (!site || load_site_config(site) != 0) {
+        LOGGER_ERROR(LOG_MOD_CONFIG, "Failed to load site configuration from %s", default_config_file);
         return 1;
     }
-    // Assign dev struct elements from site struct
-    strncpy(dev.ip, site.sqmIP, sizeof(dev.ip));
-    dev.port = site.sqmPort;
-    dev.socket_fd = -1;
-    dev.last_reading[0] = '\0';
-
-    // try to get the weather
-    if (aw_init(site.AmbientWeatherAPIKey, site.AmbientWeatherAppKey, site.AmbientWeatherEncodedMAC)) {
-            if (aw_get_current_weather(&weatherData)) {
-                printf("Weather data retrieved successfully.\n");
-                printf("Temperature: %f\n", weatherData.temperature_f);
-                weatherData.weatherReady = true;
-            } else {
-                printf("Failed to retrieve weather data.\n");
-            }
-            aw_cleanup();
+    site_config_publish(site);
+    site = site_config_acquire();
+    if (logger_configure(site->logTarget, site->logLevel, site->logModules) != 0) {
+        LOGGER_WARN(LOG_MOD_CONFIG, "Ignoring invalid logTarget, logLevel, or logModules entries");
+    }
+    // Assign device struct elements from the configured device list
+    for (int i = 0; i < site->numDevices; ++i) {
+        SQM_LE_Device *dev = &devices[i];
+        strncpy(dev->ip, site->devices[i].ip, sizeof(dev->ip) - 1);
+        dev->port = site->devices[i].port;
+        dev->read_timeout_ms = site->sqmReadTimeout * 1000;
+        dev->write_timeout_ms = site->sqmWriteTimeout * 1000;
+        sqm_le_init(dev);
+        snapshot_publish_device(i, dev);
+        device_jobs[i].index = i;
+        device_jobs[i].dev = dev;
+        pthread_mutex_init(&device_jobs[i].state_lock, NULL);
+    }
+
+    // Set up the weather client once; its connection is reused by every update
+    if (configure_weather_client(site)) {
+        atexit(aw_cleanup);
+        if (aw_get_current_weather(&weatherData)) {
+            LOGGER_INFO(LOG_MOD_WEATHER, "Weather data retrieved, temperature %.1f F", weatherData.temperature_f);
+            weatherData.weatherReady = true;
         } else {
-            printf("Failed to initialize AmbientWeather API client.\n");
+            LOGGER_WARN(LOG_MOD_WEATHER, "Failed to retrieve weather data.");
         }
+    } else {
+        LOGGER_ERROR(LOG_MOD_WEATHER, "Failed to initialize AmbientWeather API client.");
+    }
+    snapshot_publish_weather(&weatherData);
+
+    // Periodic readings start on only if enableReadOnStartup is set; start and stop change it later
+    snapshot_set_sqm_read(site->enableReadOnStartup);
+
+    // Create each device's database if it does not exist, or bring its archives up to date
+    if (db_configure_archives(site->dbArchives) != 0) {
+        LOGGER_ERROR(LOG_MOD_CONFIG, "Invalid dbArchives setting: %s", site->dbArchives);
+        return 1;
+    }
+    for (int i = 0; i < site->numDevices; ++i) {
+        if (prepare_database(site->devices[i].dbName) != 0) return 1;
+    }
 
-    // Check if site.enableReadOnStartup is true, then set site.enableSQMread to true
-    site.enableSQMread = site.enableReadOnStartup;  
+    // Recent readings are also kept in memory for "db last" and "db range"
+    if (history_init(site->historySize) != 0) {
+        LOGGER_ERROR(LOG_MOD_DB, "Failed to allocate reading history");
+        return 1;
+    }
 
-    // Create the database if it does not exist
-    if (access(site.dbName, F_OK) != 0) {
-        if (db_create(site.dbName) != 0) {
-            printf("Failed to create database: %s\n", site.dbName);
+    // Buffer database writes; anything still buffered is written when the process exits
+    db_configure_writes(site->dbBatchSize, site->rrdcachedAddress);
+    atexit(db_close);
+
+    // Readings for the REST API go through an on-disk spool so outages lose nothing
+    if (site->enableDataSend) {
+        unsigned int batch_size = site->uploadBatchSize;
+        if (batch_size > NIGHTWATCHER_MAX_BATCH) batch_size = NIGHTWATCHER_MAX_BATCH;
+        api_client = nightwatcher_client_create("gilinskyresearch.conf");
+        if (!api_client) {
+            LOGGER_ERROR(LOG_MOD_API, "Failed to create NightWatcher API client");
             return 1;
         }
+        atexit(close_api_client); // Registered first so it runs after spool_close stops the uploader
+        if (spool_open(site->spoolFile, batch_size) != 0 || spool_start_uploader(upload_batch, api_client) != 0) {
+            LOGGER_ERROR(LOG_MOD_API, "Failed to open upload spool %s", site->spoolFile[0] ? site->spoolFile : SPOOL_DEFAULT_FILE);
+            return 1;
+        }
+        atexit(spool_close);
+        spool_running = true;
+    }
+
+    // Devices are polled concurrently by a small fixed pool of worker threads, which also fetch "db export" windows
+    worker_pool = worker_pool_create(site->workerThreads, (unsigned int)site->numDevices * 2 + 4 + CONTROL_EXPORT_JOBS);
+    if (!worker_pool) {
+        LOGGER_ERROR(LOG_MOD_MAIN, "Failed to start worker threads");
+        return 1;
     }
 
-    // Get unit information before starting reading thread
-    getUnitInformation(&dev, &site);
+    // Get unit information for every device before starting readings
+    run_sqm_heartbeats(site);
+    worker_pool_wait_idle(worker_pool);
 
     // Launch TCP listener in a separate thread
     pthread_t tcp_thread;
     ThreadArgs *tcp_args = malloc(sizeof(ThreadArgs));
-    tcp_args->dev = &dev;
-    tcp_args->site = &site;
+    tcp_args->dev = devices;
     tcp_args->weatherData = &weatherData;
     pthread_create(&tcp_thread, NULL, tcp_listener_thread, tcp_args);
 
 
-    // Main loop: periodically check unit information and launch reading thread
-    time_t last_heartbeat = 0;
-    time_t last_read = 0;
-    time_t last_weather = 0;
-    while (1) {
-        time_t now = time(NULL);
-        // Heartbeat: check unit information
-        if (now - last_heartbeat >= site.sqmHeartbeatInterval) {
-            getUnitInformation(&dev, &site);
-            last_heartbeat = now;
-            printf("site.sqmHealthy: %s\n", site.sqmHealthy ? "true" : "false");
-        }
-        // Reading: launch reading thread if interval elapsed
-        if (now - last_read >= site.readingInterval) {
-            if (site.sqmHealthy == true && site.enableSQMread == true) {
-            launch_sqm_read_thread(&dev, &site, &weatherData);
-            last_read = now;
+    // Main loop: every periodic task runs from one CLOCK_MONOTONIC timer. Readings are aligned
+    // to wall-clock multiples of the reading interval; the other tasks run one interval apart.
+    Scheduler *scheduler = scheduler_create();
+    ThreadArgs weather_task_args = { &devices[0], &weatherData };
+    scheduled_reading_ms = reading_interval_ms(site);
+    scheduled_heartbeat_ms = interval_ms(site->sqmHeartbeatInterval);
+    scheduled_weather_ms = interval_ms(site->AmbientWeatherUpdateInterval);
+    scheduled_flush_ms = flush_interval_ms(site);
+    reload_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!scheduler || reload_event_fd < 0 ||
+        scheduler_add(scheduler, scheduled_reading_ms, true, reading_task, NULL) != 0 ||
+        scheduler_add(scheduler, scheduled_heartbeat_ms, false, heartbeat_task, NULL) != 0 ||
+        scheduler_add(scheduler, scheduled_weather_ms, false, weather_task, &weather_task_args) != 0 ||
+        scheduler_add(scheduler, scheduled_flush_ms, false, db_flush_task, NULL) != 0) {
+        LOGGER_ERROR(LOG_MOD_MAIN, "Failed to start the scheduler");
+        return 1;
+    }
+    site_config_release(site);
+    site = NULL; // From here on every user takes the current config with site_config_acquire
+
+    struct pollfd fds[3] = {
+        { .fd = scheduler_fd(scheduler), .events = POLLIN },
+        { .fd = signal_fd, .events = POLLIN },
+        { .fd = reload_event_fd, .events = POLLIN },
+    };
+    while (!shutdown_requested) {
+        if (poll(fds, 3, -1) < 0) continue;
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+                if (info.ssi_signo == SIGHUP) handle_sighup(SIGHUP);
+                else if (info.ssi_signo == SIGTERM) handle_sigterm(SIGTERM);
+                else handle_sigint(SIGINT);
             }
         }
-        // Weather: launch weather thread if interval elapsed
-        if (now - last_weather >= site.AmbientWeatherUpdateInterval) {
-            launch_weather_thread(&site, &weatherData);
-            last_weather = now;
-        }
-        sleep(1);
+        if (!shutdown_requested && (fds[2].revents & POLLIN)) apply_reload(scheduler, &weatherData);
+        if (!shutdown_requested && (fds[0].revents & POLLIN)) scheduler_run_due(scheduler);
     }
 
+    LOGGER_INFO(LOG_MOD_MAIN, "Shutting down gracefully.");
+    scheduler_destroy(scheduler);
+    close(signal_fd);
+    worker_pool_destroy(worker_pool);
+
     return 0;
 }
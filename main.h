@@ -7,37 +7,70 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+#define NW_MAX_DEVICES 64 // Most SQM-LE photometers one daemon will poll
+
+// Connection settings for one SQM-LE photometer
+typedef struct {
+    char name[32];       // Short name used on the control port
+    char ip[64];
+    uint16_t port;
+    char dbName[256];    // RRD file for this device's readings
+} SQM_DeviceConfig;
+
 // Global site/device configuration structure
 typedef struct {
     char siteName[256];
     float latitude;
     float longitude;
     float elevation;
-    int sqmModel;
+    int sqmModel;  // As configured; the model and serial a device reports are in its SQM_LE_Device
     int sqmSerial;
     char sqmIP[64];
     uint16_t sqmPort;
     char dbName[256];
     unsigned int readingInterval; // Number of seconds between sqm readings
+    unsigned int readingIntervalMs; // Milliseconds between sqm readings; overrides readingInterval when set
     uint16_t controlPort; // TCP port on which to listen for commands
     unsigned int sqmHeartbeatInterval; // Heartbeat interval in seconds
-    bool sqmHealthy; // True if SQM is healthy
     unsigned int sqmReadTimeout;  // SQM read timeout in seconds
     unsigned int sqmWriteTimeout; // SQM write timeout in seconds
-    bool enableSQMread;           // Enable periodic SQM reading
     bool enableReadOnStartup;     // Enable reading on startup (configurable)
     char AmbientWeatherAPIKey[66]; // Ambient Weather API key
     char AmbientWeatherAppKey[66]; // Ambient Weather app key
     unsigned int AmbientWeatherUpdateInterval; // Ambient Weather update interval in seconds
     char AmbientWeatherDeviceMAC[17]; // Ambient Weather device MAC
     char AmbientWeatherEncodedMAC[28]; // Ambient Weather encoded MAC for URL construction
+    char AmbientWeatherURL[256];  // API base URL (empty for the public API)
+    unsigned int AmbientWeatherTimeout; // Seconds allowed for one weather request
     bool enableWeather; // Enable Weather information retrieval
     bool enableDataSend; // Enable sending data by REST API to configured sites
+    SQM_DeviceConfig devices[NW_MAX_DEVICES]; // Photometers to poll; devices[0] mirrors sqmIP/sqmPort/dbName
+    int numDevices;
+    unsigned int workerThreads; // Threads shared by device readings and heartbeats
+    unsigned int dbBatchSize;     // Readings buffered per database before one RRD update (1 = write each reading)
+    unsigned int dbFlushInterval; // Seconds between flushes of partially filled batches
+    char rrdcachedAddress[256];   // rrdcached socket (e.g. unix:/run/rrdcached.sock); empty writes files directly
+    char dbArchives[128];         // RRD resolutions as steps:rows,... (empty for the default set)
+    unsigned int historySize;     // Recent readings kept in memory for "db last"/"db range"
+    char spoolFile[256];          // Readings waiting to be uploaded (empty for ./nightwatcher.spool)
+    unsigned int uploadBatchSize; // Readings sent per upload request
+    char logTarget[256];          // stderr, syslog, or a file path (empty for stderr)
+    char logLevel[16];            // error, warn, info, or debug (empty for info)
+    char logModules[128];         // Per-module levels as module=level,... (e.g. sqm=debug,db=warn)
 } GlobalConfig;
 
 int main(void);
 
+// Re-reads the configuration file and applies what changed. Runs on a worker thread.
+// summary receives a one-line description of the result. Returns 0 on success, -1 on error.
+int reload_site_config(char *summary, size_t summary_size);
+
+// Queues reload_site_config on the worker pool (SIGHUP and the reload command).
+// Returns 0 if queued, 1 if a reload was already waiting, -1 if the queue was full.
+int queue_site_config_reload(void);
+
 #endif // MAIN_H
@@ -0,0 +1,246 @@
+/*
+ * Project: NightWatcher
+ * File: metrics.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "nightwatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+// One thread's counts. Only the owning thread writes a shard, so an update is a relaxed
+// load and store with no lock or atomic read-modify-write; readers sum every shard.
+// Shards live as long as the process, since the threads that record are long-lived.
+typedef struct MetricsShard {
+    uint64_t buckets[METRIC_OP_COUNT][METRICS_BUCKETS];
+    uint64_t results[METRIC_OP_COUNT][METRIC_RESULT_COUNT];
+    uint64_t sum_ns[METRIC_OP_COUNT];
+    uint64_t max_ns[METRIC_OP_COUNT];
+    struct MetricsShard *next;
+} MetricsShard;
+
+static MetricsShard *shard_list;         // Every shard, newest first
+static __thread MetricsShard *my_shard;  // This thread's shard, created on first use
+static int64_t gauges[METRIC_GAUGE_COUNT];
+static uint64_t counters[METRIC_COUNTER_COUNT];
+
+static const char *op_names[METRIC_OP_COUNT] = {
+    "sqm_roundtrip", "weather_fetch", "rrd_update", "api_upload", "command"
+};
+static const char *result_names[METRIC_RESULT_COUNT] = { "ok", "fail", "timeout" };
+static const char *gauge_names[METRIC_GAUGE_COUNT] = {
+    "worker_queue_depth", "control_connections", "subscribers", "spool_pending_bytes"
+};
+static const char *counter_names[METRIC_COUNTER_COUNT] = { "db_readings_dropped" };
+
+// Prometheus histogram bucket bounds in seconds
+static const double prometheus_bounds[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+    0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60
+};
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+uint64_t metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Helper: adds to a counter owned by this thread
+static inline void shard_add(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+// Helper: returns the calling thread's shard, registering a new one on first use
+static MetricsShard *thread_shard(void) {
+    if (my_shard) return my_shard;
+    MetricsShard *shard = calloc(1, sizeof(MetricsShard));
+    if (!shard) return NULL;
+    shard->next = __atomic_load_n(&shard_list, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&shard_list, &shard->next, shard, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+    my_shard = shard;
+    return shard;
+}
+
+// Helper: histogram bucket for a latency in microseconds
+static unsigned int bucket_index(uint64_t us) {
+    if (us < (1u << METRICS_SUB_BITS)) return (unsigned int)us;
+    unsigned int octave = 63 - (unsigned int)__builtin_clzll(us);
+    if (octave >= METRICS_MAX_OCTAVE) return METRICS_BUCKETS - 1;
+    unsigned int sub = (unsigned int)(us >> (octave - METRICS_SUB_BITS)) & ((1u << METRICS_SUB_BITS) - 1);
+    return ((octave - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS) + sub;
+}
+
+// Helper: one past the largest latency in microseconds that falls in a bucket
+static uint64_t bucket_limit(unsigned int index) {
+    if (index < (1u << METRICS_SUB_BITS)) return index + 1;
+    unsigned int octave = (index >> METRICS_SUB_BITS) + METRICS_SUB_BITS - 1;
+    uint64_t sub = index & ((1u << METRICS_SUB_BITS) - 1);
+    return (((1ULL << METRICS_SUB_BITS) + sub + 1) << (octave - METRICS_SUB_BITS));
+}
+
+void metrics_record(MetricOp op, uint64_t start_ns, MetricResult result) {
+    MetricsShard *shard = thread_shard();
+    if (!shard) return;
+    uint64_t elapsed = metrics_now() - start_ns;
+    shard_add(&shard->buckets[op][bucket_index(elapsed / 1000)], 1);
+    shard_add(&shard->results[op][result], 1);
+    shard_add(&shard->sum_ns[op], elapsed);
+    if (elapsed > shard->max_ns[op]) __atomic_store_n(&shard->max_ns[op], elapsed, __ATOMIC_RELAXED);
+}
+
+void metrics_gauge_set(MetricGauge gauge, int64_t value) {
+    __atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+void metrics_gauge_add(MetricGauge gauge, int64_t delta) {
+    __atomic_add_fetch(&gauges[gauge], delta, __ATOMIC_RELAXED);
+}
+
+void metrics_count(MetricCounter counter, uint64_t value) {
+    __atomic_add_fetch(&counters[counter], value, __ATOMIC_RELAXED);
+}
+
+// Helper: sums every thread's shard into total
+static void metrics_collect(MetricsShard *total) {
+    memset(total, 0, sizeof(*total));
+    for (MetricsShard *s = __atomic_load_n(&shard_list, __ATOMIC_ACQUIRE); s; s = s->next) {
+        for (int op = 0; op < METRIC_OP_COUNT; ++op) {
+            for (int b = 0; b < METRICS_BUCKETS; ++b) {
+                total->buckets[op][b] += __atomic_load_n(&s->buckets[op][b], __ATOMIC_RELAXED);
+            }
+            for (int r = 0; r < METRIC_RESULT_COUNT; ++r) {
+                total->results[op][r] += __atomic_load_n(&s->results[op][r], __ATOMIC_RELAXED);
+            }
+            total->sum_ns[op] += __atomic_load_n(&s->sum_ns[op], __ATOMIC_RELAXED);
+            uint64_t max = __atomic_load_n(&s->max_ns[op], __ATOMIC_RELAXED);
+            if (max > total->max_ns[op]) total->max_ns[op] = max;
+        }
+    }
+}
+
+// Helper: operation count summed over its histogram
+static uint64_t op_count(const MetricsShard *total, int op) {
+    uint64_t count = 0;
+    for (int b = 0; b < METRICS_BUCKETS; ++b) count += total->buckets[op][b];
+    return count;
+}
+
+// Helper: latency in microseconds at quantile q, reported as the top of its bucket
+// (but never above the largest latency seen)
+static uint64_t op_quantile_us(const MetricsShard *total, int op, uint64_t count, double q) {
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)count);
+    if (rank >= count) rank = count - 1;
+    uint64_t max_us = total->max_ns[op] / 1000;
+    uint64_t seen = 0;
+    for (unsigned int b = 0; b < METRICS_BUCKETS; ++b) {
+        seen += total->buckets[op][b];
+        if (seen > rank) return bucket_limit(b) - 1 < max_us ? bucket_limit(b) - 1 : max_us;
+    }
+    return max_us;
+}
+
+// Helper: appends to buf, never past size
+static void append(char *buf, size_t size, size_t *offset, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+static void append(char *buf, size_t size, size_t *offset, const char *fmt, ...) {
+    if (*offset >= size) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *offset, size - *offset, fmt, ap);
+    va_end(ap);
+    if (n > 0) *offset += (size_t)n;
+    if (*offset >= size) *offset = size - 1;
+}
+
+size_t metrics_format(char *buf, size_t size) {
+    static MetricsShard total; // Only the control-server thread formats metrics
+    metrics_collect(&total);
+    size_t offset = 0;
+    buf[0] = '\0';
+    for (int op = 0; op < METRIC_OP_COUNT; ++op) {
+        uint64_t count = op_count(&total, op);
+        append(buf, size, &offset, "Metric:%s:count=%llu:ok=%llu:fail=%llu:timeout=%llu:mean_us=%llu",
+               op_names[op], (unsigned long long)count,
+               (unsigned long long)total.results[op][METRIC_OK],
+               (unsigned long long)total.results[op][METRIC_FAIL],
+               (unsigned long long)total.results[op][METRIC_TIMEOUT],
+               (unsigned long long)(count ? total.sum_ns[op] / count / 1000 : 0));
+        append(buf, size, &offset, ":p50_us=%llu:p90_us=%llu:p99_us=%llu:p999_us=%llu:max_us=%llu\n",
+               (unsigned long long)op_quantile_us(&total, op, count, 0.5),
+               (unsigned long long)op_quantile_us(&total, op, count, 0.9),
+               (unsigned long long)op_quantile_us(&total, op, count, 0.99),
+               (unsigned long long)op_quantile_us(&total, op, count, 0.999),
+               (unsigned long long)(total.max_ns[op] / 1000));
+    }
+    for (int g = 0; g < METRIC_GAUGE_COUNT; ++g) {
+        append(buf, size, &offset, "Gauge:%s:%lld\n", gauge_names[g], (long long)__atomic_load_n(&gauges[g], __ATOMIC_RELAXED));
+    }
+    for (int c = 0; c < METRIC_COUNTER_COUNT; ++c) {
+        append(buf, size, &offset, "Counter:%s:%llu\n", counter_names[c],
+               (unsigned long long)__atomic_load_n(&counters[c], __ATOMIC_RELAXED));
+    }
+    return offset;
+}
+
+size_t metrics_format_prometheus(char *buf, size_t size) {
+    static MetricsShard total; // Only the control-server thread formats metrics
+    metrics_collect(&total);
+    size_t offset = 0;
+    buf[0] = '\0';
+    size_t nbounds = sizeof(prometheus_bounds) / sizeof(prometheus_bounds[0]);
+
+    append(buf, size, &offset, "# HELP nightwatcher_op_duration_seconds Latency of timed operations.\n"
+                               "# TYPE nightwatcher_op_duration_seconds histogram\n");
+    for (int op = 0; op < METRIC_OP_COUNT; ++op) {
+        uint64_t cumulative = 0;
+        unsigned int b = 0;
+        for (size_t i = 0; i < nbounds; ++i) {
+            // A fine bucket is counted once its whole range fits under the bound
+            uint64_t bound_us = (uint64_t)(prometheus_bounds[i] * 1e6);
+            while (b < METRICS_BUCKETS && bucket_limit(b) - 1 <= bound_us) cumulative += total.buckets[op][b++];
+            append(buf, size, &offset, "nightwatcher_op_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %llu\n",
+                   op_names[op], prometheus_bounds[i], (unsigned long long)cumulative);
+        }
+        uint64_t count = op_count(&total, op);
+        append(buf, size, &offset, "nightwatcher_op_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n",
+               op_names[op], (unsigned long long)count);
+        append(buf, size, &offset, "nightwatcher_op_duration_seconds_sum{op=\"%s\"} %.9f\n",
+               op_names[op], (double)total.sum_ns[op] / 1e9);
+        append(buf, size, &offset, "nightwatcher_op_duration_seconds_count{op=\"%s\"} %llu\n",
+               op_names[op], (unsigned long long)count);
+    }
+
+    append(buf, size, &offset, "# HELP nightwatcher_op_latency_quantile_seconds Latency quantiles since start, from the histogram.\n"
+                               "# TYPE nightwatcher_op_latency_quantile_seconds gauge\n");
+    for (int op = 0; op < METRIC_OP_COUNT; ++op) {
+        uint64_t count = op_count(&total, op);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q) {
+            append(buf, size, &offset, "nightwatcher_op_latency_quantile_seconds{op=\"%s\",quantile=\"%g\"} %.6f\n",
+                   op_names[op], quantiles[q], (double)op_quantile_us(&total, op, count, quantiles[q]) / 1e6);
+        }
+    }
+
+    append(buf, size, &offset, "# HELP nightwatcher_op_total Completed operations by result.\n"
+                               "# TYPE nightwatcher_op_total counter\n");
+    for (int op = 0; op < METRIC_OP_COUNT; ++op) {
+        for (int r = 0; r < METRIC_RESULT_COUNT; ++r) {
+            append(buf, size, &offset, "nightwatcher_op_total{op=\"%s\",result=\"%s\"} %llu\n",
+                   op_names[op], result_names[r], (unsigned long long)total.results[op][r]);
+        }
+    }
+
+    for (int g = 0; g < METRIC_GAUGE_COUNT; ++g) {
+        append(buf, size, &offset, "# TYPE nightwatcher_%s gauge\nnightwatcher_%s %lld\n",
+               gauge_names[g], gauge_names[g], (long long)__atomic_load_n(&gauges[g], __ATOMIC_RELAXED));
+    }
+    for (int c = 0; c < METRIC_COUNTER_COUNT; ++c) {
+        append(buf, size, &offset, "# TYPE nightwatcher_%s_total counter\nnightwatcher_%s_total %llu\n",
+               counter_names[c], counter_names[c], (unsigned long long)__atomic_load_n(&counters[c], __ATOMIC_RELAXED));
+    }
+    return offset;
+}
@@ -0,0 +1,73 @@
+/*
+ * Project: NightWatcher
+ * File: metrics.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Latency histograms are log-linear: 2^METRICS_SUB_BITS buckets per power of two of
+// microseconds, so any recorded value is within 12.5% of its bucket's bounds.
+#define METRICS_SUB_BITS   3
+#define METRICS_MAX_OCTAVE 36   // Longest tracked latency is 2^36 us (about 19 hours)
+#define METRICS_BUCKETS    ((METRICS_MAX_OCTAVE - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+
+// Timed operations
+typedef enum {
+    METRIC_SQM_ROUNDTRIP,   // One command/response exchange with an SQM-LE
+    METRIC_WEATHER_FETCH,   // One Ambient Weather API request
+    METRIC_RRD_UPDATE,      // One batched RRD update (file or rrdcached)
+    METRIC_API_UPLOAD,      // One POST to the NightWatcher API
+    METRIC_COMMAND,         // One control-port command
+    METRIC_OP_COUNT
+} MetricOp;
+
+typedef enum {
+    METRIC_OK,
+    METRIC_FAIL,
+    METRIC_TIMEOUT,
+    METRIC_RESULT_COUNT
+} MetricResult;
+
+// Values sampled as they change
+typedef enum {
+    METRIC_GAUGE_WORKER_QUEUE,        // Jobs waiting for a worker thread
+    METRIC_GAUGE_CONTROL_CONNECTIONS, // Open control-port connections
+    METRIC_GAUGE_SUBSCRIBERS,         // Control-port event subscribers
+    METRIC_GAUGE_SPOOL_PENDING,       // Bytes spooled but not yet uploaded
+    METRIC_GAUGE_COUNT
+} MetricGauge;
+
+// Events counted since start
+typedef enum {
+    METRIC_COUNTER_DB_DROPPED,        // Readings that could not be written to their RRD file
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+// Returns a CLOCK_MONOTONIC timestamp in nanoseconds to pass to metrics_record.
+uint64_t metrics_now(void);
+
+// Records one operation that started at start_ns (from metrics_now) and has just finished.
+// Lock-free: each thread counts into its own shard.
+void metrics_record(MetricOp op, uint64_t start_ns, MetricResult result);
+
+// Sets a gauge, or adjusts it by delta.
+void metrics_gauge_set(MetricGauge gauge, int64_t value);
+void metrics_gauge_add(MetricGauge gauge, int64_t delta);
+
+// Adds to an event counter.
+void metrics_count(MetricCounter counter, uint64_t value);
+
+// Writes the "metrics" command response: one Metric: line per operation, one Gauge: line per gauge,
+// and one Counter: line per counter.
+// Returns the response length.
+size_t metrics_format(char *buf, size_t size);
+
+// Writes all metrics in the Prometheus text exposition format. Returns the length.
+size_t metrics_format_prometheus(char *buf, size_t size);
+
+#endif // METRICS_H
@@ -13,7 +13,18 @@
 #include "config_file_handler/config_file_handler.h"
 #include "db_handler/db_handler.h"
 #include "weather/AmbientWeather/AmbientWeather.h"
+#include "weather/AmbientWeather/aw_json.h"
 #include "command_handler/command_handler.h"
+#include "worker_pool/worker_pool.h"
+#include "control_server/control_server.h"
+#include "history/history.h"
+#include "spool/spool.h"
+#include "snapshot/snapshot.h"
+#include "site_config/site_config.h"
+#include "dt_record/dt_record.h"
+#include "scheduler/scheduler.h"
+#include "metrics/metrics.h"
+#include "logger/logger.h"
 #include "send_data/GilinskyResearch/nightwatcher_client.h"
 
 #endif // NIGHTWATCHER_H
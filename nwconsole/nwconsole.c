@@ -33,6 +33,48 @@ int connect_to_nightwatcher(const char *ip, int port) {
     return sock;
 }
 
+// Read exactly len bytes from the socket
+static int read_full(int sock, char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(sock, buf + got, len - got);
+        if (n <= 0) return -1;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+// Read one framed response ("RSP <length>\n" followed by the payload) into buf.
+// Returns the payload length, or -1 on error or if the payload does not fit.
+int read_frame(int sock, char *buf, size_t bufsize) {
+    char header[32];
+    size_t hlen = 0;
+    while (hlen < sizeof(header) - 1) {
+        if (read_full(sock, &header[hlen], 1) != 0) return -1;
+        if (header[hlen] == '\n') break;
+        hlen++;
+    }
+    header[hlen] = '\0';
+    if (strncmp(header, "RSP ", 4) != 0) return -1;
+    size_t len = (size_t)strtoul(header + 4, NULL, 10);
+    if (len >= bufsize) return -1;
+    if (read_full(sock, buf, len) != 0) return -1;
+    buf[len] = '\0';
+    return (int)len;
+}
+
+// Connect and switch the connection to session mode so it can be reused for every poll.
+int open_nightwatcher_session(const char *ip, int port) {
+    char ack[64];
+    int sock = connect_to_nightwatcher(ip, port);
+    if (sock < 0) return -1;
+    if (write(sock, "session\n", 8) != 8 || read_frame(sock, ack, sizeof(ack)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
 // Read IP and port from nwconsole.conf
 int read_nwconsole_conf(char *ip, size_t ip_len, int *port) {
     FILE *f = fopen("conf/nwconsole.conf", "r");
@@ -54,60 +96,24 @@ int read_nwconsole_conf(char *ip, size_t ip_len, int *port) {
     return 0;
 }
 
-// Fetch data from NightWatcher
+// Fetch data from NightWatcher as a binary dt record (see dt_record.h); fields are read directly
 int fetch_nw_data(int sock, NWData *data) {
-    char sendbuf[128], recvbuf[1024];
-    ssize_t n;
+    char recvbuf[BUF_SIZE * 4];
+    DtRecord rec;
     memset(data, 0, sizeof(NWData));
 
-    // Use the new dt command to get all data
-    snprintf(sendbuf, sizeof(sendbuf), "dt\n");
-    if (write(sock, sendbuf, strlen(sendbuf)) < 0) return -1;
-    n = read(sock, recvbuf, sizeof(recvbuf) - 1);
-    if (n <= 0) return -1;
-    recvbuf[n] = '\0';
-    // Parse the comma-separated response from dt
-    // Example: siteName,latitude,longitude,elevation,sqmModel,sqmSerial,sqmIP,sqmPort,dbName,readingInterval,controlPort,sqmHealthy,...,mpsqa,...,temperature_f,pressure_in,humidity,...
-    // For demo, extract mpsqa, temperature, pressure, humidity, site_name, intervals
-    char *fields[64];
-    int i = 0;
-    char *token = strtok(recvbuf, ",");
-    while (token && i < 64) {
-        fields[i++] = token;
-        token = strtok(NULL, ",");
-    }
-    // Defensive: check field count
-    if (i > 0) {
-        // mpsqa is field 28 (0-based index)
-        data->mpsqa = (i > 28) ? atof(fields[27]) : 0;
-        // temperature is field 34 (AW_WeatherData.temperature_f)
-        data->temperature = (i > 44) ? atof(fields[45]) : 0;
-        // pressure is field 38 (AW_WeatherData.pressure_in)
-        data->pressure = (i > 48) ? atof(fields[49]) : 0;
-        // humidity is field 35 (AW_WeatherData.humidity)
-        data->humidity = (i > 45) ? atof(fields[46]) : 0;
-        // site_name is field 0
-        strncpy(data->site_name, fields[0], sizeof(data->site_name)-1);
-        data->site_name[sizeof(data->site_name)-1] = '\0';
-        // site_location: combine latitude,longitude (fields 1,2)
-        snprintf(data->site_location, sizeof(data->site_location), "%s,%s", (i>1)?fields[1]:"", (i>2)?fields[2]:"");
-        // sqm_interval is field 9
-        data->sqm_interval = (i > 9) ? atoi(fields[9]) : -1;
-        // weather_interval is field 16
-        data->weather_interval = (i > 16) ? atoi(fields[16]) : -1;
-        // enable_data_send is after enableWeather (field 20, so index 21)
-        data->enable_data_send = (i > 21) ? atoi(fields[20]) : 0;
-    } else {
-        data->mpsqa = 0;
-        data->temperature = 999;
-        data->pressure = 0;
-        data->humidity = 0;
-        strcpy(data->site_name, "N/A");
-        strcpy(data->site_location, "N/A");
-        data->sqm_interval = -1;
-        data->weather_interval = -1;
-        data->enable_data_send = 0;
-    }
+    if (write(sock, "dt bin\n", 7) != 7) return -1;
+    int n = read_frame(sock, recvbuf, sizeof(recvbuf));
+    if (n < 0) return -1;
+    if (dt_record_decode(recvbuf, (size_t)n, &rec, data->site_name, NULL) != 0) return -1;
+    data->mpsqa = rec.mpsqa;
+    data->temperature = (float)rec.temperature_f;
+    data->pressure = (float)rec.pressure_in;
+    data->humidity = (float)rec.humidity;
+    snprintf(data->site_location, sizeof(data->site_location), "%f,%f", rec.latitude, rec.longitude);
+    data->sqm_interval = (int)rec.reading_interval;
+    data->weather_interval = (int)rec.weather_interval;
+    data->enable_data_send = (rec.flags & DT_FLAG_DATA_SEND) ? 1 : 0;
     return 0;
 }
 
@@ -151,21 +157,26 @@ int main() {
     read_nwconsole_conf(ip, sizeof(ip), &port);
 
     NWData data;
+    int sock = -1;
     while (1) {
-        int sock = connect_to_nightwatcher(ip, port);
+        // Keep one session open across polls; reconnect only if it drops
+        if (sock < 0) sock = open_nightwatcher_session(ip, port);
         if (sock < 0) {
             endwin();
             fprintf(stderr, "Failed to connect to NightWatcher TCP interface.\n");
             return 1;
         }
-        fetch_nw_data(sock, &data);
-        close(sock);
+        if (fetch_nw_data(sock, &data) != 0) {
+            close(sock);
+            sock = -1;
+        }
 //        printf("Temperature: %f\n", data.temperature);
         draw_ui(win1, win2, win3, &data);
         timeout(1000); // 1 second
         int ch = getch();
         if (ch == 'q' || ch == 'Q') break;
     }
+    if (sock >= 0) close(sock);
     delwin(win1);
     delwin(win2);
     delwin(win3);
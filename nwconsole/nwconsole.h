@@ -8,6 +8,7 @@
 #define NWCONSOLE_H
 
 #include <ncurses.h>
+#include "dt_record.h"
 
 #define SERVER_IP   "127.0.0.1"  // Change as needed
 #define SERVER_PORT 9000         // Change as needed
@@ -18,7 +19,7 @@ typedef struct __attribute__((__packed__)) {
     float temperature;
     float pressure;
     float humidity;
-    char site_name[128];
+    char site_name[DT_RECORD_MAX_NAME + 1];
     char site_location[128];
     int sqm_interval;
     int weather_interval;
@@ -26,6 +27,8 @@ typedef struct __attribute__((__packed__)) {
 } NWData;
 
 int connect_to_nightwatcher(const char *ip, int port);
+int open_nightwatcher_session(const char *ip, int port);
+int read_frame(int sock, char *buf, size_t bufsize);
 int fetch_nw_data(int sock, NWData *data);
 void draw_ui(WINDOW *win1, WINDOW *win2, WINDOW *win3, NWData *data);
 
@@ -0,0 +1,175 @@
+/*
+ * Project: NightWatcher
+ * File: scheduler.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "nightwatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC  1000000000ULL
+
+typedef struct {
+    uint64_t deadline;    // CLOCK_MONOTONIC nanoseconds of the next run
+    uint64_t interval;    // Nanoseconds
+    bool aligned;         // Runs on wall-clock multiples of interval
+    SchedulerTaskFn fn;
+    void *arg;
+} SchedulerTask;
+
+struct Scheduler {
+    int timer_fd;
+    SchedulerTask heap[SCHEDULER_MAX_TASKS]; // Min-heap on deadline
+    unsigned int count;
+};
+
+// Helper: reads a clock in nanoseconds
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// Helper: monotonic deadline of the wall-clock boundary after the one nearest to now.
+// Measuring from the nearest boundary keeps a task that fires a hair before its boundary
+// (the clocks are not exactly in step) from running twice.
+static uint64_t next_aligned_deadline(uint64_t interval, uint64_t mono_now) {
+    uint64_t real_now = clock_ns(CLOCK_REALTIME);
+    uint64_t next_real = (real_now + interval / 2) / interval * interval + interval;
+    return mono_now + (next_real - real_now);
+}
+
+static void heap_swap(Scheduler *sched, unsigned int a, unsigned int b) {
+    SchedulerTask tmp = sched->heap[a];
+    sched->heap[a] = sched->heap[b];
+    sched->heap[b] = tmp;
+}
+
+static void heap_sift_up(Scheduler *sched, unsigned int i) {
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (sched->heap[parent].deadline <= sched->heap[i].deadline) break;
+        heap_swap(sched, parent, i);
+        i = parent;
+    }
+}
+
+static void heap_sift_down(Scheduler *sched, unsigned int i) {
+    while (1) {
+        unsigned int smallest = i;
+        unsigned int left = 2 * i + 1, right = 2 * i + 2;
+        if (left < sched->count && sched->heap[left].deadline < sched->heap[smallest].deadline) smallest = left;
+        if (right < sched->count && sched->heap[right].deadline < sched->heap[smallest].deadline) smallest = right;
+        if (smallest == i) break;
+        heap_swap(sched, smallest, i);
+        i = smallest;
+    }
+}
+
+/*
+ * Arms the timerfd for the earliest deadline.
+ */
+static void scheduler_arm(Scheduler *sched) {
+    struct itimerspec its = {0};
+    if (sched->count > 0) {
+        uint64_t deadline = sched->heap[0].deadline;
+        its.it_value.tv_sec = (time_t)(deadline / NSEC_PER_SEC);
+        its.it_value.tv_nsec = (long)(deadline % NSEC_PER_SEC);
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1; // Zero disarms
+    }
+    if (timerfd_settime(sched->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) LOGGER_ERROR(LOG_MOD_MAIN, "timerfd_settime: %s", strerror(errno));
+}
+
+Scheduler *scheduler_create(void) {
+    Scheduler *sched = calloc(1, sizeof(Scheduler));
+    if (!sched) return NULL;
+    sched->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sched->timer_fd < 0) {
+        LOGGER_ERROR(LOG_MOD_MAIN, "timerfd_create: %s", strerror(errno));
+        free(sched);
+        return NULL;
+    }
+    return sched;
+}
+
+int scheduler_add(Scheduler *sched, uint64_t interval_ms, bool aligned, SchedulerTaskFn fn, void *arg) {
+    if (interval_ms == 0 || sched->count == SCHEDULER_MAX_TASKS) return -1;
+    SchedulerTask *task = &sched->heap[sched->count];
+    task->interval = interval_ms * NSEC_PER_MSEC;
+    task->aligned = aligned;
+    task->fn = fn;
+    task->arg = arg;
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    if (aligned) {
+        uint64_t real_now = clock_ns(CLOCK_REALTIME);
+        task->deadline = now + (task->interval - real_now % task->interval) % task->interval;
+    } else {
+        task->deadline = now + task->interval;
+    }
+    heap_sift_up(sched, sched->count++);
+    scheduler_arm(sched);
+    return 0;
+}
+
+int scheduler_set_interval(Scheduler *sched, SchedulerTaskFn fn, uint64_t interval_ms) {
+    if (interval_ms == 0) return -1;
+    for (unsigned int i = 0; i < sched->count; ++i) {
+        SchedulerTask *task = &sched->heap[i];
+        if (task->fn != fn) continue;
+        task->interval = interval_ms * NSEC_PER_MSEC;
+        uint64_t now = clock_ns(CLOCK_MONOTONIC);
+        if (task->aligned) {
+            uint64_t real_now = clock_ns(CLOCK_REALTIME);
+            task->deadline = now + (task->interval - real_now % task->interval) % task->interval;
+        } else if (task->deadline > now + task->interval) {
+            task->deadline = now + task->interval;
+        }
+        // The deadline may have moved either way
+        heap_sift_up(sched, i);
+        heap_sift_down(sched, i);
+        scheduler_arm(sched);
+        return 0;
+    }
+    return -1;
+}
+
+int scheduler_fd(const Scheduler *sched) {
+    return sched->timer_fd;
+}
+
+void scheduler_run_due(Scheduler *sched) {
+    uint64_t expirations;
+    if (read(sched->timer_fd, &expirations, sizeof(expirations)) < 0) {
+        // EAGAIN: woken for a deadline that was already handled; fall through and re-check
+    }
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    while (sched->count > 0 && sched->heap[0].deadline <= now) {
+        SchedulerTask *task = &sched->heap[0];
+        task->fn(task->arg);
+        now = clock_ns(CLOCK_MONOTONIC);
+        if (task->aligned) {
+            // Re-derived from the wall clock each time, so clock steps are followed too
+            task->deadline = next_aligned_deadline(task->interval, now);
+        } else {
+            // Skip runs that were missed entirely rather than running them back to back
+            task->deadline += task->interval;
+            if (task->deadline <= now) task->deadline += (now - task->deadline) / task->interval * task->interval + task->interval;
+        }
+        heap_sift_down(sched, 0);
+    }
+    scheduler_arm(sched);
+}
+
+void scheduler_destroy(Scheduler *sched) {
+    if (!sched) return;
+    close(sched->timer_fd);
+    free(sched);
+}
@@ -0,0 +1,44 @@
+/*
+ * Project: NightWatcher
+ * File: scheduler.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCHEDULER_MAX_TASKS 16
+
+// A periodic task. It runs on the thread that calls scheduler_run_due, so it should only
+// queue work (for example on the worker pool) and return.
+typedef void (*SchedulerTaskFn)(void *arg);
+
+typedef struct Scheduler Scheduler;
+
+// Creates a scheduler backed by one CLOCK_MONOTONIC timerfd. Returns NULL on error.
+Scheduler *scheduler_create(void);
+
+// Adds a task run every interval_ms milliseconds. An aligned task runs on wall-clock multiples
+// of its interval (a 60000 ms task at hh:mm:00); otherwise it first runs one interval from now.
+// Deadlines advance by whole intervals, so lateness never accumulates.
+// Returns 0 on success, -1 if interval_ms is 0 or the scheduler is full.
+int scheduler_add(Scheduler *sched, uint64_t interval_ms, bool aligned, SchedulerTaskFn fn, void *arg);
+
+// Changes the interval of the task added with fn. An aligned task next runs on the first boundary
+// of the new interval; any other task runs one new interval from now, or at its old deadline
+// if that is sooner. Returns 0 on success, -1 if interval_ms is 0 or no task has fn.
+int scheduler_set_interval(Scheduler *sched, SchedulerTaskFn fn, uint64_t interval_ms);
+
+// Returns the timerfd to wait on; it is readable when a task is due.
+int scheduler_fd(const Scheduler *sched);
+
+// Runs every task whose deadline has passed and re-arms the timer for the next one.
+void scheduler_run_due(Scheduler *sched);
+
+// Closes the timerfd and frees the scheduler.
+void scheduler_destroy(Scheduler *sched);
+
+#endif // SCHEDULER_H
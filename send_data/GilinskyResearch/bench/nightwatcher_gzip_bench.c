@@ -0,0 +1,125 @@
+/*
+ * Project: NightWatcher
+ * File: nightwatcher_gzip_bench.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * Upload compression benchmark: builds /submit_batch bodies of 10 to 1000 readings in the
+ * format nightwatcher_format_record writes, compresses each with nightwatcher_gzip at
+ * levels 1, 6 and 9, and gunzips the result to check it matches. Reports body sizes and
+ * microseconds per batch for the reused stream the client keeps and, for comparison, a
+ * stream set up and torn down per batch. Exits nonzero if any round trip differs.
+ */
+#include "nightwatcher_gzip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+
+#define BENCH_RECORD_SIZE 1024 // As nightwatcher_client's per-record buffer
+
+static const int batch_sizes[] = { 10, 100, 1000 }; // 1000 is NIGHTWATCHER_MAX_BATCH
+static const int levels[] = { 1, 6, 9 };
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Writes a JSON array of count readings, one minute apart, with slowly varying values.
+ * Returns the body length.
+ */
+static size_t build_batch(char *buf, size_t buf_size, int count) {
+    size_t len = 0;
+    unsigned int seed = 18;
+    buf[len++] = '[';
+    for (int i = 0; i < count; ++i) {
+        if (i) buf[len++] = ',';
+        int n = snprintf(buf + len, buf_size - len,
+            "{\"datetime\":\"2026-10-18 %02d:%02d:00\",\"site_name\":\"%s\",\"latitude\":%.8f,\"longitude\":%.8f,\"mpsqa\":%.4f,\"temperature\":%.2f,\"pressure\":%.2f,\"humidity\":%.2f}",
+            (i / 60) % 24, i % 60, "Sonoita Dark Sky Site", 31.68012345, -110.65432100,
+            21.30 + (rand_r(&seed) % 100) / 1000.0, 48.0 - i / 100.0 + (rand_r(&seed) % 30) / 100.0,
+            23.01 + (rand_r(&seed) % 3) / 100.0, 31.0 + (rand_r(&seed) % 50) / 10.0);
+        if (n < 0 || (size_t)n >= buf_size - len) return 0;
+        len += (size_t)n;
+    }
+    buf[len++] = ']';
+    return len;
+}
+
+/*
+ * Gunzips body and compares it with the original. Returns true if they match.
+ */
+static bool round_trip(const unsigned char *body, size_t body_len, const char *json, size_t json_len, char *out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) return false;
+    zs.next_in = (Bytef *)body;
+    zs.avail_in = (uInt)body_len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = (uInt)json_len + 1;
+    int rc = inflate(&zs, Z_FINISH);
+    bool whole = rc == Z_STREAM_END && zs.avail_in == 0 && zs.total_out == json_len;
+    inflateEnd(&zs);
+    return whole && memcmp(out, json, json_len) == 0;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 200;
+    int c;
+    while ((c = getopt(argc, argv, "n:h")) != -1) {
+        switch (c) {
+        case 'n': iterations = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-n ITERATIONS] (default 200 per batch size and level)\n", argv[0]);
+            return c == 'h' ? 0 : 2;
+        }
+    }
+    if (iterations < 1) return 2;
+
+    size_t buf_size = (size_t)batch_sizes[sizeof(batch_sizes) / sizeof(batch_sizes[0]) - 1] * BENCH_RECORD_SIZE;
+    char *json = malloc(buf_size);
+    char *check = malloc(buf_size + 1);
+    if (!json || !check) return 1;
+    NightWatcherGzip gz;
+    memset(&gz, 0, sizeof(gz));
+    int failures = 0;
+
+    printf("iterations: %d\n", iterations);
+    printf("%8s %6s %9s %9s %7s %11s %11s\n", "readings", "level", "json", "gzip", "ratio", "reused us", "fresh us");
+    for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++b) {
+        size_t json_len = build_batch(json, buf_size, batch_sizes[b]);
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l) {
+            size_t zlen = 0;
+            uint64_t start = now_ns();
+            for (int i = 0; i < iterations; ++i) zlen = nightwatcher_gzip(&gz, json, json_len, levels[l]);
+            double reused_us = (double)(now_ns() - start) / iterations / 1000.0;
+            if (zlen == 0 || !round_trip(gz.buf, zlen, json, json_len, check)) {
+                fprintf(stderr, "%d readings at level %d: gzip round trip failed\n", batch_sizes[b], levels[l]);
+                failures++;
+            }
+
+            // A stream set up for every batch, as a client without a kept stream would do
+            start = now_ns();
+            for (int i = 0; i < iterations; ++i) {
+                NightWatcherGzip fresh;
+                memset(&fresh, 0, sizeof(fresh));
+                if (nightwatcher_gzip(&fresh, json, json_len, levels[l]) != zlen) failures++;
+                nightwatcher_gzip_free(&fresh);
+            }
+            double fresh_us = (double)(now_ns() - start) / iterations / 1000.0;
+            printf("%8d %6d %9zu %9zu %6.1f%% %11.1f %11.1f\n", batch_sizes[b], levels[l], json_len, zlen,
+                   100.0 * zlen / json_len, reused_us, fresh_us);
+        }
+    }
+    nightwatcher_gzip_free(&gz);
+    free(json);
+    free(check);
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -7,11 +7,14 @@
  */
 #include "../../nightwatcher.h"
 #include "nightwatcher_client.h"
+#include "nightwatcher_gzip.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <curl/curl.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 
 
@@ -22,7 +25,7 @@ static void trim(char *str) {
     while (end > str && (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r')) *end-- = '\0';
 }
 
-// Reads url, username, password from gilinskyresearch.conf (key:value format)
+// Reads url, batch_url, username, password from gilinskyresearch.conf (key:value format)
 bool nightwatcher_load_api_config(const char *conf_path, struct nightwatcher_api_config *cfg) {
     if (!conf_path || !cfg) return false;
     FILE *f = fopen(conf_path, "r");
@@ -36,10 +39,19 @@ bool nightwatcher_load_api_config(const char *conf_path, struct nightwatcher_api
         char *val = sep + 1;
         trim(key); trim(val);
         if (strcmp(key, "url") == 0) strncpy(cfg->url, val, sizeof(cfg->url)-1);
+        else if (strcmp(key, "batch_url") == 0) strncpy(cfg->batch_url, val, sizeof(cfg->batch_url)-1);
         else if (strcmp(key, "username") == 0) strncpy(cfg->username, val, sizeof(cfg->username)-1);
         else if (strcmp(key, "password") == 0) strncpy(cfg->password, val, sizeof(cfg->password)-1);
+        else if (strcmp(key, "gzip_level") == 0) cfg->gzip_level = atoi(val);
     }
     fclose(f);
+    if (!cfg->batch_url[0] && cfg->url[0]) {
+        size_t len = strlen(cfg->url);
+        if (len >= 7 && len + 6 < sizeof(cfg->batch_url) && strcmp(cfg->url + len - 7, "/submit") == 0) {
+            memcpy(cfg->batch_url, cfg->url, len);
+            memcpy(cfg->batch_url + len, "_batch", 7);
+        }
+    }
     return (cfg->url[0] && cfg->username[0] && cfg->password[0]);
 }
 
@@ -60,38 +72,93 @@ static size_t write_callback(void *ptr, size_t size, size_t nmemb, void *userdat
     return total;
 }
 
-bool nightwatcher_send_data(const char *url, const char *username, const char *app_password,
-                            const GlobalConfig *site, const SQM_LE_Device *dev, const AW_WeatherData *weather_data,
-                            char *response_buf, size_t response_buf_size) {
-    if (!url || !username || !app_password || !site || !dev || !weather_data) return false;
-    bool result = false;
-    CURL *curl = curl_easy_init();
-    if (!curl) return false;
-
-    // Compose JSON payload
-    char json[1024];
-    // Use site, dev, and weather_data to fill the fields
-    // For datetime, use weather_data->datetime if available, else dev->datetime, else ""
-//    const char *datetime = weather_data->timestamp[0] ? weather_data->timestamp : (dev->datetime[0] ? dev->datetime : "");
+// Copies src into dst as the body of a JSON string, escaping quotes, backslashes and control characters
+static void json_escape(char *dst, size_t dst_size, const char *src) {
+    size_t out = 0;
+    for (; *src && out + 7 < dst_size; ++src) {
+        unsigned char c = (unsigned char)*src;
+        if (c == '"' || c == '\\') {
+            dst[out++] = '\\';
+            dst[out++] = (char)c;
+        } else if (c < 0x20) {
+            out += (size_t)snprintf(dst + out, dst_size - out, "\\u%04x", c);
+        } else {
+            dst[out++] = (char)c;
+        }
+    }
+    dst[out] = '\0';
+}
+
+size_t nightwatcher_format_record(char *buf, size_t buf_size,
+                                  const GlobalConfig *site, const SQM_LE_Device *dev, const AW_WeatherData *weather_data) {
+    if (!buf || !site || !dev || !weather_data) return 0;
     const char *datetime = dev->last_reading_timestamp[0]  ? dev->last_reading_timestamp : "";
-    snprintf(json, sizeof(json),
+    char site_name[sizeof(site->siteName) * 2];
+    json_escape(site_name, sizeof(site_name), site->siteName);
+    int len = snprintf(buf, buf_size,
         "{\"datetime\":\"%s\",\"site_name\":\"%s\",\"latitude\":%.8f,\"longitude\":%.8f,\"mpsqa\":%.4f,\"temperature\":%.2f,\"pressure\":%.2f,\"humidity\":%.2f}",
         datetime,
-        site->siteName,
+        site_name,
         site->latitude,
         site->longitude,
         dev->mpsqa,
         weather_data->temperature_f,
         weather_data->pressure_in,
         weather_data->humidity);
+    if (len < 0 || (size_t)len >= buf_size) return 0;
+    return (size_t)len;
+}
 
-    // Prepare HTTP Basic Auth string
-    char userpass[256];
-    snprintf(userpass, sizeof(userpass), "%s:%s", username, app_password);
+#define NIGHTWATCHER_CONNECTION_MAX_AGE 300L // Seconds an idle connection is kept for the next upload
+#define NIGHTWATCHER_BATCH_TIMEOUT      60L  // A full batch can take a while on a slow uplink
+#define NIGHTWATCHER_RECORD_TIMEOUT     10L
+#define NIGHTWATCHER_GZIP_MIN_BYTES     512  // Smaller bodies are sent as-is; gzip framing would eat the saving
+
+struct NightWatcherClient {
+    pthread_mutex_t lock;
+    char conf_path[256];
+    struct nightwatcher_api_config cfg;
+    bool cfg_ok;                  // cfg holds a complete set of settings
+    struct stat conf_stat;        // Config file as of the last load, to spot edits
+    bool have_stat;
+    CURL *curl;                   // Kept open so uploads reuse the connection and TLS session
+    struct curl_slist *headers;
+    struct curl_slist *gzip_headers; // headers plus Content-Encoding: gzip
+    NightWatcherGzip gz;          // Compressed batch and the deflate stream reused for each
+    bool gzip_refused;            // The server could not read a gzip body; send plain until the config changes
+    char record[1024];            // One record at a time for nightwatcher_client_send_each
+};
 
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+/*
+ * Applies the options shared by every request made on a handle.
+ * Parameters: curl - handle to configure; headers - request headers; userpass - "user:password".
+ */
+static void setup_handle(CURL *curl, struct curl_slist *headers, const char *userpass) {
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_USERPWD, userpass);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, NIGHTWATCHER_CONNECTION_MAX_AGE);
+    curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+}
 
+/*
+ * POSTs a JSON body on a handle prepared by setup_handle.
+ * Parameters:
+ *   curl - handle to use
+ *   url - endpoint
+ *   json, json_len - request body
+ *   timeout - seconds allowed for the whole request
+ *   http_code - receives the HTTP status, or 0 on a transport error (may be NULL)
+ *   response_buf, response_buf_size - optional buffer for the response body
+ * Returns:
+ *   true on a 2xx response, false otherwise
+ */
+static bool perform_post(CURL *curl, const char *url, const char *json, size_t json_len, long timeout,
+                         long *http_code, char *response_buf, size_t response_buf_size) {
+    long code = 0;
     struct response_accumulator acc = {0};
     if (response_buf && response_buf_size > 0) {
         acc.buf = response_buf;
@@ -101,30 +168,174 @@ bool nightwatcher_send_data(const char *url, const char *username, const char *a
     }
 
     curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_USERPWD, userpass);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)json_len);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &acc);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
 
+    uint64_t start = metrics_now();
     CURLcode res = curl_easy_perform(curl);
     if (res == CURLE_OK) {
-        long http_code = 0;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        if (http_code >= 200 && http_code < 300) {
-            result = true;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    }
+    metrics_record(METRIC_API_UPLOAD, start, code >= 200 && code < 300 ? METRIC_OK :
+                   res == CURLE_OPERATION_TIMEDOUT ? METRIC_TIMEOUT : METRIC_FAIL);
+    if (http_code) *http_code = code;
+    return code >= 200 && code < 300;
+}
+
+/*
+ * Posts each object of a JSON array as its own request, stopping at the first failure.
+ * Parameters: as perform_post, plus record/record_size - scratch buffer for one object.
+ * Returns: number of objects sent.
+ */
+static size_t post_each(CURL *curl, const char *url, const char *json, size_t json_len, long *http_code,
+                        char *record, size_t record_size, char *response_buf, size_t response_buf_size) {
+    size_t sent = 0;
+    size_t start = 0;
+    int depth = 0;
+    bool in_string = false;
+    bool escaped = false;
+    // Walk the array, tracking strings so braces inside site names do not end a record
+    for (size_t i = 0; i < json_len; ++i) {
+        char c = json[i];
+        if (in_string) {
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == '"') in_string = false;
+            continue;
+        }
+        if (c == '"') in_string = true;
+        else if (c == '{' && depth++ == 0) start = i;
+        else if (c == '}' && depth > 0 && --depth == 0) {
+            size_t len = i + 1 - start;
+            if (len >= record_size) return sent;
+            memcpy(record, json + start, len);
+            record[len] = '\0';
+            if (!perform_post(curl, url, record, len, NIGHTWATCHER_RECORD_TIMEOUT, http_code, response_buf, response_buf_size)) {
+                return sent;
+            }
+            sent++;
         }
     }
+    return sent;
+}
 
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+NightWatcherClient *nightwatcher_client_create(const char *conf_path) {
+    if (!conf_path) return NULL;
+    NightWatcherClient *client = calloc(1, sizeof(NightWatcherClient));
+    if (!client) return NULL;
+    snprintf(client->conf_path, sizeof(client->conf_path), "%s", conf_path);
+    client->curl = curl_easy_init();
+    client->headers = curl_slist_append(NULL, "Content-Type: application/json");
+    client->gzip_headers = curl_slist_append(NULL, "Content-Type: application/json");
+    if (client->gzip_headers) client->gzip_headers = curl_slist_append(client->gzip_headers, "Content-Encoding: gzip");
+    if (!client->curl || !client->headers || !client->gzip_headers) {
+        if (client->curl) curl_easy_cleanup(client->curl);
+        curl_slist_free_all(client->headers);
+        curl_slist_free_all(client->gzip_headers);
+        free(client);
+        return NULL;
+    }
+    setup_handle(client->curl, client->headers, "");
+    pthread_mutex_init(&client->lock, NULL);
+    return client;
+}
+
+/*
+ * Re-reads the API settings if the config file changed since the last load.
+ * A file that goes missing or becomes incomplete keeps the last good settings.
+ * Caller holds client->lock. Returns true if usable settings are loaded.
+ */
+static bool client_refresh(NightWatcherClient *client) {
+    struct stat st;
+    if (stat(client->conf_path, &st) != 0) {
+        if (!client->cfg_ok) LOGGER_ERROR(LOG_MOD_API, "Failed to load API config %s", client->conf_path);
+        return client->cfg_ok;
+    }
+    if (client->have_stat && st.st_ino == client->conf_stat.st_ino && st.st_size == client->conf_stat.st_size &&
+        st.st_mtim.tv_sec == client->conf_stat.st_mtim.tv_sec && st.st_mtim.tv_nsec == client->conf_stat.st_mtim.tv_nsec) {
+        return client->cfg_ok;
+    }
+    client->conf_stat = st;
+    client->have_stat = true;
+    struct nightwatcher_api_config cfg = {0};
+    if (!nightwatcher_load_api_config(client->conf_path, &cfg)) {
+        LOGGER_WARN(LOG_MOD_API, "Failed to load API config %s%s", client->conf_path, client->cfg_ok ? ", keeping previous settings" : "");
+        return client->cfg_ok;
+    }
+    client->cfg = cfg;
+    client->cfg_ok = true;
+    client->gzip_refused = false;
+    char userpass[256];
+    snprintf(userpass, sizeof(userpass), "%s:%s", cfg.username, cfg.password);
+    curl_easy_setopt(client->curl, CURLOPT_USERPWD, userpass); // libcurl keeps its own copy
+    return true;
+}
+
+bool nightwatcher_client_send_batch(NightWatcherClient *client, const char *json, size_t json_len, long *http_code,
+                                    char *response_buf, size_t response_buf_size) {
+    if (http_code) *http_code = 0;
+    if (!client || !json || json_len == 0) return false;
+    pthread_mutex_lock(&client->lock);
+    bool result = false;
+    if (client_refresh(client) && client->cfg.batch_url[0]) {
+        size_t zlen = 0;
+        bool gzip_400 = false;
+        if (client->cfg.gzip_level > 0 && !client->gzip_refused && json_len >= NIGHTWATCHER_GZIP_MIN_BYTES) {
+            zlen = nightwatcher_gzip(&client->gz, json, json_len, client->cfg.gzip_level);
+        }
+        if (zlen > 0) {
+            long code = 0;
+            curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->gzip_headers);
+            result = perform_post(client->curl, client->cfg.batch_url, (const char *)client->gz.buf, zlen,
+                                  NIGHTWATCHER_BATCH_TIMEOUT, &code, response_buf, response_buf_size);
+            curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, client->headers);
+            if (http_code) *http_code = code;
+            if (code == 415) {
+                LOGGER_WARN(LOG_MOD_API, "NightWatcher API does not accept gzip bodies (HTTP 415), sending uncompressed");
+                client->gzip_refused = true;
+                zlen = 0;
+            } else if (code == 400) {
+                // A plugin that predates gzip support cannot parse the body, but a bad reading
+                // also gets 400; resend uncompressed and let the answer decide which it was
+                gzip_400 = true;
+                zlen = 0;
+            }
+        }
+        if (zlen == 0) {
+            result = perform_post(client->curl, client->cfg.batch_url, json, json_len, NIGHTWATCHER_BATCH_TIMEOUT,
+                                  http_code, response_buf, response_buf_size);
+            if (gzip_400 && result) {
+                LOGGER_WARN(LOG_MOD_API, "NightWatcher API refused a gzip body (HTTP 400) but accepted it uncompressed, sending uncompressed");
+                client->gzip_refused = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
     return result;
 }
 
-// Example usage:
-// struct nightwatcher_api_config cfg = {0};
-// if (nightwatcher_load_api_config("gilinskyresearch.conf", &cfg)) {
-//     nightwatcher_send_data(cfg.url, cfg.username, cfg.password, &data, response, sizeof(response));
-// }
+size_t nightwatcher_client_send_each(NightWatcherClient *client, const char *json, size_t json_len, long *http_code,
+                                     char *response_buf, size_t response_buf_size) {
+    if (http_code) *http_code = 0;
+    if (!client || !json) return 0;
+    pthread_mutex_lock(&client->lock);
+    size_t sent = 0;
+    if (client_refresh(client)) {
+        sent = post_each(client->curl, client->cfg.url, json, json_len, http_code,
+                         client->record, sizeof(client->record), response_buf, response_buf_size);
+    }
+    pthread_mutex_unlock(&client->lock);
+    return sent;
+}
+
+void nightwatcher_client_destroy(NightWatcherClient *client) {
+    if (!client) return;
+    curl_easy_cleanup(client->curl);
+    curl_slist_free_all(client->headers);
+    curl_slist_free_all(client->gzip_headers);
+    nightwatcher_gzip_free(&client->gz);
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+}
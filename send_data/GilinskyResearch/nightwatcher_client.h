@@ -13,10 +13,14 @@
 extern "C" {
 #endif
 
+#define NIGHTWATCHER_MAX_BATCH 1000   // Most readings the /submit_batch endpoint accepts per request
+
 struct nightwatcher_api_config {
     char url[256];
+    char batch_url[256];       // Batch endpoint; defaults to url with "/submit" replaced by "/submit_batch"
     char username[128];
     char password[128];
+    int gzip_level;            // 1-9 compresses batch uploads with gzip; 0 sends plain JSON
 };
 struct nightwatcher_data {
     const char *datetime;      // ISO 8601 string, e.g. "2024-06-01 12:00:00"
@@ -30,20 +34,50 @@ struct nightwatcher_data {
 };
 
 /**
- * Send data to the NightWatcher WordPress API endpoint.
- * @param url The full API endpoint URL (e.g., https://example.com/wp-json/nightwatcher/v1/submit)
- * @param username API username
- * @param app_password API password
- * @param site Pointer to GlobalConfig
- * @param dev Pointer to SQM_LE_Device
- * @param weather_data Pointer to AW_WeatherData
- * @param response_buf Optional buffer to receive response (may be NULL)
- * @param response_buf_size Size of response buffer
- * @return true on success, false on failure
+ * Read the API settings from a key:value file (url, batch_url, username, password).
+ * @return true if url, username and password were all found
+ */
+bool nightwatcher_load_api_config(const char *conf_path, struct nightwatcher_api_config *cfg);
+
+/**
+ * Format one reading as the JSON object accepted by the API.
+ * @return Length of the record, or 0 if it did not fit in the buffer
+ */
+size_t nightwatcher_format_record(char *buf, size_t buf_size,
+                                  const GlobalConfig *site, const SQM_LE_Device *dev, const AW_WeatherData *weather_data);
+
+// A long-lived uploader: cached API settings and one keep-alive connection
+typedef struct NightWatcherClient NightWatcherClient;
+
+/**
+ * Create a client for the settings in conf_path. The file is read on first use and again
+ * only when its modification time, size, or inode changes.
+ * @return The client, or NULL on allocation failure
  */
-bool nightwatcher_send_data(const char *url, const char *username, const char *app_password,
-                            const GlobalConfig *site, const SQM_LE_Device *dev, const AW_WeatherData *weather_data,
-                            char *response_buf, size_t response_buf_size);
+NightWatcherClient *nightwatcher_client_create(const char *conf_path);
+
+/**
+ * Send a JSON array of records to the batch endpoint in one request.
+ * With gzip_level set, bodies of 512 bytes or more go out gzip-compressed. If the server answers
+ * 415, or 400 and then accepts the same batch uncompressed, gzip stays off until the file changes.
+ * @param json The array, json_len bytes long (not NUL terminated)
+ * @param http_code Receives the HTTP status, or 0 if no response arrived (may be NULL)
+ * @return true on a 2xx response; false with *http_code 0 if no settings are loaded
+ */
+bool nightwatcher_client_send_batch(NightWatcherClient *client, const char *json, size_t json_len, long *http_code,
+                                    char *response_buf, size_t response_buf_size);
+
+/**
+ * Send each record of a JSON array to the single-reading endpoint, one request per record.
+ * Used when the server predates /submit_batch. Stops at the first failure.
+ * @param http_code Receives the HTTP status of the last request (may be NULL)
+ * @return Number of records sent before the first failure
+ */
+size_t nightwatcher_client_send_each(NightWatcherClient *client, const char *json, size_t json_len, long *http_code,
+                                     char *response_buf, size_t response_buf_size);
+
+// Close the connection and free the client
+void nightwatcher_client_destroy(NightWatcherClient *client);
 
 #ifdef __cplusplus
 }
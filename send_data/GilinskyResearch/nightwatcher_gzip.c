@@ -0,0 +1,43 @@
+/*
+ * Project: NightWatcher
+ * File: nightwatcher_gzip.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "nightwatcher_gzip.h"
+#include <stdlib.h>
+#include <string.h>
+
+size_t nightwatcher_gzip(NightWatcherGzip *gz, const char *data, size_t len, int level) {
+    if (level > 9) level = 9;
+    if (level < 1) return 0;
+    if (gz->level != level) {
+        if (gz->level) deflateEnd(&gz->zs);
+        gz->level = 0;
+        memset(&gz->zs, 0, sizeof(gz->zs));
+        // windowBits 15 + 16 selects the gzip wrapper; memLevel 8 is zlib's default
+        if (deflateInit2(&gz->zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+        gz->level = level;
+    } else {
+        deflateReset(&gz->zs);
+    }
+    size_t bound = deflateBound(&gz->zs, (uLong)len);
+    if (bound > gz->size) {
+        unsigned char *grown = realloc(gz->buf, bound);
+        if (!grown) return 0;
+        gz->buf = grown;
+        gz->size = bound;
+    }
+    gz->zs.next_in = (Bytef *)data;
+    gz->zs.avail_in = (uInt)len;
+    gz->zs.next_out = gz->buf;
+    gz->zs.avail_out = (uInt)gz->size;
+    if (deflate(&gz->zs, Z_FINISH) != Z_STREAM_END) return 0;
+    return gz->size - gz->zs.avail_out;
+}
+
+void nightwatcher_gzip_free(NightWatcherGzip *gz) {
+    if (gz->level) deflateEnd(&gz->zs);
+    free(gz->buf);
+    memset(gz, 0, sizeof(*gz));
+}
@@ -0,0 +1,30 @@
+/*
+ * Project: NightWatcher
+ * File: nightwatcher_gzip.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef NIGHTWATCHER_GZIP_H
+#define NIGHTWATCHER_GZIP_H
+
+// gzip compression of upload bodies. Needs only zlib, so the benchmark builds without libcurl.
+
+#include <stddef.h>
+#include <zlib.h>
+
+// A deflate stream and output buffer kept between bodies; zero-initialize before first use
+typedef struct {
+    z_stream zs;                  // Reused between bodies with deflateReset
+    int level;                    // Level zs was set up for; 0 when not set up
+    unsigned char *buf;           // Compressed body
+    size_t size;
+} NightWatcherGzip;
+
+// Compresses data into gz->buf as a single gzip member at level 1-9 (higher is clamped to 9).
+// Returns the compressed length, or 0 on error
+size_t nightwatcher_gzip(NightWatcherGzip *gz, const char *data, size_t len, int level);
+
+// Frees the stream and buffer; gz may be reused afterwards
+void nightwatcher_gzip_free(NightWatcherGzip *gz);
+
+#endif // NIGHTWATCHER_GZIP_H
@@ -0,0 +1,150 @@
+/*
+ * Project: NightWatcher
+ * File: site_config.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "nightwatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// A published config and the number of references held on it. cfg comes first so a
+// GlobalConfig pointer handed out is also a pointer to its slot.
+typedef struct {
+    GlobalConfig cfg;
+    unsigned int refs;
+    unsigned int generation; // Set when published; never changes afterwards
+} SiteConfigSlot;
+
+// One setting, compared and copied as raw bytes. Configs are zeroed before read_config
+// fills them and strings are copied with strncpy, so equal settings have equal bytes.
+typedef struct {
+    const char *name;   // Key in nwconf.conf
+    size_t offset;
+    size_t size;
+    unsigned int class; // SITE_CONFIG_*
+} SiteConfigField;
+
+#define FIELD(key, member, class) { key, offsetof(GlobalConfig, member), sizeof(((GlobalConfig *)0)->member), class }
+
+static const SiteConfigField fields[] = {
+    FIELD("siteName",                     siteName,                     SITE_CONFIG_LIVE),
+    FIELD("latitude",                     latitude,                     SITE_CONFIG_LIVE),
+    FIELD("longitude",                    longitude,                    SITE_CONFIG_LIVE),
+    FIELD("elevation",                    elevation,                    SITE_CONFIG_LIVE),
+    FIELD("sqmModel",                     sqmModel,                     SITE_CONFIG_LIVE),
+    FIELD("sqmSerial",                    sqmSerial,                    SITE_CONFIG_LIVE),
+    FIELD("sqmIP",                        sqmIP,                        SITE_CONFIG_DEVICE),
+    FIELD("sqmPort",                      sqmPort,                      SITE_CONFIG_DEVICE),
+    FIELD("dbName",                       dbName,                       SITE_CONFIG_DEVICE),
+    FIELD("readingInterval",              readingInterval,              SITE_CONFIG_SCHEDULE),
+    FIELD("readingIntervalMs",            readingIntervalMs,            SITE_CONFIG_SCHEDULE),
+    FIELD("controlPort",                  controlPort,                  SITE_CONFIG_RESTART),
+    FIELD("sqmHeartbeatInterval",         sqmHeartbeatInterval,         SITE_CONFIG_SCHEDULE),
+    FIELD("sqmReadTimeout",               sqmReadTimeout,               SITE_CONFIG_DEVICE),
+    FIELD("sqmWriteTimeout",              sqmWriteTimeout,              SITE_CONFIG_DEVICE),
+    FIELD("enableReadOnStartup",          enableReadOnStartup,          SITE_CONFIG_LIVE),
+    FIELD("AmbientWeatherAPIKey",         AmbientWeatherAPIKey,         SITE_CONFIG_WEATHER),
+    FIELD("AmbientWeatherAppKey",         AmbientWeatherAppKey,         SITE_CONFIG_WEATHER),
+    FIELD("AmbientWeatherUpdateInterval", AmbientWeatherUpdateInterval, SITE_CONFIG_SCHEDULE),
+    FIELD("AmbientWeatherDeviceMAC",      AmbientWeatherDeviceMAC,      SITE_CONFIG_WEATHER),
+    FIELD("AmbientWeatherURL",            AmbientWeatherURL,            SITE_CONFIG_WEATHER),
+    FIELD("AmbientWeatherTimeout",        AmbientWeatherTimeout,        SITE_CONFIG_WEATHER),
+    FIELD("enableWeather",                enableWeather,                SITE_CONFIG_LIVE),
+    FIELD("enableDataSend",               enableDataSend,               SITE_CONFIG_LIVE),
+    FIELD("sqmDevice",                    devices,                      SITE_CONFIG_DEVICE),
+    FIELD("sqmDevice count",              numDevices,                   SITE_CONFIG_RESTART),
+    FIELD("workerThreads",                workerThreads,                SITE_CONFIG_RESTART),
+    FIELD("dbBatchSize",                  dbBatchSize,                  SITE_CONFIG_RESTART),
+    FIELD("dbFlushInterval",              dbFlushInterval,              SITE_CONFIG_SCHEDULE),
+    FIELD("rrdcachedAddress",             rrdcachedAddress,             SITE_CONFIG_RESTART),
+    FIELD("dbArchives",                   dbArchives,                   SITE_CONFIG_RESTART),
+    FIELD("historySize",                  historySize,                  SITE_CONFIG_RESTART),
+    FIELD("spoolFile",                    spoolFile,                    SITE_CONFIG_RESTART),
+    FIELD("uploadBatchSize",              uploadBatchSize,              SITE_CONFIG_RESTART),
+    FIELD("logTarget",                    logTarget,                    SITE_CONFIG_LOGGER),
+    FIELD("logLevel",                     logLevel,                     SITE_CONFIG_LOGGER),
+    FIELD("logModules",                   logModules,                   SITE_CONFIG_LOGGER),
+};
+// AmbientWeatherEncodedMAC is left out: read_config derives it from AmbientWeatherDeviceMAC
+
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+static SiteConfigSlot *live;
+static unsigned int generations; // Configs published so far
+// Held only to swap the pointer and count references, never across any I/O
+static pthread_mutex_t site_config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+GlobalConfig *site_config_alloc(void) {
+    SiteConfigSlot *slot = calloc(1, sizeof(SiteConfigSlot));
+    return slot ? &slot->cfg : NULL;
+}
+
+void site_config_free(GlobalConfig *cfg) {
+    free(cfg);
+}
+
+void site_config_publish(GlobalConfig *cfg) {
+    SiteConfigSlot *slot = (SiteConfigSlot *)cfg;
+    pthread_mutex_lock(&site_config_lock);
+    SiteConfigSlot *old = live;
+    slot->generation = ++generations;
+    live = slot;
+    bool unused = old && old->refs == 0;
+    pthread_mutex_unlock(&site_config_lock);
+    if (unused) free(old);
+}
+
+GlobalConfig *site_config_acquire(void) {
+    pthread_mutex_lock(&site_config_lock);
+    SiteConfigSlot *slot = live;
+    slot->refs++;
+    pthread_mutex_unlock(&site_config_lock);
+    return &slot->cfg;
+}
+
+unsigned int site_config_generation(const GlobalConfig *cfg) {
+    return ((const SiteConfigSlot *)cfg)->generation;
+}
+
+void site_config_release(GlobalConfig *cfg) {
+    SiteConfigSlot *slot = (SiteConfigSlot *)cfg;
+    pthread_mutex_lock(&site_config_lock);
+    bool unused = --slot->refs == 0 && slot != live;
+    pthread_mutex_unlock(&site_config_lock);
+    if (unused) free(slot);
+}
+
+// Helper: appends a setting name to a comma-separated list
+static void append_name(char *names, size_t names_size, const char *name) {
+    if (!names || names_size == 0) return;
+    size_t len = strlen(names);
+    snprintf(names + len, names_size - len, "%s%s", len ? ", " : "", name);
+}
+
+unsigned int site_config_diff(const GlobalConfig *old, const GlobalConfig *cfg, char *names, size_t names_size) {
+    unsigned int classes = 0;
+    if (names && names_size) names[0] = '\0';
+    for (size_t i = 0; i < FIELD_COUNT; ++i) {
+        const SiteConfigField *f = &fields[i];
+        if (memcmp((const char *)old + f->offset, (const char *)cfg + f->offset, f->size) != 0) {
+            classes |= f->class;
+            append_name(names, names_size, f->name);
+        }
+    }
+    return classes;
+}
+
+void site_config_keep(GlobalConfig *cfg, const GlobalConfig *old, unsigned int classes, char *names, size_t names_size) {
+    if (names && names_size) names[0] = '\0';
+    for (size_t i = 0; i < FIELD_COUNT; ++i) {
+        const SiteConfigField *f = &fields[i];
+        if (!(f->class & classes)) continue;
+        if (memcmp((const char *)old + f->offset, (const char *)cfg + f->offset, f->size) == 0) continue;
+        memcpy((char *)cfg + f->offset, (const char *)old + f->offset, f->size);
+        append_name(names, names_size, f->name);
+    }
+}
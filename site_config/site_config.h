@@ -0,0 +1,54 @@
+/*
+ * Project: NightWatcher
+ * File: site_config.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef SITE_CONFIG_H
+#define SITE_CONFIG_H
+
+#include <stddef.h>
+
+// The live GlobalConfig. A reload builds a complete new copy and swaps the pointer, so a
+// thread never sees a half-updated struct. Each job or control command takes a reference
+// for as long as it uses the config; a replaced copy is freed when its last reference is dropped.
+// A published config is never written; runtime state such as device health lives in the
+// device snapshots (snapshot.h).
+
+// How a setting is applied when a reload changes it
+#define SITE_CONFIG_LIVE     0x01 // Read where it is used, so the new value takes effect at once
+#define SITE_CONFIG_DEVICE   0x02 // Applied to a device link by its next job; reconnects if the address changed
+#define SITE_CONFIG_SCHEDULE 0x04 // Reschedules a periodic task
+#define SITE_CONFIG_WEATHER  0x08 // Reconfigures the weather client before its next request
+#define SITE_CONFIG_LOGGER   0x10 // Passed to logger_configure
+#define SITE_CONFIG_RESTART  0x20 // Only read at startup; the running value is kept until a restart
+
+// Returns a zeroed GlobalConfig that can be published, or NULL if out of memory
+GlobalConfig *site_config_alloc(void);
+
+// Frees a config that was never published
+void site_config_free(GlobalConfig *cfg);
+
+// Makes cfg (from site_config_alloc) the live config. The config it replaces is freed
+// once nobody holds a reference to it.
+void site_config_publish(GlobalConfig *cfg);
+
+// Returns the live config with a reference held. Every call must be paired with site_config_release.
+GlobalConfig *site_config_acquire(void);
+
+// Drops a reference taken by site_config_acquire
+void site_config_release(GlobalConfig *cfg);
+
+// Returns the number a published config was given; each publish gives a larger one.
+// Anything cached from a config can be keyed on it, since a published config never changes.
+unsigned int site_config_generation(const GlobalConfig *cfg);
+
+// Compares two configs setting by setting. Writes the names of the settings that differ to
+// names (comma-separated) and returns the SITE_CONFIG_* classes they belong to, 0 if none differ.
+unsigned int site_config_diff(const GlobalConfig *old, const GlobalConfig *cfg, char *names, size_t names_size);
+
+// Copies every setting of the given classes from old into cfg. names, if not NULL,
+// receives the names of the ones whose values differed.
+void site_config_keep(GlobalConfig *cfg, const GlobalConfig *old, unsigned int classes, char *names, size_t names_size);
+
+#endif // SITE_CONFIG_H
@@ -0,0 +1,122 @@
+/*
+ * Project: NightWatcher
+ * File: snapshot.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "nightwatcher.h"
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+// Each record is guarded by a sequence counter (a seqlock). The writer makes the counter
+// odd, stores the record, then makes it even again; a reader retries if the counter was
+// odd or changed while it copied. The record is copied one 64-bit word at a time with
+// relaxed atomics, so a reader racing a writer gets a stale or retried copy, never
+// undefined behaviour.
+#define SNAPSHOT_WORDS(type) ((sizeof(type) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+#define SNAPSHOT_MAX_WORDS (SNAPSHOT_WORDS(SQM_LE_Device) > SNAPSHOT_WORDS(AW_WeatherData) ? \
+                            SNAPSHOT_WORDS(SQM_LE_Device) : SNAPSHOT_WORDS(AW_WeatherData))
+
+typedef struct {
+    unsigned int seq;
+    uint64_t words[SNAPSHOT_WORDS(SQM_LE_Device)];
+} DeviceSnapshot;
+
+typedef struct {
+    unsigned int seq;
+    uint64_t words[SNAPSHOT_WORDS(AW_WeatherData)];
+} WeatherSnapshot;
+
+static DeviceSnapshot device_snapshots[NW_MAX_DEVICES];
+static WeatherSnapshot weather_snapshot;
+static unsigned int site_version;
+static bool sqm_read; // Periodic SQM readings are on; start/stop state, not a setting
+// Writers are rare (one per reading, heartbeat, or weather poll) and only need to be
+// kept from interleaving with each other; readers never touch this lock.
+static pthread_mutex_t snapshot_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Stores a record under its sequence counter.
+ * Parameters: seq - the record's counter; words - its storage; src/size - the new contents.
+ */
+static void seqlock_write(unsigned int *seq, uint64_t *words, const void *src, size_t size) {
+    uint64_t buf[SNAPSHOT_MAX_WORDS] = {0};
+    size_t nwords = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    memcpy(buf, src, size);
+    pthread_mutex_lock(&snapshot_write_lock);
+    unsigned int s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    __atomic_store_n(seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // Odd counter is visible before any new word
+    for (size_t i = 0; i < nwords; ++i) __atomic_store_n(&words[i], buf[i], __ATOMIC_RELAXED);
+    __atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&snapshot_write_lock);
+}
+
+/*
+ * Copies a record out from under its sequence counter, retrying while a write is in progress.
+ * Parameters: seq - the record's counter; words - its storage; dst/size - where to copy it.
+ * Returns: the (even) counter value the copy was taken at.
+ */
+static unsigned int seqlock_read(const unsigned int *seq, const uint64_t *words, void *dst, size_t size) {
+    uint64_t buf[SNAPSHOT_MAX_WORDS];
+    size_t nwords = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    unsigned int before, after;
+    do {
+        before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (before & 1) continue; // Writer mid-update; it holds the counter odd only for a copy
+        for (size_t i = 0; i < nwords; ++i) buf[i] = __atomic_load_n(&words[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE); // Words are read before the counter is checked again
+        after = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+    memcpy(dst, buf, size);
+    return before;
+}
+
+void snapshot_publish_device(int index, const SQM_LE_Device *dev) {
+    if (index < 0 || index >= NW_MAX_DEVICES) return;
+    DeviceSnapshot *snap = &device_snapshots[index];
+    seqlock_write(&snap->seq, snap->words, dev, sizeof(*dev));
+}
+
+unsigned int snapshot_read_device(int index, SQM_LE_Device *out) {
+    if (index < 0 || index >= NW_MAX_DEVICES) {
+        memset(out, 0, sizeof(*out));
+        return 0;
+    }
+    const DeviceSnapshot *snap = &device_snapshots[index];
+    return seqlock_read(&snap->seq, snap->words, out, sizeof(*out));
+}
+
+unsigned int snapshot_device_version(int index) {
+    if (index < 0 || index >= NW_MAX_DEVICES) return 0;
+    return __atomic_load_n(&device_snapshots[index].seq, __ATOMIC_ACQUIRE);
+}
+
+void snapshot_publish_weather(const AW_WeatherData *data) {
+    seqlock_write(&weather_snapshot.seq, weather_snapshot.words, data, sizeof(*data));
+}
+
+unsigned int snapshot_read_weather(AW_WeatherData *out) {
+    return seqlock_read(&weather_snapshot.seq, weather_snapshot.words, out, sizeof(*out));
+}
+
+unsigned int snapshot_weather_version(void) {
+    return __atomic_load_n(&weather_snapshot.seq, __ATOMIC_ACQUIRE);
+}
+
+void snapshot_site_changed(void) {
+    __atomic_add_fetch(&site_version, 1, __ATOMIC_RELEASE);
+}
+
+unsigned int snapshot_site_version(void) {
+    return __atomic_load_n(&site_version, __ATOMIC_ACQUIRE);
+}
+
+void snapshot_set_sqm_read(bool enabled) {
+    if (__atomic_exchange_n(&sqm_read, enabled, __ATOMIC_ACQ_REL) != enabled) snapshot_site_changed();
+}
+
+bool snapshot_sqm_read(void) {
+    return __atomic_load_n(&sqm_read, __ATOMIC_ACQUIRE);
+}
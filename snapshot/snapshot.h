@@ -0,0 +1,46 @@
+/*
+ * Project: NightWatcher
+ * File: snapshot.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// Published copies of the live device and weather state. The thread that updates a
+// device or the weather publishes a complete copy when it is done; control-port readers
+// take a consistent copy without locking, so they can never stall acquisition and never
+// see fields from two different updates.
+
+// Publishes the state of device index (0 <= index < NW_MAX_DEVICES)
+void snapshot_publish_device(int index, const SQM_LE_Device *dev);
+
+// Copies the last published state of device index into out. Returns the copy's version.
+unsigned int snapshot_read_device(int index, SQM_LE_Device *out);
+
+// Returns the version of device index's snapshot; it changes with every publish
+unsigned int snapshot_device_version(int index);
+
+// Publishes the current weather
+void snapshot_publish_weather(const AW_WeatherData *data);
+
+// Copies the last published weather into out. Returns the copy's version.
+unsigned int snapshot_read_weather(AW_WeatherData *out);
+
+// Returns the version of the weather snapshot; it changes with every publish
+unsigned int snapshot_weather_version(void);
+
+// Records that site-level state shown by dt changed (primary device health, start/stop).
+// A reload needs no call: the new config has a new site_config_generation.
+void snapshot_site_changed(void);
+
+// Returns a counter bumped by every snapshot_site_changed call
+unsigned int snapshot_site_version(void);
+
+// Turns periodic SQM readings on or off (start/stop, enableReadOnStartup)
+void snapshot_set_sqm_read(bool enabled);
+
+// Returns true if periodic SQM readings are on
+bool snapshot_sqm_read(void);
+
+#endif // SNAPSHOT_H
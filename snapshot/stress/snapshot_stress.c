@@ -0,0 +1,222 @@
+/*
+ * Project: NightWatcher
+ * File: snapshot_stress.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * Snapshot stress test: writer threads publish device and weather updates back to back,
+ * the way the reading and weather jobs do, while reader threads take the same pair of
+ * copies command_dt takes for every "dt" (snapshot_read_device then snapshot_read_weather).
+ * Every field of a published update is derived from one counter, so a copy that mixes
+ * two updates is caught. Reports reads per second, torn copies, and the longest publish,
+ * and exits nonzero if any copy was torn or a version went backwards.
+ */
+// main.h declares the daemon's int main(void); rename that declaration so this program can take arguments
+#define main nightwatcher_main
+#include "nightwatcher.h"
+#undef main
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#define STRESS_MAX_DEVICES 16
+#define STRESS_MAX_READERS 64
+#define STRESS_COUNTER_MASK 0xffffff // Counter values stay exact in a float
+
+typedef struct {
+    pthread_t thread;
+    int index;                 // Device index, or -1 for the weather writer
+    uint64_t publishes;
+    uint64_t max_publish_ns;
+} StressWriter;
+
+typedef struct {
+    pthread_t thread;
+    unsigned int seed;
+    uint64_t reads;
+    uint64_t torn;
+    uint64_t backwards;        // A version older than one this reader already saw
+} StressReader;
+
+static int ndevices = 4;
+static unsigned int interval_us = 0;
+static volatile int stop = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Helper: fills a device update in which every field carries k
+static void fill_device(SQM_LE_Device *dev, int index, int k) {
+    memset(dev, 0, sizeof(*dev));
+    snprintf(dev->ip, sizeof(dev->ip), "10.0.%d.%d", index, k & 0xff);
+    dev->port = (uint16_t)(10001 + index);
+    dev->socket_fd = k;
+    dev->sqmModel = index;
+    dev->sqmSerial = k;
+    snprintf(dev->last_reading, sizeof(dev->last_reading), "r, %08d.00m,0000022921Hz,0000000000c,0000000.000s, 027.0C", k);
+    snprintf(dev->last_reading_timestamp, sizeof(dev->last_reading_timestamp), "%d", k);
+    dev->reading_ready = true;
+    dev->healthy = (k & 1) != 0;
+    dev->calibration = (float)k;
+    snprintf(dev->unit_info, sizeof(dev->unit_info), "i,00000004,00000003,00000023,%08d", k);
+    dev->mpsqa = (float)k;
+    dev->sensorFreq = k;
+    dev->sensorPeriodCount = -k;
+    dev->sensorPeriodSecs = (float)k;
+    dev->sensorTemp = (float)-k;
+}
+
+// Helper: returns true if every field of a device copy came from the same update
+static bool device_consistent(const SQM_LE_Device *dev, int index) {
+    int k = dev->sensorFreq;
+    SQM_LE_Device expect;
+    fill_device(&expect, index, k);
+    return strcmp(dev->ip, expect.ip) == 0 && dev->port == expect.port && dev->socket_fd == k &&
+           dev->sqmModel == index && dev->sqmSerial == k &&
+           strcmp(dev->last_reading, expect.last_reading) == 0 &&
+           strcmp(dev->last_reading_timestamp, expect.last_reading_timestamp) == 0 &&
+           dev->healthy == expect.healthy && dev->calibration == expect.calibration &&
+           strcmp(dev->unit_info, expect.unit_info) == 0 && dev->mpsqa == expect.mpsqa &&
+           dev->sensorPeriodCount == -k && dev->sensorPeriodSecs == expect.sensorPeriodSecs &&
+           dev->sensorTemp == expect.sensorTemp;
+}
+
+// Helper: fills a weather update in which every field carries k
+static void fill_weather(AW_WeatherData *data, int k) {
+    memset(data, 0, sizeof(*data));
+    data->temperature_f = k;
+    data->humidity = k + 1;
+    data->wind_speed_mph = k + 2;
+    data->wind_gust_mph = k + 3;
+    data->pressure_in = k + 4;
+    data->rainfall_in = k + 5;
+    snprintf(data->timestamp, sizeof(data->timestamp), "2026-10-18T%08d.000Z", k);
+    data->weatherReady = true;
+}
+
+// Helper: returns true if every field of a weather copy came from the same update
+static bool weather_consistent(const AW_WeatherData *data) {
+    AW_WeatherData expect;
+    fill_weather(&expect, (int)data->temperature_f);
+    return memcmp(data, &expect, sizeof(expect)) == 0;
+}
+
+/*
+ * Writer thread: publishes updates for one device (or the weather) until stopped.
+ */
+static void *writer_main(void *arg) {
+    StressWriter *w = (StressWriter *)arg;
+    SQM_LE_Device dev;
+    AW_WeatherData weather;
+    for (int k = 1; !stop; k = (k + 1) & STRESS_COUNTER_MASK) {
+        if (w->index >= 0) fill_device(&dev, w->index, k);
+        else fill_weather(&weather, k);
+        uint64_t start = now_ns();
+        if (w->index >= 0) snapshot_publish_device(w->index, &dev);
+        else snapshot_publish_weather(&weather);
+        uint64_t elapsed = now_ns() - start;
+        if (elapsed > w->max_publish_ns) w->max_publish_ns = elapsed;
+        w->publishes++;
+        if (interval_us) usleep(interval_us);
+    }
+    return NULL;
+}
+
+/*
+ * Reader thread: takes a device and weather copy, as dt does, and checks both.
+ */
+static void *reader_main(void *arg) {
+    StressReader *r = (StressReader *)arg;
+    unsigned int last_device[STRESS_MAX_DEVICES] = {0};
+    unsigned int last_weather = 0;
+    SQM_LE_Device dev;
+    AW_WeatherData weather;
+    while (!stop) {
+        int index = (int)(rand_r(&r->seed) % (unsigned int)ndevices);
+        unsigned int dv = snapshot_read_device(index, &dev);
+        unsigned int wv = snapshot_read_weather(&weather);
+        r->reads++;
+        // Version 0 is the empty record before the first publish
+        if (dv != 0 && !device_consistent(&dev, index)) r->torn++;
+        if (wv != 0 && !weather_consistent(&weather)) r->torn++;
+        // Counters are compared by difference so wrap-around is not a step back
+        if ((int)(dv - last_device[index]) < 0 || (int)(wv - last_weather) < 0) r->backwards++;
+        last_device[index] = dv;
+        last_weather = wv;
+    }
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -d SECS     duration (default 5)\n"
+        "  -n COUNT    devices, one writer thread each (default 4)\n"
+        "  -r COUNT    reader threads (default 4)\n"
+        "  -i USECS    pause between publishes (default 0, back to back)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int duration = 5;
+    int nreaders = 4;
+    int c;
+    while ((c = getopt(argc, argv, "d:n:r:i:h")) != -1) {
+        switch (c) {
+        case 'd': duration = (unsigned int)atoi(optarg); break;
+        case 'n': ndevices = atoi(optarg); break;
+        case 'r': nreaders = atoi(optarg); break;
+        case 'i': interval_us = (unsigned int)atoi(optarg); break;
+        default: usage(argv[0]); return c == 'h' ? 0 : 2;
+        }
+    }
+    if (ndevices < 1 || ndevices > STRESS_MAX_DEVICES || ndevices > NW_MAX_DEVICES || nreaders < 1 || nreaders > STRESS_MAX_READERS) {
+        fprintf(stderr, "Device count must be 1 to %d and reader count 1 to %d\n", STRESS_MAX_DEVICES, STRESS_MAX_READERS);
+        return 2;
+    }
+
+    StressWriter writers[STRESS_MAX_DEVICES + 1];
+    StressReader readers[STRESS_MAX_READERS];
+    memset(writers, 0, sizeof(writers));
+    memset(readers, 0, sizeof(readers));
+    int nwriters = ndevices + 1;
+    for (int i = 0; i < nwriters; ++i) {
+        writers[i].index = i < ndevices ? i : -1;
+        pthread_create(&writers[i].thread, NULL, writer_main, &writers[i]);
+    }
+    for (int i = 0; i < nreaders; ++i) {
+        readers[i].seed = (unsigned int)i + 1;
+        pthread_create(&readers[i].thread, NULL, reader_main, &readers[i]);
+    }
+    uint64_t start = now_ns();
+    sleep(duration);
+    stop = 1;
+    for (int i = 0; i < nwriters; ++i) pthread_join(writers[i].thread, NULL);
+    for (int i = 0; i < nreaders; ++i) pthread_join(readers[i].thread, NULL);
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    uint64_t publishes = 0, max_publish_ns = 0, reads = 0, torn = 0, backwards = 0;
+    for (int i = 0; i < nwriters; ++i) {
+        publishes += writers[i].publishes;
+        if (writers[i].max_publish_ns > max_publish_ns) max_publish_ns = writers[i].max_publish_ns;
+    }
+    for (int i = 0; i < nreaders; ++i) {
+        reads += readers[i].reads;
+        torn += readers[i].torn;
+        backwards += readers[i].backwards;
+    }
+    printf("devices:     %d (+1 weather writer), %d readers\n", ndevices, nreaders);
+    printf("duration:    %.2f s\n", elapsed);
+    printf("publishes:   %llu (%.0f/s), longest %.1f us\n", (unsigned long long)publishes, publishes / elapsed, max_publish_ns / 1000.0);
+    printf("dt reads:    %llu (%.0f/s)\n", (unsigned long long)reads, reads / elapsed);
+    printf("torn:        %llu\n", (unsigned long long)torn);
+    printf("backwards:   %llu\n", (unsigned long long)backwards);
+    bool pass = torn == 0 && backwards == 0 && reads > 0 && publishes > 0;
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,333 @@
+/*
+ * Project: NightWatcher
+ * File: spool.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#define _GNU_SOURCE
+#include "nightwatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// The spool is an append-only file of newline-terminated JSON records. A small
+// companion file, <spool>.offset, holds the offset of the first record not yet
+// acknowledged by the server, so uploads resume where they stopped after a restart.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;      // Signalled on appends that need a sync, and on shutdown
+    int fd;                   // Spool file, opened O_APPEND
+    int offset_fd;            // Acknowledged offset, rewritten in place
+    off_t end;                // Bytes in the spool file
+    off_t sent;               // Bytes acknowledged by the server
+    unsigned int unsynced;    // Appends since the last fdatasync
+    unsigned int batch_size;
+    bool running;
+    bool stopping;
+    pthread_t thread;
+    SpoolSendFn send;
+    void *ctx;
+    char *read_buf;           // Raw records read back from the file
+    char *batch_buf;          // The same records as a JSON array
+} Spool;
+
+static Spool spool = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .fd = -1, .offset_fd = -1 };
+
+/*
+ * Records the acknowledged offset. The value is written over the old one in place
+ * and synced; a single small pwrite cannot be torn across sectors.
+ */
+static void spool_save_offset(off_t offset) {
+    char text[24];
+    int len = snprintf(text, sizeof(text), "%020lld\n", (long long)offset);
+    if (pwrite(spool.offset_fd, text, (size_t)len, 0) != len) {
+        LOGGER_ERROR(LOG_MOD_API, "spool offset: %s", strerror(errno));
+        return;
+    }
+    fdatasync(spool.offset_fd);
+}
+
+/*
+ * Drops a partial record left at the end of the file by a crash mid-append.
+ * Returns the length of the file up to and including its last newline.
+ */
+static off_t spool_trim_partial(int fd, off_t size) {
+    char buf[4096];
+    off_t pos = size;
+    while (pos > 0) {
+        size_t chunk = pos > (off_t)sizeof(buf) ? sizeof(buf) : (size_t)pos;
+        if (pread(fd, buf, chunk, pos - (off_t)chunk) != (ssize_t)chunk) break;
+        for (size_t i = chunk; i > 0; --i) {
+            if (buf[i - 1] == '\n') {
+                off_t keep = pos - (off_t)chunk + (off_t)i;
+                if (keep != size && ftruncate(fd, keep) != 0) LOGGER_ERROR(LOG_MOD_API, "spool truncate: %s", strerror(errno));
+                return keep;
+            }
+        }
+        pos -= (off_t)chunk;
+    }
+    if (size > 0 && ftruncate(fd, 0) != 0) LOGGER_ERROR(LOG_MOD_API, "spool truncate: %s", strerror(errno));
+    return 0;
+}
+
+int spool_open(const char *path, unsigned int batch_size) {
+    if (!path || !path[0]) path = SPOOL_DEFAULT_FILE;
+    char offset_path[512];
+    snprintf(offset_path, sizeof(offset_path), "%s.offset", path);
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOGGER_ERROR(LOG_MOD_API, "spool open: %s", strerror(errno));
+        return -1;
+    }
+    int offset_fd = open(offset_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (offset_fd < 0) {
+        LOGGER_ERROR(LOG_MOD_API, "spool offset open: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    spool.read_buf = malloc(SPOOL_MAX_BATCH_BYTES);
+    spool.batch_buf = malloc(SPOOL_MAX_BATCH_BYTES + 2);
+    if (!spool.read_buf || !spool.batch_buf) {
+        free(spool.read_buf);
+        free(spool.batch_buf);
+        close(offset_fd);
+        close(fd);
+        return -1;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    char text[32] = {0};
+    off_t sent = 0;
+    if (pread(offset_fd, text, sizeof(text) - 1, 0) > 0) sent = (off_t)strtoll(text, NULL, 10);
+
+    pthread_mutex_lock(&spool.lock);
+    spool.fd = fd;
+    spool.offset_fd = offset_fd;
+    spool.end = spool_trim_partial(fd, st.st_size);
+    // An offset past the end means the file was emptied but the new offset never saved
+    spool.sent = (sent >= 0 && sent <= spool.end) ? sent : 0;
+    spool.batch_size = batch_size ? batch_size : SPOOL_DEFAULT_BATCH;
+    metrics_gauge_set(METRIC_GAUGE_SPOOL_PENDING, (int64_t)(spool.end - spool.sent));
+    pthread_mutex_unlock(&spool.lock);
+    if (spool.end > spool.sent) {
+        LOGGER_INFO(LOG_MOD_API, "Spool: resuming with %lld bytes waiting to upload", (long long)(spool.end - spool.sent));
+    }
+    return 0;
+}
+
+int spool_append(const char *record, size_t len) {
+    if (len == 0 || len + 1 > SPOOL_MAX_BATCH_BYTES) return -1;
+    char line[4096];
+    const char *out = record;
+    // One write per record, so concurrent appends never interleave
+    if (len < sizeof(line)) {
+        memcpy(line, record, len);
+        line[len] = '\n';
+        out = line;
+    }
+    pthread_mutex_lock(&spool.lock);
+    if (spool.fd < 0) {
+        pthread_mutex_unlock(&spool.lock);
+        return -1;
+    }
+    ssize_t n;
+    if (out == line) {
+        n = write(spool.fd, line, len + 1);
+    } else {
+        n = write(spool.fd, record, len);
+        if (n == (ssize_t)len) n += write(spool.fd, "\n", 1);
+    }
+    if (n != (ssize_t)(len + 1)) {
+        LOGGER_ERROR(LOG_MOD_API, "spool write: %s", strerror(errno));
+        // Drop whatever part of the record made it, so the file stays line aligned
+        if (n > 0 && ftruncate(spool.fd, spool.end) != 0) LOGGER_ERROR(LOG_MOD_API, "spool truncate: %s", strerror(errno));
+        pthread_mutex_unlock(&spool.lock);
+        return -1;
+    }
+    spool.end += n;
+    metrics_gauge_add(METRIC_GAUGE_SPOOL_PENDING, (int64_t)n);
+    if (++spool.unsynced >= SPOOL_SYNC_RECORDS) pthread_cond_signal(&spool.wake);
+    pthread_mutex_unlock(&spool.lock);
+    return 0;
+}
+
+/*
+ * Reads up to batch_size whole records starting at the acknowledged offset and joins
+ * them into a JSON array in batch_buf.
+ * Returns the number of records, with the array length in *len and the bytes of the
+ * file they cover in *consumed, or -1 if the file could not be read. 0 records with
+ * nothing consumed means the first record does not fit in one upload.
+ */
+static ssize_t spool_read_batch(off_t from, off_t end, size_t *len, size_t *consumed) {
+    size_t want = (size_t)(end - from);
+    if (want > SPOOL_MAX_BATCH_BYTES) want = SPOOL_MAX_BATCH_BYTES;
+    ssize_t got;
+    do {
+        got = pread(spool.fd, spool.read_buf, want, from);
+    } while (got < 0 && errno == EINTR);
+    *len = 0;
+    *consumed = 0;
+    if (got <= 0) {
+        LOGGER_ERROR(LOG_MOD_API, "spool read: %s", got < 0 ? strerror(errno) : "file is shorter than expected");
+        return -1;
+    }
+    ssize_t count = 0;
+    size_t pos = 0;
+    size_t out = 0;
+    spool.batch_buf[out++] = '[';
+    while (pos < (size_t)got && (size_t)count < spool.batch_size) {
+        char *nl = memchr(spool.read_buf + pos, '\n', (size_t)got - pos);
+        if (!nl) break;
+        size_t rec_len = (size_t)(nl - (spool.read_buf + pos));
+        if (rec_len > 0) {
+            if (count > 0) spool.batch_buf[out++] = ',';
+            memcpy(spool.batch_buf + out, spool.read_buf + pos, rec_len);
+            out += rec_len;
+            count++;
+        }
+        pos += rec_len + 1;
+    }
+    spool.batch_buf[out++] = ']';
+    *len = out;
+    *consumed = pos;
+    return count;
+}
+
+/*
+ * Finds the end of the record at from, for skipping one that is too large to upload.
+ * Returns the record's length including its newline, or -1 if the file could not be read.
+ */
+static ssize_t spool_record_length(off_t from, off_t end) {
+    off_t pos = from;
+    while (pos < end) {
+        size_t chunk = (size_t)(end - pos) < SPOOL_MAX_BATCH_BYTES ? (size_t)(end - pos) : SPOOL_MAX_BATCH_BYTES;
+        ssize_t got = pread(spool.fd, spool.read_buf, chunk, pos);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return -1;
+        char *nl = memchr(spool.read_buf, '\n', (size_t)got);
+        if (nl) return (ssize_t)(pos - from) + (nl - spool.read_buf) + 1;
+        pos += got;
+    }
+    return (ssize_t)(end - from);
+}
+
+/*
+ * Uploader thread: keeps the spool synced to disk and sends batches oldest first.
+ * A failed upload or a failed read of the spool is retried after a delay that doubles
+ * up to SPOOL_BACKOFF_MAX. A record too large to upload is skipped on its own.
+ */
+static void *spool_uploader(void *arg) {
+    (void)arg;
+    unsigned int backoff = 0;
+    time_t retry_at = 0;
+    pthread_mutex_lock(&spool.lock);
+    while (!spool.stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += SPOOL_SYNC_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (long)(SPOOL_SYNC_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (spool.unsynced < SPOOL_SYNC_RECORDS) pthread_cond_timedwait(&spool.wake, &spool.lock, &deadline);
+        if (spool.stopping) break;
+
+        if (spool.unsynced > 0) {
+            spool.unsynced = 0;
+            pthread_mutex_unlock(&spool.lock);
+            fdatasync(spool.fd);
+            pthread_mutex_lock(&spool.lock);
+        }
+        // Send batches until the spool is empty, an upload fails, or we are asked to stop
+        while (!spool.stopping && spool.sent < spool.end && time(NULL) >= retry_at) {
+            off_t from = spool.sent;
+            off_t end = spool.end;
+            pthread_mutex_unlock(&spool.lock);
+
+            size_t len, consumed;
+            ssize_t count = spool_read_batch(from, end, &len, &consumed);
+            SpoolResult result = SPOOL_SENT;
+            if (count > 0) {
+                result = spool.send(spool.batch_buf, len, (size_t)count, spool.ctx);
+            } else if (count == 0 && consumed == 0) {
+                ssize_t record_len = spool_record_length(from, end);
+                if (record_len > 0) {
+                    LOGGER_WARN(LOG_MOD_API, "Spool: skipping a %zd byte record, too large to upload", record_len);
+                    consumed = (size_t)record_len;
+                } else {
+                    count = -1;
+                }
+            }
+            if (count < 0) result = SPOOL_RETRY; // The records are still on disk; read them again later
+
+            pthread_mutex_lock(&spool.lock);
+            if (result == SPOOL_RETRY) {
+                backoff = backoff ? backoff * 2 : SPOOL_BACKOFF_MIN;
+                if (backoff > SPOOL_BACKOFF_MAX) backoff = SPOOL_BACKOFF_MAX;
+                retry_at = time(NULL) + backoff;
+                LOGGER_WARN(LOG_MOD_API, "Spool: %s failed, retrying in %u s", count < 0 ? "read" : "upload", backoff);
+                break;
+            }
+            if (result == SPOOL_REJECTED) LOGGER_WARN(LOG_MOD_API, "Spool: server rejected %zd records, dropping them", count);
+            backoff = 0;
+            spool.sent = from + (off_t)consumed;
+            if (spool.sent == spool.end) {
+                // Everything is acknowledged: start the file over. Truncate before saving
+                // the offset, so a crash in between can only cause a reset, not a resend.
+                if (ftruncate(spool.fd, 0) == 0) {
+                    spool.end = 0;
+                    spool.sent = 0;
+                }
+            }
+            metrics_gauge_set(METRIC_GAUGE_SPOOL_PENDING, (int64_t)(spool.end - spool.sent));
+            spool_save_offset(spool.sent);
+        }
+    }
+    pthread_mutex_unlock(&spool.lock);
+    fdatasync(spool.fd);
+    return NULL;
+}
+
+int spool_start_uploader(SpoolSendFn send, void *ctx) {
+    pthread_mutex_lock(&spool.lock);
+    if (spool.fd < 0 || spool.running) {
+        pthread_mutex_unlock(&spool.lock);
+        return -1;
+    }
+    spool.send = send;
+    spool.ctx = ctx;
+    spool.stopping = false;
+    if (pthread_create(&spool.thread, NULL, spool_uploader, NULL) != 0) {
+        pthread_mutex_unlock(&spool.lock);
+        return -1;
+    }
+    spool.running = true;
+    pthread_mutex_unlock(&spool.lock);
+    return 0;
+}
+
+void spool_close(void) {
+    pthread_mutex_lock(&spool.lock);
+    bool running = spool.running;
+    spool.stopping = true;
+    pthread_cond_signal(&spool.wake);
+    pthread_mutex_unlock(&spool.lock);
+    if (running) pthread_join(spool.thread, NULL);
+    pthread_mutex_lock(&spool.lock);
+    spool.running = false;
+    if (spool.fd >= 0) {
+        fdatasync(spool.fd);
+        close(spool.fd);
+        close(spool.offset_fd);
+        spool.fd = spool.offset_fd = -1;
+    }
+    pthread_mutex_unlock(&spool.lock);
+}
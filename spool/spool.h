@@ -0,0 +1,45 @@
+/*
+ * Project: NightWatcher
+ * File: spool.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stddef.h>
+
+#define SPOOL_DEFAULT_FILE       "./nightwatcher.spool"
+#define SPOOL_DEFAULT_BATCH      100          // Records per upload when uploadBatchSize is not set
+#define SPOOL_MAX_BATCH_BYTES    (256 * 1024) // Largest JSON array sent in one upload
+#define SPOOL_SYNC_RECORDS       32           // Appends that trigger an early fdatasync
+#define SPOOL_SYNC_INTERVAL_MS   1000         // Longest time an append waits to reach the disk
+#define SPOOL_BACKOFF_MIN        1            // Seconds before the first retry of a failed upload
+#define SPOOL_BACKOFF_MAX        300          // Longest wait between retries
+
+// Result of one upload attempt
+typedef enum {
+    SPOOL_SENT,      // Batch accepted; it is removed from the spool
+    SPOOL_RETRY,     // Temporary failure (network, server error); retried with backoff
+    SPOOL_REJECTED   // Batch refused for good; it is dropped so later records can go out
+} SpoolResult;
+
+// Uploads one batch: json is a JSON array of count records, len bytes long
+typedef SpoolResult (*SpoolSendFn)(const char *json, size_t len, size_t count, void *ctx);
+
+// Opens (or creates) the spool file and resumes from the last acknowledged record.
+// batch_size is the most records per upload. Returns 0 on success, -1 on error.
+int spool_open(const char *path, unsigned int batch_size);
+
+// Appends one record (a JSON object, no newline). Only writes to the page cache; the
+// uploader thread makes it durable. Safe to call from any thread. Returns 0 or -1.
+int spool_append(const char *record, size_t len);
+
+// Starts the background thread that syncs the file and uploads batches with send.
+// Returns 0 on success, -1 on error.
+int spool_start_uploader(SpoolSendFn send, void *ctx);
+
+// Stops the uploader and syncs the file; call before exiting
+void spool_close(void);
+
+#endif // SPOOL_H
@@ -0,0 +1,182 @@
+/*
+ * Project: NightWatcher
+ * File: sqm_le_bench.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * SQM-LE protocol benchmark: drives getReading and getUnitInformation against SQM-LE devices
+ * (normally sqm_le_sim) as fast as each link allows, one thread per device, and reports
+ * throughput, errors, and latency percentiles.
+ */
+// main.h declares the daemon's int main(void); rename that declaration so this program can take arguments
+#define main nightwatcher_main
+#include "nightwatcher.h"
+#undef main
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#define BENCH_MAX_DEVICES 1024
+#define BENCH_MAX_SAMPLES (1024 * 1024) // Latencies kept per thread; later calls are still counted
+
+typedef enum { BENCH_READING, BENCH_UNIT_INFO, BENCH_BOTH } BenchMode;
+
+// One device's thread and results
+typedef struct {
+    pthread_t thread;
+    SQM_LE_Device dev;
+    uint64_t calls;
+    uint64_t ok;
+    uint64_t timeouts;
+    uint64_t io_errors;
+    uint64_t other_errors;
+    uint64_t bad_responses;     // Answered, but the response did not parse
+    uint64_t *samples;          // Latency of each call in nanoseconds
+    size_t nsamples;
+} BenchWorker;
+
+static BenchMode mode = BENCH_READING;
+static uint64_t deadline_ns;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Worker thread: issues commands back to back until the deadline.
+ */
+static void *bench_main(void *arg) {
+    BenchWorker *w = (BenchWorker *)arg;
+    while (1) {
+        uint64_t start = now_ns();
+        if (start >= deadline_ns) break;
+        bool reading = mode == BENCH_READING || (mode == BENCH_BOTH && (w->calls & 1) == 0);
+        int ret = reading ? getReading(&w->dev) : getUnitInformation(&w->dev);
+        uint64_t elapsed = now_ns() - start;
+        if (ret == -4) {
+            // Reconnects are backing off and nothing was sent, so it is not a round trip
+            usleep(1000);
+            continue;
+        }
+        w->calls++;
+        if (ret == 0 && w->dev.healthy) w->ok++;
+        else if (ret == 0) w->bad_responses++;
+        else if (ret == SQM_LE_ERR_TIMEOUT) w->timeouts++;
+        else if (ret == SQM_LE_ERR_IO) w->io_errors++;
+        else w->other_errors++;
+        if (w->nsamples < BENCH_MAX_SAMPLES) w->samples[w->nsamples++] = elapsed;
+    }
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -a ADDRESS  device address (default 127.0.0.1)\n"
+        "  -p PORT     first device's port; device i is at PORT+i (default 10001)\n"
+        "  -n COUNT    number of devices, one thread each (default 1)\n"
+        "  -d SECS     duration (default 10)\n"
+        "  -c CMD      rx, ix, or both (default rx)\n"
+        "  -t MS       read and write timeout (default 1000)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *address = "127.0.0.1";
+    int port = 10001, ndevices = 1;
+    unsigned int duration = 10, timeout_ms = 1000;
+    int c;
+    while ((c = getopt(argc, argv, "a:p:n:d:c:t:h")) != -1) {
+        switch (c) {
+        case 'a': address = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'n': ndevices = atoi(optarg); break;
+        case 'd': duration = (unsigned int)atoi(optarg); break;
+        case 't': timeout_ms = (unsigned int)atoi(optarg); break;
+        case 'c':
+            if (strcmp(optarg, "rx") == 0) mode = BENCH_READING;
+            else if (strcmp(optarg, "ix") == 0) mode = BENCH_UNIT_INFO;
+            else if (strcmp(optarg, "both") == 0) mode = BENCH_BOTH;
+            else {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        default: usage(argv[0]); return c == 'h' ? 0 : 2;
+        }
+    }
+    if (ndevices < 1 || ndevices > BENCH_MAX_DEVICES) {
+        fprintf(stderr, "Device count must be 1 to %d\n", BENCH_MAX_DEVICES);
+        return 2;
+    }
+
+    BenchWorker *workers = calloc((size_t)ndevices, sizeof(BenchWorker));
+    if (!workers) return 1;
+    for (int i = 0; i < ndevices; ++i) {
+        BenchWorker *w = &workers[i];
+        strncpy(w->dev.ip, address, sizeof(w->dev.ip) - 1);
+        w->dev.port = (uint16_t)(port + i);
+        w->dev.read_timeout_ms = timeout_ms;
+        w->dev.write_timeout_ms = timeout_ms;
+        sqm_le_init(&w->dev);
+        w->samples = malloc(BENCH_MAX_SAMPLES * sizeof(uint64_t));
+        if (!w->samples) return 1;
+    }
+    uint64_t start = now_ns();
+    deadline_ns = start + (uint64_t)duration * 1000000000ULL;
+    for (int i = 0; i < ndevices; ++i) pthread_create(&workers[i].thread, NULL, bench_main, &workers[i]);
+    for (int i = 0; i < ndevices; ++i) pthread_join(workers[i].thread, NULL);
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    // Merge every thread's samples for the overall percentiles
+    BenchWorker total = {0};
+    size_t all = 0;
+    for (int i = 0; i < ndevices; ++i) all += workers[i].nsamples;
+    uint64_t *samples = malloc((all ? all : 1) * sizeof(uint64_t));
+    if (!samples) return 1;
+    for (int i = 0; i < ndevices; ++i) {
+        BenchWorker *w = &workers[i];
+        memcpy(samples + total.nsamples, w->samples, w->nsamples * sizeof(uint64_t));
+        total.nsamples += w->nsamples;
+        total.calls += w->calls;
+        total.ok += w->ok;
+        total.timeouts += w->timeouts;
+        total.io_errors += w->io_errors;
+        total.other_errors += w->other_errors;
+        total.bad_responses += w->bad_responses;
+        sqm_le_close(&w->dev);
+    }
+    qsort(samples, total.nsamples, sizeof(uint64_t), compare_u64);
+
+    printf("command:     %s\n", mode == BENCH_READING ? "rx (getReading)" : mode == BENCH_UNIT_INFO ? "ix (getUnitInformation)" : "rx + ix");
+    printf("devices:     %d\n", ndevices);
+    printf("duration:    %.2f s\n", elapsed);
+    printf("calls:       %llu (%.0f/s)\n", (unsigned long long)total.calls, total.calls / elapsed);
+    printf("ok:          %llu\n", (unsigned long long)total.ok);
+    printf("errors:      %llu timeout, %llu io, %llu other, %llu bad response\n",
+           (unsigned long long)total.timeouts, (unsigned long long)total.io_errors,
+           (unsigned long long)total.other_errors, (unsigned long long)total.bad_responses);
+    if (total.nsamples > 0) {
+        static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+        static const char *names[] = { "p50", "p90", "p99", "p99.9" };
+        printf("latency us: ");
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q) {
+            size_t index = (size_t)(quantiles[q] * (double)(total.nsamples - 1));
+            printf(" %s %.1f", names[q], samples[index] / 1000.0);
+        }
+        printf("  max %.1f\n", samples[total.nsamples - 1] / 1000.0);
+    }
+    free(samples);
+    for (int i = 0; i < ndevices; ++i) free(workers[i].samples);
+    free(workers);
+    return total.ok > 0 ? 0 : 1;
+}
@@ -0,0 +1,483 @@
+/*
+ * Project: NightWatcher
+ * File: sqm_le_sim.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * SQM-LE simulator: serves any number of simulated photometers, one per TCP port, from a
+ * single epoll loop so sqm-le/ can be tested and benchmarked without hardware. It answers
+ * the commands sqm_le.c sends (rx, ix, cx, and the binary calibration and settings commands)
+ * with responses of the same length as the device's, and can add latency, jitter, segmented
+ * writes, dropped connections, unanswered commands, and garbage frames.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define SIM_MAX_DEVICES    1024
+#define SIM_MAX_EVENTS     64
+#define SIM_MAX_FRAMES     8     // Responses queued per connection
+#define SIM_FRAME_SIZE     64
+#define SIM_READING_SIZE   56    // rx response, as read by getReading
+#define SIM_UNIT_INFO_SIZE 38    // ix response, as read by getUnitInformation
+#define SIM_SERIAL_SIZE    32    // 0x02 response, as read by getReadingSerialNumber
+
+// Command line settings
+typedef struct {
+    const char *address;
+    uint16_t port;              // First device's port; device i listens on port + i
+    int devices;
+    unsigned int latency_ms;    // Delay before each response
+    unsigned int jitter_ms;     // Latency varies uniformly by up to this much either way
+    unsigned int segment_size;  // Write responses in pieces of this many bytes (0 = whole)
+    unsigned int segment_gap_ms; // Pause between pieces
+    double drop_rate;           // Fraction of commands answered by closing the connection
+    double noreply_rate;        // Fraction of commands never answered
+    double garbage_rate;        // Fraction of responses replaced with random bytes
+    unsigned int seed;
+    unsigned int report_secs;   // Print counters this often (0 = only at exit)
+} SimOptions;
+
+// One simulated photometer
+typedef struct {
+    int model;
+    int serial;
+    uint64_t readings;          // rx commands answered, drives the simulated sky
+    float light_offset;         // Set by the 0x07 light calibration command
+    float light_temp;
+    float dark_period;
+    float dark_temp;
+    float calibration;          // Returned by the 0x03 command
+} SimDevice;
+
+typedef struct {
+    char data[SIM_FRAME_SIZE];
+    size_t len;
+    size_t sent;
+    int64_t due_ms;             // Earliest time the next byte may be sent
+} SimFrame;
+
+// One client connection, or a device's listening socket
+typedef struct {
+    int fd;
+    bool listening;
+    SimDevice *dev;
+    char text[16];              // ASCII command being received (ends with 'x')
+    size_t text_len;
+    unsigned int arg_needed;    // Argument bytes still to come for a binary command
+    unsigned char arg_cmd;
+    unsigned char arg[4];
+    SimFrame frames[SIM_MAX_FRAMES];
+    int nframes;
+} SimConn;
+
+// Counters printed by report()
+static struct {
+    uint64_t commands, responses, bytes, drops, noreplies, garbage, unknown, accepted;
+} stats;
+
+static SimOptions opt = {
+    .address = "127.0.0.1", .port = 10001, .devices = 1, .segment_gap_ms = 1, .seed = 1
+};
+static SimDevice *devices;
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int signum) {
+    (void)signum;
+    stop_requested = 1;
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Helper: true with the given probability
+static bool chance(double rate) {
+    return rate > 0 && (double)rand() / RAND_MAX < rate;
+}
+
+static void report(void) {
+    fprintf(stderr, "sqm_le_sim: %llu connections, %llu commands, %llu responses (%llu bytes), "
+            "%llu dropped, %llu unanswered, %llu garbage, %llu unknown bytes\n",
+            (unsigned long long)stats.accepted, (unsigned long long)stats.commands,
+            (unsigned long long)stats.responses, (unsigned long long)stats.bytes,
+            (unsigned long long)stats.drops, (unsigned long long)stats.noreplies,
+            (unsigned long long)stats.garbage, (unsigned long long)stats.unknown);
+}
+
+/*
+ * Builds the device's reading as 56 bytes: "r, mm.mmm,ffffffffffHz,ccccccccccc,ppppppp.ppps, ttt.tC\r".
+ * The sky darkens and brightens slowly and the temperature drifts with it, so successive
+ * readings differ and each device's values are distinct.
+ */
+static size_t format_reading(SimDevice *dev, char *buf) {
+    uint64_t n = dev->readings++;
+    double phase = (double)(n % 600) / 600.0;
+    double mpsqa = 17.0 + 4.0 * (phase < 0.5 ? phase * 2 : (1 - phase) * 2) + dev->light_offset;
+    double temp = 12.0 + 8.0 * phase + (dev->serial % 7);
+    int freq = (int)(100000.0 / (mpsqa * mpsqa));
+    char line[SIM_FRAME_SIZE];
+    snprintf(line, sizeof(line), "r, %05.2fm,%010dHz,%010dc,%011.3fs, %05.1fC\r",
+             mpsqa, freq, 0, 0.0, temp);
+    memset(buf, ' ', SIM_READING_SIZE);
+    memcpy(buf, line, strlen(line) < SIM_READING_SIZE ? strlen(line) : SIM_READING_SIZE);
+    buf[SIM_READING_SIZE - 1] = '\r';
+    return SIM_READING_SIZE;
+}
+
+// Builds unit information as 38 bytes: "i,protocol,model,feature,serial\r"
+static size_t format_unit_info(SimDevice *dev, char *buf) {
+    char line[SIM_FRAME_SIZE];
+    snprintf(line, sizeof(line), "i,%08d,%08d,%08d,%08d\r", 4, dev->model, 23, dev->serial);
+    memcpy(buf, line, SIM_UNIT_INFO_SIZE);
+    return SIM_UNIT_INFO_SIZE;
+}
+
+// Builds calibration information: "c,light offset m,dark period s,light temp C,offset m,dark temp C\r"
+static size_t format_calibration(SimDevice *dev, char *buf) {
+    return (size_t)snprintf(buf, SIM_FRAME_SIZE, "c,%011.2fm,%011.3fs, %05.1fC,%011.2fm, %05.1fC\r",
+                            17.60 + dev->light_offset, dev->dark_period, dev->light_temp,
+                            8.71, dev->dark_temp);
+}
+
+// Helper: number of argument bytes that follow a binary command byte
+static unsigned int binary_arg_size(unsigned char cmd) {
+    return (cmd >= 0x07 && cmd <= 0x0A) || (cmd >= 0x0D && cmd <= 0x10) ? 4 : 0;
+}
+
+static void conn_close(int epfd, SimConn *conn) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn);
+}
+
+// Helper: queues a response, applying the latency and fault settings. Returns -1 to drop the connection.
+static int queue_response(SimConn *conn, const char *data, size_t len) {
+    stats.commands++;
+    if (chance(opt.drop_rate)) {
+        stats.drops++;
+        return -1;
+    }
+    if (chance(opt.noreply_rate)) {
+        stats.noreplies++;
+        return 0;
+    }
+    if (len == 0) return 0;
+    if (conn->nframes == SIM_MAX_FRAMES) return -1; // Client is pipelining far more than the device would allow
+    SimFrame *frame = &conn->frames[conn->nframes++];
+    memcpy(frame->data, data, len);
+    frame->len = len;
+    frame->sent = 0;
+    if (chance(opt.garbage_rate)) {
+        stats.garbage++;
+        for (size_t i = 0; i < len; ++i) frame->data[i] = (char)(rand() & 0xff);
+    }
+    int64_t delay = opt.latency_ms;
+    if (opt.jitter_ms) delay += rand() % (2 * (int64_t)opt.jitter_ms + 1) - opt.jitter_ms;
+    // Responses leave in order, so one never overtakes a slower one queued before it
+    int64_t due = now_ms() + (delay > 0 ? delay : 0);
+    if (conn->nframes > 1 && conn->frames[conn->nframes - 2].due_ms > due) due = conn->frames[conn->nframes - 2].due_ms;
+    frame->due_ms = due;
+    return 0;
+}
+
+// Helper: applies a complete binary command. Returns -1 to drop the connection.
+static int run_binary(SimConn *conn, unsigned char cmd, const unsigned char *arg) {
+    SimDevice *dev = conn->dev;
+    char resp[SIM_FRAME_SIZE];
+    float value = 0;
+    memcpy(&value, arg, sizeof(value));
+    switch (cmd) {
+    case 0x02:
+        memset(resp, 0, SIM_SERIAL_SIZE);
+        snprintf(resp, SIM_SERIAL_SIZE, "%08d", dev->serial);
+        return queue_response(conn, resp, SIM_SERIAL_SIZE);
+    case 0x03:
+        memcpy(resp, &dev->calibration, sizeof(float));
+        return queue_response(conn, resp, sizeof(float));
+    case 0x07: dev->light_offset = value; break;
+    case 0x08: dev->light_temp = value; break;
+    case 0x09: {
+        int period;
+        memcpy(&period, arg, sizeof(period));
+        dev->dark_period = (float)period;
+        break;
+    }
+    case 0x0A: dev->dark_temp = value; break;
+    case 0x0B: dev->readings = 0; break; // Reset
+    default: break; // Arm calibration, period and threshold settings, and the rest have no visible effect
+    }
+    return queue_response(conn, NULL, 0);
+}
+
+// Helper: applies a complete ASCII command. Returns -1 to drop the connection.
+static int run_text(SimConn *conn) {
+    char resp[SIM_FRAME_SIZE];
+    conn->text[conn->text_len] = '\0';
+    size_t len;
+    if (strcmp(conn->text, "rx") == 0) len = format_reading(conn->dev, resp);
+    else if (strcmp(conn->text, "ix") == 0) len = format_unit_info(conn->dev, resp);
+    else if (strcmp(conn->text, "cx") == 0) len = format_calibration(conn->dev, resp);
+    else {
+        stats.unknown += conn->text_len;
+        return 0; // The device ignores commands it does not know
+    }
+    return queue_response(conn, resp, len);
+}
+
+/*
+ * Splits received bytes into commands. ASCII commands end with 'x'; bytes 0x02 to 0x13 are
+ * binary commands, some followed by a 4-byte argument. sqm_le.c sends commands with no line
+ * ending, and 0x0A and 0x0D are binary commands, so only spaces are ignored.
+ * Returns: 0, or -1 to drop the connection.
+ */
+static int conn_parse(SimConn *conn, const unsigned char *buf, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = buf[i];
+        if (conn->arg_needed > 0) {
+            conn->arg[4 - conn->arg_needed] = c;
+            if (--conn->arg_needed == 0 && run_binary(conn, conn->arg_cmd, conn->arg) != 0) return -1;
+        } else if (c >= 0x02 && c <= 0x13 && conn->text_len == 0) {
+            conn->arg_cmd = c;
+            conn->arg_needed = binary_arg_size(c);
+            memset(conn->arg, 0, sizeof(conn->arg));
+            if (conn->arg_needed == 0 && run_binary(conn, c, conn->arg) != 0) return -1;
+        } else if (c == ' ') {
+            continue;
+        } else {
+            if (conn->text_len < sizeof(conn->text) - 1) conn->text[conn->text_len++] = (char)c;
+            if (c == 'x') {
+                if (run_text(conn) != 0) return -1;
+                conn->text_len = 0;
+            } else if (conn->text_len == sizeof(conn->text) - 1) {
+                stats.unknown += conn->text_len;
+                conn->text_len = 0;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Sends whatever queued responses are due, one segment at a time when segmented writes are on.
+ * Returns: 0, or -1 if the connection failed.
+ */
+static int conn_flush(SimConn *conn, int64_t now) {
+    while (conn->nframes > 0) {
+        SimFrame *frame = &conn->frames[0];
+        if (frame->due_ms > now) return 0;
+        size_t chunk = frame->len - frame->sent;
+        if (opt.segment_size && chunk > opt.segment_size) chunk = opt.segment_size;
+        ssize_t n = send(conn->fd, frame->data + frame->sent, chunk, MSG_NOSIGNAL);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        frame->sent += (size_t)n;
+        stats.bytes += (uint64_t)n;
+        if (frame->sent < frame->len) {
+            if (opt.segment_size) frame->due_ms = now + opt.segment_gap_ms;
+            continue;
+        }
+        stats.responses++;
+        memmove(&conn->frames[0], &conn->frames[1], (size_t)(conn->nframes - 1) * sizeof(SimFrame));
+        conn->nframes--;
+    }
+    return 0;
+}
+
+// Helper: opens device i's listening socket
+static int open_listener(int i) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)(opt.port + i)) };
+    if (inet_pton(AF_INET, opt.address, &addr.sin_addr) != 1 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -a ADDRESS  address to listen on (default 127.0.0.1)\n"
+        "  -p PORT     first device's port; device i listens on PORT+i (default 10001)\n"
+        "  -n COUNT    number of simulated devices (default 1)\n"
+        "  -l MS       response latency (default 0)\n"
+        "  -j MS       latency jitter, uniform +/- (default 0)\n"
+        "  -s BYTES    write responses in segments of this size (default: whole)\n"
+        "  -g MS       pause between segments (default 1)\n"
+        "  -d RATE     fraction of commands answered by dropping the connection\n"
+        "  -N RATE     fraction of commands never answered\n"
+        "  -G RATE     fraction of responses replaced by random bytes\n"
+        "  -r SEED     random seed (default 1)\n"
+        "  -i SECS     print counters every SECS seconds\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int c;
+    while ((c = getopt(argc, argv, "a:p:n:l:j:s:g:d:N:G:r:i:h")) != -1) {
+        switch (c) {
+        case 'a': opt.address = optarg; break;
+        case 'p': opt.port = (uint16_t)atoi(optarg); break;
+        case 'n': opt.devices = atoi(optarg); break;
+        case 'l': opt.latency_ms = (unsigned int)atoi(optarg); break;
+        case 'j': opt.jitter_ms = (unsigned int)atoi(optarg); break;
+        case 's': opt.segment_size = (unsigned int)atoi(optarg); break;
+        case 'g': opt.segment_gap_ms = (unsigned int)atoi(optarg); break;
+        case 'd': opt.drop_rate = atof(optarg); break;
+        case 'N': opt.noreply_rate = atof(optarg); break;
+        case 'G': opt.garbage_rate = atof(optarg); break;
+        case 'r': opt.seed = (unsigned int)atoi(optarg); break;
+        case 'i': opt.report_secs = (unsigned int)atoi(optarg); break;
+        default: usage(argv[0]); return c == 'h' ? 0 : 2;
+        }
+    }
+    if (opt.devices < 1 || opt.devices > SIM_MAX_DEVICES) {
+        fprintf(stderr, "Device count must be 1 to %d\n", SIM_MAX_DEVICES);
+        return 2;
+    }
+    srand(opt.seed);
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    devices = calloc((size_t)opt.devices, sizeof(SimDevice));
+    if (epfd < 0 || !devices) {
+        perror("sqm_le_sim");
+        return 1;
+    }
+    for (int i = 0; i < opt.devices; ++i) {
+        SimDevice *dev = &devices[i];
+        dev->model = 3;
+        dev->serial = 2142 + i;
+        dev->calibration = 19.3f;
+        dev->dark_period = 300.0f;
+        dev->light_temp = dev->dark_temp = 20.0f;
+        SimConn *listener = calloc(1, sizeof(SimConn));
+        int fd = open_listener(i);
+        if (!listener || fd < 0) {
+            fprintf(stderr, "sqm_le_sim: cannot listen on %s:%d: %s\n", opt.address, opt.port + i, strerror(errno));
+            return 1;
+        }
+        listener->fd = fd;
+        listener->listening = true;
+        listener->dev = dev;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = listener };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    fprintf(stderr, "sqm_le_sim: %d device(s) on %s:%d-%d\n", opt.devices, opt.address, opt.port, opt.port + opt.devices - 1);
+
+    // Connections with responses waiting to be sent, so the loop knows how long it may sleep
+    SimConn **waiting = NULL;
+    size_t nwaiting = 0, waiting_cap = 0;
+    int64_t next_report = opt.report_secs ? now_ms() + opt.report_secs * 1000 : 0;
+    struct epoll_event events[SIM_MAX_EVENTS];
+
+    while (!stop_requested) {
+        int64_t now = now_ms();
+        int timeout = -1;
+        for (size_t i = 0; i < nwaiting; ++i) {
+            int64_t wait = waiting[i]->frames[0].due_ms - now;
+            if (wait < 0) wait = 0;
+            if (timeout < 0 || wait < timeout) timeout = (int)wait;
+        }
+        if (next_report && (timeout < 0 || next_report - now < timeout)) timeout = next_report - now > 0 ? (int)(next_report - now) : 0;
+        int n = epoll_wait(epfd, events, SIM_MAX_EVENTS, timeout);
+        if (n < 0 && errno != EINTR) break;
+        for (int e = 0; e < n; ++e) {
+            SimConn *conn = events[e].data.ptr;
+            if (conn->listening) {
+                int fd;
+                while ((fd = accept4(conn->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    SimDevice *dev = conn->dev;
+                    SimConn *client = calloc(1, sizeof(SimConn));
+                    if (!client) {
+                        close(fd);
+                        continue;
+                    }
+                    int on = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                    client->fd = fd;
+                    client->dev = dev;
+                    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = client };
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+                    stats.accepted++;
+                }
+                continue;
+            }
+            unsigned char buf[512];
+            bool dead = false;
+            while (1) {
+                ssize_t r = recv(conn->fd, buf, sizeof(buf), 0);
+                if (r > 0) {
+                    if (conn_parse(conn, buf, (size_t)r) != 0) {
+                        dead = true;
+                        break;
+                    }
+                    continue;
+                }
+                if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) dead = true;
+                if (r < 0 && errno == EINTR) continue;
+                break;
+            }
+            if (!dead && conn_flush(conn, now_ms()) != 0) dead = true;
+            // Forget it from the waiting list; it is re-added below if it still has output
+            for (size_t i = 0; i < nwaiting; ++i) {
+                if (waiting[i] == conn) {
+                    waiting[i] = waiting[--nwaiting];
+                    break;
+                }
+            }
+            if (dead) {
+                conn_close(epfd, conn);
+                continue;
+            }
+            if (conn->nframes > 0) {
+                if (nwaiting == waiting_cap) {
+                    waiting_cap = waiting_cap ? waiting_cap * 2 : 64;
+                    waiting = realloc(waiting, waiting_cap * sizeof(SimConn *));
+                }
+                waiting[nwaiting++] = conn;
+            }
+        }
+        now = now_ms();
+        for (size_t i = 0; i < nwaiting;) {
+            SimConn *conn = waiting[i];
+            if (conn->frames[0].due_ms <= now) {
+                if (conn_flush(conn, now) != 0) {
+                    waiting[i] = waiting[--nwaiting];
+                    conn_close(epfd, conn);
+                    continue;
+                }
+                if (conn->nframes == 0) {
+                    waiting[i] = waiting[--nwaiting];
+                    continue;
+                }
+            }
+            i++;
+        }
+        if (next_report && now >= next_report) {
+            report();
+            next_report = now + opt.report_secs * 1000;
+        }
+    }
+    report();
+    return 0;
+}
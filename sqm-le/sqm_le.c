@@ -10,20 +10,97 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
 
 /*
- * Establishes a TCP connection to the SQM-LE device using the IP and port in the dev struct.
+ * Initializes the connection state of a device. Must be called once before any command is sent.
+ */
+void sqm_le_init(SQM_LE_Device *dev) {
+    pthread_mutex_init(&dev->lock, NULL);
+    dev->socket_fd = -1;
+    dev->reconnect_delay = 0;
+    dev->next_connect_time = 0;
+    if (dev->read_timeout_ms == 0) dev->read_timeout_ms = SQM_LE_DEFAULT_TIMEOUT_MS;
+    if (dev->write_timeout_ms == 0) dev->write_timeout_ms = SQM_LE_DEFAULT_TIMEOUT_MS;
+}
+
+/*
+ * Returns: the current CLOCK_MONOTONIC time in milliseconds.
+ */
+static int64_t sqm_le_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Waits until the socket is ready for the given poll events or the deadline passes.
+ * Returns: 0 if ready, SQM_LE_ERR_TIMEOUT on timeout, SQM_LE_ERR_IO on error.
+ */
+static int sqm_le_wait(int fd, short events, int64_t deadline_ms) {
+    while (1) {
+        int64_t remaining = deadline_ms - sqm_le_now_ms();
+        if (remaining <= 0) return SQM_LE_ERR_TIMEOUT;
+        struct pollfd pfd = { .fd = fd, .events = events, .revents = 0 };
+        int n = poll(&pfd, 1, (int)remaining);
+        if (n > 0) return (pfd.revents & (POLLERR | POLLNVAL)) ? SQM_LE_ERR_IO : 0;
+        if (n == 0) return SQM_LE_ERR_TIMEOUT;
+        if (errno != EINTR) return SQM_LE_ERR_IO;
+    }
+}
+
+/*
+ * Enables TCP keepalive on the device socket so a link that silently died
+ * (device power cycle, cable pulled) is detected even while idle.
+ */
+static void sqm_le_set_keepalive(int fd) {
+    int on = 1;
+    int idle = SQM_LE_KEEPALIVE_IDLE;
+    int interval = SQM_LE_KEEPALIVE_INTERVAL;
+    int count = SQM_LE_KEEPALIVE_COUNT;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+/*
+ * Establishes a non-blocking TCP connection to the SQM-LE device using the IP and port in
+ * the dev struct. The connect is bounded by dev->write_timeout_ms.
  * Returns: 0 on success, negative value on error.
  */
 static int sqm_le_connect(SQM_LE_Device *dev) {
     struct sockaddr_in addr;
-    dev->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (dev->socket_fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_port = htons(dev->port);
     if (inet_pton(AF_INET, dev->ip, &addr.sin_addr) <= 0) return -2;
-    if (connect(dev->socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) return -3;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            close(fd);
+            return -3;
+        }
+        int ret = sqm_le_wait(fd, POLLOUT, sqm_le_now_ms() + dev->write_timeout_ms);
+        int err = 0;
+        socklen_t errlen = sizeof(err);
+        if (ret == 0 && (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0 || err != 0)) ret = -3;
+        if (ret != 0) {
+            close(fd);
+            return ret;
+        }
+    }
+    sqm_le_set_keepalive(fd);
+    dev->socket_fd = fd;
     return 0;
 }
 
@@ -36,31 +113,175 @@ static void sqm_le_disconnect(SQM_LE_Device *dev) {
 }
 
 /*
- * Sends bytes to the SQM-LE device and receives a response.
- * Returns: 0 on success, negative value on error.
+ * Closes the persistent connection to the device, if open.
  */
-static int sqm_le_sendrecv(SQM_LE_Device *dev, const void *sendbuf, size_t sendlen, void *recvbuf, size_t recvlen) {
-    if (sqm_le_connect(dev) != 0) return -1;
-    if (write(dev->socket_fd, sendbuf, sendlen) != (ssize_t)sendlen) {
-        sqm_le_disconnect(dev);
-        return -2;
+void sqm_le_close(SQM_LE_Device *dev) {
+    pthread_mutex_lock(&dev->lock);
+    sqm_le_disconnect(dev);
+    pthread_mutex_unlock(&dev->lock);
+}
+
+/*
+ * Points the device at a new address. The open connection, if any, is closed and the
+ * reconnect backoff cleared, so the next command connects to the new address at once.
+ */
+void sqm_le_set_address(SQM_LE_Device *dev, const char *ip, uint16_t port) {
+    pthread_mutex_lock(&dev->lock);
+    sqm_le_disconnect(dev);
+    memset(dev->ip, 0, sizeof(dev->ip));
+    strncpy(dev->ip, ip, sizeof(dev->ip) - 1);
+    dev->port = port;
+    dev->reconnect_delay = 0;
+    dev->next_connect_time = 0;
+    pthread_mutex_unlock(&dev->lock);
+}
+
+/*
+ * Makes sure the persistent connection is open, reconnecting if needed. After a failed
+ * attempt further attempts are held off with exponential backoff, from
+ * SQM_LE_RECONNECT_MIN up to SQM_LE_RECONNECT_MAX seconds.
+ * Returns: 0 if connected, negative value on error or while backing off.
+ */
+static int sqm_le_ensure_connected(SQM_LE_Device *dev) {
+    if (dev->socket_fd >= 0) return 0;
+    time_t now = time(NULL);
+    if (now < dev->next_connect_time) return -4;
+    int ret = sqm_le_connect(dev);
+    if (ret != 0) {
+        if (dev->reconnect_delay == 0) dev->reconnect_delay = SQM_LE_RECONNECT_MIN;
+        else if (dev->reconnect_delay < SQM_LE_RECONNECT_MAX) dev->reconnect_delay *= 2;
+        if (dev->reconnect_delay > SQM_LE_RECONNECT_MAX) dev->reconnect_delay = SQM_LE_RECONNECT_MAX;
+        dev->next_connect_time = now + dev->reconnect_delay;
+        return ret;
     }
-    if (read(dev->socket_fd, recvbuf, recvlen) != (ssize_t)recvlen) {
-        sqm_le_disconnect(dev);
-        return -3;
+    dev->reconnect_delay = 0;
+    dev->next_connect_time = 0;
+    return 0;
+}
+
+/*
+ * Discards anything already waiting on the socket, such as the late reply to a command
+ * that was abandoned, so it is not mistaken for the response to the next command.
+ * Returns: 0 if the link is still open, -1 if the device closed it.
+ */
+static int sqm_le_drain(SQM_LE_Device *dev) {
+    char scratch[128];
+    while (1) {
+        ssize_t n = recv(dev->socket_fd, scratch, sizeof(scratch), MSG_DONTWAIT);
+        if (n > 0) continue;
+        if (n == 0) return -1;
+        if (errno == EINTR) continue;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+}
+
+/*
+ * Writes the whole buffer to the socket before the deadline.
+ * Returns: 0 on success, SQM_LE_ERR_TIMEOUT or SQM_LE_ERR_IO on failure.
+ */
+static int sqm_le_write_all(int fd, const void *buf, size_t len, int64_t deadline_ms) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n > 0) {
+            p += n;
+            len -= (size_t)n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            int ret = sqm_le_wait(fd, POLLOUT, deadline_ms);
+            if (ret != 0) return ret;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return SQM_LE_ERR_IO;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Reads exactly len bytes from the socket before the deadline. Responses may arrive split
+ * across several TCP segments, so partial reads are accumulated rather than treated as errors.
+ * *received counts the bytes read, including those of a response that then failed.
+ * Returns: 0 on success, SQM_LE_ERR_TIMEOUT or SQM_LE_ERR_IO on failure.
+ */
+static int sqm_le_read_full(int fd, void *buf, size_t len, int64_t deadline_ms, size_t *received) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n > 0) {
+            p += n;
+            len -= (size_t)n;
+            *received += (size_t)n;
+        } else if (n == 0) {
+            return SQM_LE_ERR_IO; // Device closed the connection
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            int ret = sqm_le_wait(fd, POLLIN, deadline_ms);
+            if (ret != 0) return ret;
+        } else if (errno != EINTR) {
+            return SQM_LE_ERR_IO;
+        }
     }
-    sqm_le_disconnect(dev);
     return 0;
 }
 
+/*
+ * Sends one command on the open connection and reads its response, honoring the
+ * device's write and read timeouts. *received counts the response bytes that arrived.
+ * Returns: 0 on success, -5 if the device had closed the link before the command was sent,
+ *          or SQM_LE_ERR_TIMEOUT / SQM_LE_ERR_IO.
+ */
+static int sqm_le_transact(SQM_LE_Device *dev, const void *sendbuf, size_t sendlen, void *recvbuf, size_t recvlen,
+                           size_t *received) {
+    *received = 0;
+    if (sqm_le_drain(dev) != 0) return -5;
+    int ret = sqm_le_write_all(dev->socket_fd, sendbuf, sendlen, sqm_le_now_ms() + dev->write_timeout_ms);
+    if (ret != 0) return ret;
+    if (recvlen > 0) ret = sqm_le_read_full(dev->socket_fd, recvbuf, recvlen, sqm_le_now_ms() + dev->read_timeout_ms, received);
+    return ret;
+}
+
+/*
+ * Sends bytes to the SQM-LE device and receives a response over the persistent connection.
+ * Commands from all threads are serialized on dev->lock. A connection that was already open
+ * may have been dropped by the device while idle; if the command fails on one the way a dropped
+ * link does (closed or reset before any response byte arrived), the link is reopened and the
+ * command sent once more. A timeout or a partial response is never retried: a slow device holds
+ * dev->lock for one read timeout at most, and a command the device may have acted on (reset,
+ * calibration arming) is not sent to it twice. A failed command also drops the link, so a late
+ * reply can never be read as the response to a later command.
+ * Returns: 0 on success, negative value on error (SQM_LE_ERR_TIMEOUT if the device did not answer in time).
+ */
+static int sqm_le_sendrecv(SQM_LE_Device *dev, const void *sendbuf, size_t sendlen, void *recvbuf, size_t recvlen) {
+    pthread_mutex_lock(&dev->lock);
+    uint64_t start = metrics_now();
+    bool reused = dev->socket_fd >= 0;
+    size_t received = 0;
+    int ret = sqm_le_ensure_connected(dev);
+    if (ret == 0) {
+        ret = sqm_le_transact(dev, sendbuf, sendlen, recvbuf, recvlen, &received);
+        if (ret != 0) {
+            sqm_le_disconnect(dev);
+            bool dropped = ret == -5 || (ret == SQM_LE_ERR_IO && received == 0);
+            if (reused && dropped && sqm_le_ensure_connected(dev) == 0) {
+                ret = sqm_le_transact(dev, sendbuf, sendlen, recvbuf, recvlen, &received);
+                if (ret != 0) sqm_le_disconnect(dev);
+            }
+        }
+    }
+    // -4 means reconnects are backing off and nothing was sent
+    if (ret != -4) metrics_record(METRIC_SQM_ROUNDTRIP, start, ret == 0 ? METRIC_OK : ret == SQM_LE_ERR_TIMEOUT ? METRIC_TIMEOUT : METRIC_FAIL);
+    pthread_mutex_unlock(&dev->lock);
+    return ret;
+}
+
 /*
  * Gets a reading from the SQM-LE device, parses the response, and updates the dev struct.
- * Sets site->sqmHealthy to true if successful.
+ * Sets dev->healthy to true if successful.
  * Returns: 0 on success, negative value on error.
  */
-int getReading(SQM_LE_Device *dev, GlobalConfig *site) {
-    if (site) site->sqmHealthy = false;
-    if (dev) dev->reading_ready = false;
+int getReading(SQM_LE_Device *dev) {
+    dev->healthy = false;
+    dev->reading_ready = false;
     uint8_t cmd[] = {'r', 'x'}; // Send ASCII "rx"
     uint8_t resp[56];
     int ret = sqm_le_sendrecv(dev, cmd, sizeof(cmd), resp, sizeof(resp));
@@ -85,8 +306,8 @@ int getReading(SQM_LE_Device *dev, GlobalConfig *site) {
             dev->sensorPeriodCount = atoi(fields[3]);
             dev->sensorPeriodSecs = strtof(fields[4], NULL);
             dev->sensorTemp = strtof(fields[5], NULL);
-            if (site) site->sqmHealthy = true;
-            if (dev) dev->reading_ready = true;
+            dev->healthy = true;
+            dev->reading_ready = true;
         }
     }
     return ret;
@@ -121,16 +342,12 @@ int getCalibration(SQM_LE_Device *dev) {
 }
 
 /*
- * Gets unit information from the SQM-LE device and updates the dev struct.
- * Returns: 0 on success, negative value on error.
- */
-/*
- * Gets unit information from the SQM-LE device, parses the response, and updates the dev struct and site struct.
- * Sends 'ix', receives 38 bytes, parses into 5 fields, and populates site->sqmModel and site->sqmSerial.
+ * Gets unit information from the SQM-LE device, parses the response, and updates the dev struct.
+ * Sends 'ix', receives 38 bytes, parses into 5 fields, and populates dev->sqmModel and dev->sqmSerial.
  * Returns: 0 on success, negative value on error.
  */
-int getUnitInformation(SQM_LE_Device *dev, GlobalConfig *site) {
-    if (site) site->sqmHealthy = false;
+int getUnitInformation(SQM_LE_Device *dev) {
+    dev->healthy = false;
     uint8_t cmd[] = {'i', 'x'};
     char resp[38];
     int ret = sqm_le_sendrecv(dev, cmd, sizeof(cmd), resp, sizeof(resp));
@@ -143,15 +360,11 @@ int getUnitInformation(SQM_LE_Device *dev, GlobalConfig *site) {
         char field_bufs[5][16];
         char *fields[5] = { field_bufs[0], field_bufs[1], field_bufs[2], field_bufs[3], field_bufs[4] };
         int nfields = parse_fields(dev->unit_info, ',', fields, 5, 16);
-        if (nfields == 5 && site) {
-            site->sqmModel = atoi(fields[1]);
-            dev->sqmModel = site->sqmModel;
-            site->sqmSerial = atoi(fields[3]);
-            dev->sqmSerial = site->sqmSerial;
-            site->sqmHealthy = true;
-            printf("sqmModel: %d\n", site->sqmModel);
-            printf("sqmSerial: %d\n", site->sqmSerial);
-            printf("Reading Ready: %s\n", dev->reading_ready ? "true" : "false");
+        if (nfields == 5) {
+            dev->sqmModel = atoi(fields[1]);
+            dev->sqmSerial = atoi(fields[3]);
+            dev->healthy = true;
+            LOGGER_DEBUG(LOG_MOD_SQM, "%s: model %d, serial %d", dev->ip, dev->sqmModel, dev->sqmSerial);
         }
     }
     return ret;
@@ -3,14 +3,33 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <time.h>
+#include <pthread.h>
 
 #define SQM_LE_IP_MAXLEN 64
 
+// Persistent connection management
+#define SQM_LE_RECONNECT_MIN       1   // First reconnect backoff in seconds
+#define SQM_LE_RECONNECT_MAX       60  // Longest reconnect backoff in seconds
+#define SQM_LE_KEEPALIVE_IDLE      30  // Seconds idle before the first keepalive probe
+#define SQM_LE_KEEPALIVE_INTERVAL  10  // Seconds between keepalive probes
+#define SQM_LE_KEEPALIVE_COUNT     3   // Unanswered probes before the link is declared dead
+#define SQM_LE_DEFAULT_TIMEOUT_MS  5000 // Used when no read/write timeout is configured
+
+// Error codes returned by the protocol layer (other negative values are connection setup errors)
+#define SQM_LE_ERR_IO       -7  // Socket error or connection closed by the device
+#define SQM_LE_ERR_TIMEOUT  -6  // Device did not answer before the deadline
+
 // Structure to hold SQM-LE device state and connection info
 typedef struct {
     char ip[SQM_LE_IP_MAXLEN]; // Device IP address
     uint16_t port;             // Device port
-    int socket_fd;             // Socket file descriptor
+    int socket_fd;             // Socket file descriptor, kept open between commands
+    pthread_mutex_t lock;      // Serializes commands from all threads on the one link
+    unsigned int reconnect_delay; // Current reconnect backoff in seconds (0 = none)
+    time_t next_connect_time;  // Earliest time the next reconnect may be attempted
+    unsigned int read_timeout_ms;  // Deadline for a complete response (site.sqmReadTimeout)
+    unsigned int write_timeout_ms; // Deadline for connect and send (site.sqmWriteTimeout)
     // Device-specific variables (add as needed)
     // char serial_number[32];
     int sqmModel;
@@ -18,6 +37,7 @@ typedef struct {
     char last_reading[64];
     char last_reading_timestamp[32]; 
     bool reading_ready;
+    bool healthy;              // Last heartbeat or reading succeeded
     float calibration;
     char unit_info[64];
     // Add more fields as needed for calibration, settings, etc.
@@ -30,10 +50,13 @@ typedef struct {
 } SQM_LE_Device;
 
 // Function declarations
-int getReading(SQM_LE_Device *dev, GlobalConfig *site);
+void sqm_le_init(SQM_LE_Device *dev);
+void sqm_le_close(SQM_LE_Device *dev);
+void sqm_le_set_address(SQM_LE_Device *dev, const char *ip, uint16_t port);
+int getReading(SQM_LE_Device *dev);
 int getReadingSerialNumber(SQM_LE_Device *dev);
 int getCalibration(SQM_LE_Device *dev);
-int getUnitInformation(SQM_LE_Device *dev, GlobalConfig *site);
+int getUnitInformation(SQM_LE_Device *dev);
 int armLightCalibration(SQM_LE_Device *dev);
 int armDarkCalibration(SQM_LE_Device *dev);
 int setLightCalilbrationOffset(SQM_LE_Device *dev, float offset);
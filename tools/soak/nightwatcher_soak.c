@@ -0,0 +1,862 @@
+/*
+ * Project: NightWatcher
+ * File: nightwatcher_soak.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * End-to-end load and soak harness. Starts nightwatcher in a scratch directory against
+ * sqm_le_sim, a local stand-in for the AmbientWeather /v1/devices endpoint, and a local
+ * stand-in for the NightWatcher /submit endpoint, then drives the control port with many
+ * concurrent session clients. Every report interval it prints readings, uploads, weather
+ * requests, and control-port queries per second, control-port latency percentiles, and the
+ * daemon's RSS, open fds, and threads; at the end it flags stalls, fd and thread growth,
+ * crashes, and slow shutdowns, and exits nonzero if any were seen.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+
+#define SOAK_MAX_CLIENTS    1024
+#define SOAK_MAX_DEVICES    16       // MAX_SQM_DEVICES in the daemon
+#define SOAK_FRAME_MAX      (256 * 1024)
+#define SOAK_HTTP_MAX       (4 * 1024 * 1024)
+#define SOAK_HIST_SUB_BITS  3        // 8 buckets per power of two, so percentiles are within 12.5%
+#define SOAK_HIST_BUCKETS   (64 << SOAK_HIST_SUB_BITS)
+#define SOAK_FD_SLACK       4        // fds and threads allowed above the baseline before it is a leak
+#define SOAK_THREAD_SLACK   2
+#define SOAK_SHUTDOWN_LIMIT 10       // Seconds the daemon may take to exit on SIGTERM
+
+// Control-port latency in microseconds, log-linear buckets
+typedef struct {
+    uint64_t counts[SOAK_HIST_BUCKETS];
+    uint64_t total;
+} SoakHist;
+
+// Totals shared by every thread; read and reset by the reporter
+typedef struct {
+    uint64_t readings;          // Reading events pushed to the subscriber
+    uint64_t ctl_responses;     // Control-port commands answered
+    uint64_t ctl_errors;        // Commands that failed, timed out, or lost their connection
+    uint64_t ctl_reconnects;
+    uint64_t weather_requests;  // Requests answered by the weather stand-in
+    uint64_t upload_requests;   // Requests answered by the upload stand-in
+    uint64_t uploaded;          // Records acknowledged by the upload stand-in
+    uint64_t upload_bytes;      // Upload bodies as sent, before gunzip
+    uint64_t http_errors;       // Requests the stand-ins could not parse or decode
+    uint64_t interval_max_us;   // Slowest control-port command since the last report
+} SoakCounters;
+
+// Sampled from /proc/<pid>
+typedef struct {
+    long rss_kb;
+    int fds;
+    int threads;
+} ProcSample;
+
+typedef enum { MOCK_WEATHER, MOCK_UPLOAD } MockKind;
+
+typedef struct {
+    int listen_fd;
+    MockKind kind;
+} MockServer;
+
+typedef struct {
+    int fd;
+    MockKind kind;
+} MockConn;
+
+// Buffered reader for control-port frames
+typedef struct {
+    int fd;
+    char buf[64 * 1024];
+    size_t start;
+    size_t end;
+} FrameReader;
+
+static SoakCounters counters;
+static SoakHist hist;
+static volatile int stop_clients = 0;
+static uint16_t control_port;
+
+// Commands the control clients cycle through; each client starts at a different offset
+static const char *command_mix[] = {
+    "status", "dt", "dt bin", "devices", "db last 10", "metrics", "show", "dt 0",
+};
+#define COMMAND_MIX_COUNT (sizeof(command_mix) / sizeof(command_mix[0]))
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void count(uint64_t *counter, uint64_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static uint64_t load(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static unsigned int hist_bucket(uint64_t us) {
+    if (us < (1u << SOAK_HIST_SUB_BITS)) return (unsigned int)us;
+    unsigned int log = 63 - (unsigned int)__builtin_clzll(us);
+    unsigned int sub = (unsigned int)(us >> (log - SOAK_HIST_SUB_BITS)) & ((1u << SOAK_HIST_SUB_BITS) - 1);
+    return ((log - SOAK_HIST_SUB_BITS + 1) << SOAK_HIST_SUB_BITS) + sub;
+}
+
+// Upper bound of a bucket, so reported percentiles never understate
+static uint64_t hist_bucket_limit(unsigned int bucket) {
+    if (bucket < (1u << SOAK_HIST_SUB_BITS)) return bucket;
+    unsigned int log = (bucket >> SOAK_HIST_SUB_BITS) + SOAK_HIST_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1u << SOAK_HIST_SUB_BITS) - 1);
+    return ((1ULL << SOAK_HIST_SUB_BITS | sub) + 1) << (log - SOAK_HIST_SUB_BITS);
+}
+
+static void hist_record(uint64_t us) {
+    count(&hist.counts[hist_bucket(us)], 1);
+    count(&hist.total, 1);
+    uint64_t max = load(&counters.interval_max_us);
+    while (us > max && !__atomic_compare_exchange_n(&counters.interval_max_us, &max, us, false,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void hist_copy(SoakHist *out) {
+    for (int i = 0; i < SOAK_HIST_BUCKETS; ++i) out->counts[i] = load(&hist.counts[i]);
+    out->total = 0;
+    for (int i = 0; i < SOAK_HIST_BUCKETS; ++i) out->total += out->counts[i];
+}
+
+/*
+ * Returns quantile q of the commands counted in now but not in before.
+ */
+static uint64_t hist_quantile(const SoakHist *now, const SoakHist *before, double q) {
+    uint64_t total = now->total - (before ? before->total : 0);
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)(total - 1)) + 1, seen = 0;
+    for (unsigned int i = 0; i < SOAK_HIST_BUCKETS; ++i) {
+        seen += now->counts[i] - (before ? before->counts[i] : 0);
+        if (seen >= rank) return hist_bucket_limit(i);
+    }
+    return hist_bucket_limit(SOAK_HIST_BUCKETS - 1);
+}
+
+/*
+ * Opens a TCP listener on 127.0.0.1:port. Returns the socket, or -1 on error.
+ */
+static int listen_on(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Connects to 127.0.0.1:port with a receive timeout. Returns the socket, or -1 on error.
+ */
+static int connect_to(uint16_t port, int timeout_s) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = timeout_s };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/*
+ * Gunzips an upload body. Returns a malloc'd, NUL-terminated buffer, or NULL on error.
+ */
+static char *gunzip(const char *in, size_t in_len, size_t *out_len) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) return NULL;
+    size_t cap = in_len * 8 + 1024, len = 0;
+    char *out = malloc(cap);
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)in_len;
+    int ret = Z_OK;
+    while (out && ret == Z_OK) {
+        if (cap - len < 1024) {
+            char *bigger = cap * 2 <= SOAK_HTTP_MAX * 4 ? realloc(out, cap * 2) : NULL;
+            if (!bigger) break;
+            out = bigger;
+            cap *= 2;
+        }
+        zs.next_out = (Bytef *)out + len;
+        zs.avail_out = (uInt)(cap - len - 1);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        len = cap - 1 - zs.avail_out;
+    }
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    out[len] = '\0';
+    *out_len = len;
+    return out;
+}
+
+// Finds header name in the request head, case-insensitively. Returns its value, or NULL.
+static const char *find_header(const char *head, const char *name) {
+    size_t name_len = strlen(name);
+    for (const char *line = strstr(head, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            line += name_len + 1;
+            while (*line == ' ') line++;
+            return line;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Answers one request on a stand-in connection. Returns the response status.
+ */
+static int mock_respond(MockConn *conn, const char *head, const char *body, size_t body_len, char *out, size_t out_size) {
+    char method[8] = "", path[1024] = "";
+    sscanf(head, "%7s %1023s", method, path);
+    int status = 404;
+    char payload[512] = "{}";
+    if (conn->kind == MOCK_WEATHER && strcmp(method, "GET") == 0 && strncmp(path, "/v1/devices/", 12) == 0) {
+        uint64_t n = __atomic_add_fetch(&counters.weather_requests, 1, __ATOMIC_RELAXED);
+        time_t t = time(NULL);
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S.000Z", &tm);
+        snprintf(payload, sizeof(payload),
+                 "[{\"dateutc\":%lld000,\"tempf\":%.1f,\"humidity\":%d,\"baromrelin\":29.92,\"baromabsin\":%.2f,"
+                 "\"windspeedmph\":%.1f,\"windgustmph\":%.1f,\"winddir\":%d,\"dailyrainin\":0,\"date\":\"%s\"}]",
+                 (long long)t, 50.0 + (double)(n % 20) / 2, 30 + (int)(n % 40), 29.5 + (double)(n % 10) / 100,
+                 (double)(n % 15), (double)(n % 25), (int)(n * 7 % 360), date);
+        status = 200;
+    } else if (conn->kind == MOCK_UPLOAD && strcmp(method, "POST") == 0) {
+        size_t path_len = strlen(path);
+        bool batch = path_len >= 13 && strcmp(path + path_len - 13, "/submit_batch") == 0;
+        bool single = path_len >= 7 && strcmp(path + path_len - 7, "/submit") == 0;
+        if (batch || single) {
+            const char *encoding = find_header(head, "Content-Encoding");
+            char *plain = NULL;
+            size_t plain_len = body_len;
+            if (encoding && strncasecmp(encoding, "gzip", 4) == 0) plain = gunzip(body, body_len, &plain_len);
+            const char *json = plain ? plain : body;
+            if (encoding && strncasecmp(encoding, "gzip", 4) == 0 && !plain) {
+                count(&counters.http_errors, 1);
+                status = 400;
+            } else {
+                uint64_t records = 0;
+                for (const char *p = strstr(json, "\"datetime\""); p; p = strstr(p + 10, "\"datetime\"")) records++;
+                if (records == 0) {
+                    count(&counters.http_errors, 1);
+                    status = 400;
+                } else {
+                    count(&counters.upload_requests, 1);
+                    count(&counters.uploaded, records);
+                    count(&counters.upload_bytes, body_len);
+                    if (batch) snprintf(payload, sizeof(payload), "{\"inserted\":%llu}", (unsigned long long)records);
+                    else snprintf(payload, sizeof(payload), "{\"success\":true}");
+                    status = 200;
+                }
+            }
+            free(plain);
+        }
+    }
+    size_t payload_len = strlen(payload);
+    int n = snprintf(out, out_size, "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n%s",
+                     status, status == 200 ? "OK" : status == 400 ? "Bad Request" : "Not Found", payload_len, payload);
+    write_all(conn->fd, out, (size_t)n);
+    return status;
+}
+
+/*
+ * Serves one keep-alive connection to a stand-in until the client closes it.
+ */
+static void *mock_conn_main(void *arg) {
+    MockConn *conn = (MockConn *)arg;
+    size_t cap = 64 * 1024, len = 0;
+    char *buf = malloc(cap);
+    char out[1024];
+    while (buf) {
+        char *head_end = NULL;
+        while (!(head_end = len ? memmem(buf, len, "\r\n\r\n", 4) : NULL)) {
+            if (len == cap - 1) goto done;
+            ssize_t n = recv(conn->fd, buf + len, cap - 1 - len, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) goto done;
+            len += (size_t)n;
+        }
+        *head_end = '\0';
+        size_t head_len = (size_t)(head_end - buf) + 4;
+        const char *length = find_header(buf, "Content-Length");
+        size_t body_len = length ? strtoul(length, NULL, 10) : 0;
+        if (body_len > SOAK_HTTP_MAX) goto done;
+        if (head_len + body_len + 1 > cap) {
+            char *bigger = realloc(buf, head_len + body_len + 1);
+            if (!bigger) goto done;
+            buf = bigger;
+            cap = head_len + body_len + 1;
+        }
+        while (len < head_len + body_len) {
+            ssize_t n = recv(conn->fd, buf + len, cap - 1 - len, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) goto done;
+            len += (size_t)n;
+        }
+        char saved = buf[head_len + body_len];
+        buf[head_len + body_len] = '\0';
+        mock_respond(conn, buf, buf + head_len, body_len, out, sizeof(out));
+        buf[head_len + body_len] = saved;
+        // Keep anything pipelined behind this request
+        len -= head_len + body_len;
+        memmove(buf, buf + head_len + body_len, len);
+    }
+done:
+    free(buf);
+    close(conn->fd);
+    free(conn);
+    return NULL;
+}
+
+/*
+ * Accepts stand-in connections, one detached thread each.
+ */
+static void *mock_accept_main(void *arg) {
+    MockServer *srv = (MockServer *)arg;
+    while (1) {
+        int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return NULL;
+        }
+        MockConn *conn = malloc(sizeof(*conn));
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (!conn) {
+            close(fd);
+        } else {
+            conn->fd = fd;
+            conn->kind = srv->kind;
+            if (pthread_create(&thread, &attr, mock_conn_main, conn) != 0) {
+                close(fd);
+                free(conn);
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+}
+
+/*
+ * Reads one control-port frame ("TYPE <length>\n" and the payload). The payload is
+ * NUL-terminated in out. Returns the payload length, or -1 on error or timeout.
+ */
+static ssize_t read_frame(FrameReader *r, char *type, size_t type_size, char *out, size_t out_size) {
+    char header[64];
+    size_t hlen = 0;
+    while (1) {
+        if (r->start == r->end) {
+            ssize_t n = recv(r->fd, r->buf, sizeof(r->buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            r->start = 0;
+            r->end = (size_t)n;
+        }
+        char c = r->buf[r->start++];
+        if (c == '\n') break;
+        if (hlen == sizeof(header) - 1) return -1;
+        header[hlen++] = c;
+    }
+    header[hlen] = '\0';
+    char *space = strchr(header, ' ');
+    if (!space) return -1;
+    *space = '\0';
+    if ((size_t)(space - header) >= type_size) return -1;
+    memcpy(type, header, (size_t)(space - header) + 1);
+    size_t len = strtoul(space + 1, NULL, 10), got = 0;
+    if (len >= out_size) return -1;
+    while (got < len) {
+        if (r->start == r->end) {
+            ssize_t n = recv(r->fd, r->buf, sizeof(r->buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            r->start = 0;
+            r->end = (size_t)n;
+        }
+        size_t take = r->end - r->start < len - got ? r->end - r->start : len - got;
+        memcpy(out + got, r->buf + r->start, take);
+        r->start += take;
+        got += take;
+    }
+    out[len] = '\0';
+    return (ssize_t)len;
+}
+
+/*
+ * Opens a control-port connection and sends first_command ("session" or "subscribe").
+ * Returns 0 once the daemon has answered it, -1 on error.
+ */
+static int control_open(FrameReader *r, const char *first_command, char *frame) {
+    r->fd = connect_to(control_port, 5);
+    r->start = r->end = 0;
+    if (r->fd < 0) return -1;
+    char cmd[32], type[8];
+    int n = snprintf(cmd, sizeof(cmd), "%s\n", first_command);
+    if (write_all(r->fd, cmd, (size_t)n) < 0 || read_frame(r, type, sizeof(type), frame, SOAK_FRAME_MAX) < 0
+        || strcmp(type, "RSP") != 0) {
+        close(r->fd);
+        r->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Control client: one session connection issuing the command mix back to back, closed loop.
+ */
+static void *client_main(void *arg) {
+    unsigned int next = (unsigned int)(uintptr_t)arg;
+    FrameReader *r = malloc(sizeof(*r));
+    char *frame = malloc(SOAK_FRAME_MAX);
+    if (!r || !frame) return NULL;
+    r->fd = -1;
+    while (!__atomic_load_n(&stop_clients, __ATOMIC_RELAXED)) {
+        if (r->fd < 0) {
+            if (control_open(r, "session", frame) < 0) {
+                count(&counters.ctl_errors, 1);
+                usleep(100000);
+                continue;
+            }
+            count(&counters.ctl_reconnects, 1);
+        }
+        const char *command = command_mix[next++ % COMMAND_MIX_COUNT];
+        char line[64], type[8];
+        int n = snprintf(line, sizeof(line), "%s\n", command);
+        uint64_t start = now_us();
+        if (write_all(r->fd, line, (size_t)n) < 0 || read_frame(r, type, sizeof(type), frame, SOAK_FRAME_MAX) < 0
+            || strcmp(type, "RSP") != 0) {
+            count(&counters.ctl_errors, 1);
+            close(r->fd);
+            r->fd = -1;
+            continue;
+        }
+        hist_record(now_us() - start);
+        count(&counters.ctl_responses, 1);
+    }
+    if (r->fd >= 0) close(r->fd);
+    free(frame);
+    free(r);
+    return NULL;
+}
+
+/*
+ * Subscriber: counts the Reading events the daemon pushes, one per reading taken.
+ */
+static void *subscriber_main(void *arg) {
+    (void)arg;
+    FrameReader *r = malloc(sizeof(*r));
+    char *frame = malloc(SOAK_FRAME_MAX);
+    if (!r || !frame) return NULL;
+    r->fd = -1;
+    while (!__atomic_load_n(&stop_clients, __ATOMIC_RELAXED)) {
+        if (r->fd < 0 && control_open(r, "subscribe", frame) < 0) {
+            usleep(100000);
+            continue;
+        }
+        char type[8];
+        if (read_frame(r, type, sizeof(type), frame, SOAK_FRAME_MAX) < 0) {
+            // Readings arrive several times a second, so a timeout here is a stall; reconnect
+            close(r->fd);
+            r->fd = -1;
+            continue;
+        }
+        if (strcmp(type, "EVT") == 0 && strncmp(frame, "Reading:", 8) == 0) count(&counters.readings, 1);
+    }
+    if (r->fd >= 0) close(r->fd);
+    free(frame);
+    free(r);
+    return NULL;
+}
+
+/*
+ * Samples the daemon's resident set, open fds, and threads. Returns 0 on success.
+ */
+static int sample_proc(pid_t pid, ProcSample *out) {
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    out->rss_kb = -1;
+    out->threads = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) out->rss_kb = atol(line + 6);
+        else if (strncmp(line, "Threads:", 8) == 0) out->threads = atoi(line + 8);
+    }
+    fclose(f);
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+    DIR *dir = opendir(path);
+    if (!dir) return -1;
+    out->fds = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') out->fds++;
+    }
+    closedir(dir);
+    return 0;
+}
+
+/*
+ * Starts argv[0] in dir with its stdout and stderr sent to log_path. Returns the pid, or -1.
+ */
+static pid_t spawn(const char *dir, char *const argv[], const char *log_path) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    int log = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log >= 0) {
+        dup2(log, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+        close(log);
+    }
+    if (chdir(dir) < 0) _exit(127);
+    execv(argv[0], argv);
+    fprintf(stderr, "exec %s: %s\n", argv[0], strerror(errno));
+    _exit(127);
+}
+
+/*
+ * Writes the daemon's configuration files into workdir. Returns 0 on success.
+ */
+static int write_configs(const char *workdir, uint16_t base_port, int ndevices, int interval_ms) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/conf", workdir);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) return -1;
+    snprintf(path, sizeof(path), "%s/conf/nwconf.conf", workdir);
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "siteName:Soak\nlatitude:31.5\nlongitude:-110.2\nelevation:1200\n");
+    fprintf(f, "dbName:%s/soak.rrd\n", workdir);
+    for (int i = 0; i < ndevices; ++i) {
+        fprintf(f, "sqmDevice:d%d,127.0.0.1,%d,%s/d%d.rrd\n", i, base_port + 10 + i, workdir, i);
+    }
+    fprintf(f, "workerThreads:4\ndbBatchSize:10\ndbFlushInterval:60\nhistorySize:8192\n");
+    fprintf(f, "readingIntervalMs:%d\ncontrolPort:%d\n", interval_ms, base_port);
+    fprintf(f, "sqmHeartbeatInterval:10\nsqmReadTimeout:2\nsqmWriteTimeout:2\nenableReadOnStartup:true\n");
+    fprintf(f, "AmbientWeatherAPIKey:soakapikey\nAmbientWeatherAppKey:soakappkey\n");
+    fprintf(f, "AmbientWeatherUpdateInterval:5\nAmbientWeatherDeviceMAC:00:11:22:33:44:55\n");
+    fprintf(f, "AmbientWeatherURL:http://127.0.0.1:%d/v1\nAmbientWeatherTimeout:5\nenableWeather:true\n", base_port + 1);
+    fprintf(f, "enableDataSend:true\nspoolFile:%s/nightwatcher.spool\nuploadBatchSize:50\n", workdir);
+    fprintf(f, "logTarget:%s/nightwatcher.log\nlogLevel:info\n", workdir);
+    if (fclose(f) != 0) return -1;
+    snprintf(path, sizeof(path), "%s/gilinskyresearch.conf", workdir);
+    f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "url:http://127.0.0.1:%d/wp-json/nightwatcher/v1/submit\nusername:soak\npassword:soak\n", base_port + 2);
+    return fclose(f) != 0 ? -1 : 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -b PATH   nightwatcher binary (default ./nightwatcher)\n"
+        "  -S PATH   sqm_le_sim binary (default ./sqm_le_sim)\n"
+        "  -d SECS   duration (default 3600)\n"
+        "  -r SECS   report interval; the first interval is the warmup baseline (default 60)\n"
+        "  -n COUNT  simulated SQM-LE devices (default 4)\n"
+        "  -c COUNT  concurrent control-port clients (default 16)\n"
+        "  -i MS     readingIntervalMs (default 250)\n"
+        "  -P PORT   base port: control PORT, weather PORT+1, upload PORT+2, devices from PORT+10 (default 19000)\n"
+        "  -w DIR    working directory (default a new /tmp/nwsoak.XXXXXX)\n"
+        "  -k        keep the working directory\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *nw_arg = "./nightwatcher", *sim_arg = "./sqm_le_sim";
+    char workdir[PATH_MAX] = "";
+    int duration = 3600, report = 60, ndevices = 4, nclients = 16, interval_ms = 250, base = 19000;
+    bool keep = false;
+    int c;
+    while ((c = getopt(argc, argv, "b:S:d:r:n:c:i:P:w:kh")) != -1) {
+        switch (c) {
+        case 'b': nw_arg = optarg; break;
+        case 'S': sim_arg = optarg; break;
+        case 'd': duration = atoi(optarg); break;
+        case 'r': report = atoi(optarg); break;
+        case 'n': ndevices = atoi(optarg); break;
+        case 'c': nclients = atoi(optarg); break;
+        case 'i': interval_ms = atoi(optarg); break;
+        case 'P': base = atoi(optarg); break;
+        case 'w': snprintf(workdir, sizeof(workdir), "%s", optarg); keep = true; break;
+        case 'k': keep = true; break;
+        default: usage(argv[0]); return c == 'h' ? 0 : 2;
+        }
+    }
+    if (ndevices < 1 || ndevices > SOAK_MAX_DEVICES || nclients < 0 || nclients > SOAK_MAX_CLIENTS
+        || duration < 1 || report < 1 || interval_ms < 1 || base < 1 || base > 65535 - 10 - ndevices) {
+        usage(argv[0]);
+        return 2;
+    }
+    char nw_path[PATH_MAX], sim_path[PATH_MAX];
+    if (!realpath(nw_arg, nw_path) || !realpath(sim_arg, sim_path)) {
+        fprintf(stderr, "Cannot find %s or %s\n", nw_arg, sim_arg);
+        return 2;
+    }
+    if (workdir[0] == '\0') {
+        snprintf(workdir, sizeof(workdir), "/tmp/nwsoak.XXXXXX");
+        if (!mkdtemp(workdir)) {
+            perror("mkdtemp");
+            return 1;
+        }
+    } else if (mkdir(workdir, 0755) < 0 && errno != EEXIST) {
+        perror(workdir);
+        return 1;
+    }
+    control_port = (uint16_t)base;
+    signal(SIGPIPE, SIG_IGN);
+
+    // The stand-ins listen before the daemon starts, so its first requests find them
+    static MockServer mocks[2];
+    mocks[0].kind = MOCK_WEATHER;
+    mocks[1].kind = MOCK_UPLOAD;
+    for (int i = 0; i < 2; ++i) {
+        mocks[i].listen_fd = listen_on((uint16_t)(base + 1 + i));
+        pthread_t thread;
+        if (mocks[i].listen_fd < 0 || pthread_create(&thread, NULL, mock_accept_main, &mocks[i]) != 0) {
+            fprintf(stderr, "Cannot listen on port %d: %s\n", base + 1 + i, strerror(errno));
+            return 1;
+        }
+        pthread_detach(thread);
+    }
+    if (write_configs(workdir, (uint16_t)base, ndevices, interval_ms) < 0) {
+        fprintf(stderr, "Cannot write the configuration in %s\n", workdir);
+        return 1;
+    }
+
+    char log_path[PATH_MAX + 32], port_arg[16], count_arg[16];
+    snprintf(port_arg, sizeof(port_arg), "%d", base + 10);
+    snprintf(count_arg, sizeof(count_arg), "%d", ndevices);
+    snprintf(log_path, sizeof(log_path), "%s/sqm_le_sim.log", workdir);
+    char *sim_argv[] = { sim_path, "-p", port_arg, "-n", count_arg, NULL };
+    pid_t sim_pid = spawn(workdir, sim_argv, log_path);
+    usleep(200000);
+    snprintf(log_path, sizeof(log_path), "%s/nightwatcher.out", workdir);
+    char *nw_argv[] = { nw_path, NULL };
+    pid_t nw_pid = spawn(workdir, nw_argv, log_path);
+    if (sim_pid < 0 || nw_pid < 0) {
+        perror("fork");
+        return 1;
+    }
+
+    // Wait for the control port before starting the clients
+    int probe = -1;
+    for (int tries = 0; tries < 100 && probe < 0; ++tries) {
+        if (waitpid(nw_pid, NULL, WNOHANG) == nw_pid) break;
+        probe = connect_to(control_port, 1);
+        if (probe < 0) usleep(100000);
+    }
+    if (probe < 0) {
+        fprintf(stderr, "nightwatcher did not open control port %d; see %s\n", base, log_path);
+        kill(nw_pid, SIGKILL);
+        kill(sim_pid, SIGTERM);
+        return 1;
+    }
+    close(probe);
+    printf("soak: %d devices every %d ms (%.1f readings/s expected), %d control clients, %d s, workdir %s\n",
+           ndevices, interval_ms, ndevices * 1000.0 / interval_ms, nclients, duration, workdir);
+    fflush(stdout);
+
+    pthread_t subscriber, *clients = calloc((size_t)nclients + 1, sizeof(pthread_t));
+    if (!clients) return 1;
+    pthread_create(&subscriber, NULL, subscriber_main, NULL);
+    for (int i = 0; i < nclients; ++i) pthread_create(&clients[i], NULL, client_main, (void *)(uintptr_t)i);
+
+    // Report loop
+    SoakCounters last = {0};
+    SoakHist *hist_last = calloc(1, sizeof(SoakHist)), *hist_now = calloc(1, sizeof(SoakHist));
+    if (!hist_last || !hist_now) return 1;
+    ProcSample first = {0}, baseline = {0}, sample = {0}, peak = {0};
+    int stalls = 0, intervals = 0, crashed = 0, status = 0;
+    uint64_t start = now_us(), last_us = start;
+    sample_proc(nw_pid, &first);
+    while (now_us() - start < (uint64_t)duration * 1000000ULL) {
+        uint64_t remaining = (uint64_t)duration * 1000000ULL - (now_us() - start);
+        uint64_t wait = (uint64_t)report * 1000000ULL;
+        usleep((useconds_t)(remaining < wait ? remaining : wait));
+        if (waitpid(nw_pid, &status, WNOHANG) == nw_pid) {
+            crashed = 1;
+            break;
+        }
+        uint64_t t = now_us();
+        double secs = (double)(t - last_us) / 1e6;
+        last_us = t;
+        SoakCounters cur;
+        cur.readings = load(&counters.readings);
+        cur.ctl_responses = load(&counters.ctl_responses);
+        cur.ctl_errors = load(&counters.ctl_errors);
+        cur.weather_requests = load(&counters.weather_requests);
+        cur.uploaded = load(&counters.uploaded);
+        uint64_t max_us = __atomic_exchange_n(&counters.interval_max_us, 0, __ATOMIC_RELAXED);
+        hist_copy(hist_now);
+        sample_proc(nw_pid, &sample);
+        intervals++;
+        if (intervals == 1) baseline = sample;
+        if (sample.rss_kb > peak.rss_kb) peak.rss_kb = sample.rss_kb;
+        if (sample.fds > peak.fds) peak.fds = sample.fds;
+        if (sample.threads > peak.threads) peak.threads = sample.threads;
+
+        uint64_t readings = cur.readings - last.readings, responses = cur.ctl_responses - last.ctl_responses;
+        bool stalled = readings == 0 || (nclients > 0 && responses == 0);
+        bool leaking = intervals > 1 && (sample.fds > baseline.fds + SOAK_FD_SLACK || sample.threads > baseline.threads + SOAK_THREAD_SLACK);
+        if (stalled) stalls++;
+        printf("[%6.0fs] readings %.1f/s uploaded %.1f/s weather %.2f/s ctl %.0f q/s err %llu "
+               "p50 %llu p99 %llu p99.9 %llu max %llu us rss %ld kB fds %d threads %d%s%s\n",
+               (double)(t - start) / 1e6, readings / secs, (cur.uploaded - last.uploaded) / secs,
+               (cur.weather_requests - last.weather_requests) / secs, responses / secs,
+               (unsigned long long)(cur.ctl_errors - last.ctl_errors),
+               (unsigned long long)hist_quantile(hist_now, hist_last, 0.5),
+               (unsigned long long)hist_quantile(hist_now, hist_last, 0.99),
+               (unsigned long long)hist_quantile(hist_now, hist_last, 0.999),
+               (unsigned long long)max_us, sample.rss_kb, sample.fds, sample.threads,
+               stalled ? " STALL" : "", leaking ? " LEAK" : "");
+        fflush(stdout);
+        last = cur;
+        SoakHist *swap = hist_last;
+        hist_last = hist_now;
+        hist_now = swap;
+    }
+    double elapsed = (double)(now_us() - start) / 1e6;
+
+    // Sample with the clients still connected, as the baseline was
+    ProcSample end = sample;
+    if (!crashed) sample_proc(nw_pid, &end);
+    __atomic_store_n(&stop_clients, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < nclients; ++i) pthread_join(clients[i], NULL);
+    pthread_join(subscriber, NULL);
+
+    double shutdown_s = 0;
+    if (!crashed) {
+        uint64_t term = now_us();
+        kill(nw_pid, SIGTERM);
+        int exited = 0;
+        while (!exited && now_us() - term < (uint64_t)SOAK_SHUTDOWN_LIMIT * 2 * 1000000ULL) {
+            if (waitpid(nw_pid, &status, WNOHANG) == nw_pid) exited = 1;
+            else usleep(10000);
+        }
+        shutdown_s = (double)(now_us() - term) / 1e6;
+        if (!exited) {
+            kill(nw_pid, SIGKILL);
+            waitpid(nw_pid, &status, 0);
+        }
+    }
+    kill(sim_pid, SIGTERM);
+    waitpid(sim_pid, NULL, 0);
+
+    hist_copy(hist_now);
+    uint64_t readings = load(&counters.readings), responses = load(&counters.ctl_responses);
+    printf("\nsummary after %.0f s\n", elapsed);
+    printf("readings:    %llu (%.2f/s, %.2f/s expected)\n", (unsigned long long)readings, readings / elapsed,
+           ndevices * 1000.0 / interval_ms);
+    printf("uploads:     %llu records in %llu requests, %llu bytes on the wire\n",
+           (unsigned long long)load(&counters.uploaded), (unsigned long long)load(&counters.upload_requests),
+           (unsigned long long)load(&counters.upload_bytes));
+    printf("weather:     %llu requests\n", (unsigned long long)load(&counters.weather_requests));
+    printf("control:     %llu responses (%.0f q/s), %llu errors, %llu connections\n",
+           (unsigned long long)responses, responses / elapsed, (unsigned long long)load(&counters.ctl_errors),
+           (unsigned long long)load(&counters.ctl_reconnects));
+    printf("latency us:  p50 %llu p90 %llu p99 %llu p99.9 %llu\n",
+           (unsigned long long)hist_quantile(hist_now, NULL, 0.5), (unsigned long long)hist_quantile(hist_now, NULL, 0.9),
+           (unsigned long long)hist_quantile(hist_now, NULL, 0.99), (unsigned long long)hist_quantile(hist_now, NULL, 0.999));
+    if (load(&counters.http_errors) > 0) printf("stand-ins:   %llu malformed requests\n", (unsigned long long)load(&counters.http_errors));
+    double hours = elapsed / 3600.0;
+    printf("rss kB:      start %ld, baseline %ld, end %ld, peak %ld (%+.0f kB/h after baseline)\n",
+           first.rss_kb, baseline.rss_kb, end.rss_kb, peak.rss_kb,
+           hours > 0 ? (double)(end.rss_kb - baseline.rss_kb) / hours : 0.0);
+    printf("fds:         baseline %d, end %d, peak %d\n", baseline.fds, end.fds, peak.fds);
+    printf("threads:     baseline %d, end %d, peak %d\n", baseline.threads, end.threads, peak.threads);
+
+    int failures = 0;
+    if (crashed) {
+        printf("FAIL: nightwatcher exited during the run (%s %d)\n",
+               WIFSIGNALED(status) ? "signal" : "status", WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+        failures++;
+    } else {
+        printf("shutdown:    %.2f s, %s %d\n", shutdown_s, WIFSIGNALED(status) ? "signal" : "exit status",
+               WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+        if (shutdown_s > SOAK_SHUTDOWN_LIMIT) {
+            printf("FAIL: shutdown took longer than %d s\n", SOAK_SHUTDOWN_LIMIT);
+            failures++;
+        }
+        if (WIFSIGNALED(status) || WEXITSTATUS(status) != 0) {
+            printf("FAIL: nightwatcher did not exit cleanly on SIGTERM\n");
+            failures++;
+        }
+    }
+    if (stalls > 0) {
+        printf("FAIL: %d of %d intervals stalled\n", stalls, intervals);
+        failures++;
+    }
+    if (intervals > 1 && end.fds > baseline.fds + SOAK_FD_SLACK) {
+        printf("FAIL: open fds grew from %d to %d\n", baseline.fds, end.fds);
+        failures++;
+    }
+    if (intervals > 1 && end.threads > baseline.threads + SOAK_THREAD_SLACK) {
+        printf("FAIL: threads grew from %d to %d\n", baseline.threads, end.threads);
+        failures++;
+    }
+    if (failures == 0) printf("PASS\n");
+    printf("logs in %s\n", keep || failures ? workdir : "(removed)");
+    if (!keep && failures == 0) {
+        char cmd[PATH_MAX + 16];
+        snprintf(cmd, sizeof(cmd), "rm -rf '%s'", workdir);
+        if (system(cmd) != 0) fprintf(stderr, "Could not remove %s\n", workdir);
+    }
+    free(clients);
+    free(hist_last);
+    free(hist_now);
+    return failures ? 1 : 0;
+}
@@ -8,97 +8,121 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <curl/curl.h>
-#include <cjson/cJSON.h>
 
 static char g_api_key[128] = {0};
 static char g_app_key[128] = {0};
 static char g_device_mac[64] = {0};
+static char g_base_url[256] = AW_DEFAULT_BASE_URL;
+static long g_timeout = AW_DEFAULT_TIMEOUT;
 
-// Buffer for HTTP response
-typedef struct {
-    char *data;
-    size_t size;
-} aw_http_buffer;
+// One easy handle for the life of the process, so its connection, DNS, and TLS session
+// caches carry over from one poll to the next. Easy handles are not thread safe.
+static pthread_mutex_t g_curl_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_curl_once = PTHREAD_ONCE_INIT;
+static bool g_curl_global_ok = false;
+static CURL *g_curl = NULL;
 
 static size_t aw_write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t realsize = size * nmemb;
-    aw_http_buffer *mem = (aw_http_buffer *)userp;
-    char *ptr = realloc(mem->data, mem->size + realsize + 1);
-    if(ptr == NULL) return 0;
-    mem->data = ptr;
-    memcpy(&(mem->data[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->data[mem->size] = 0;
+    // Keep accepting bytes after element 0 so the connection stays reusable
+    aw_json_feed((AW_JsonScanner *)userp, (const char *)contents, realsize);
     return realsize;
 }
 
+/*
+ * Runs curl_global_init exactly once per process (it is not thread safe).
+ */
+static void aw_global_init(void) {
+    g_curl_global_ok = curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK;
+}
+
+/*
+ * Creates the persistent easy handle and sets the options that stay fixed across polls.
+ * Caller holds g_curl_lock. Returns true if the handle is ready.
+ */
+static bool aw_open_handle(void) {
+    if (g_curl) return true;
+    g_curl = curl_easy_init();
+    if (!g_curl) return false;
+    curl_easy_setopt(g_curl, CURLOPT_WRITEFUNCTION, aw_write_callback);
+    curl_easy_setopt(g_curl, CURLOPT_NOSIGNAL, 1L);              // Timeouts without SIGALRM; we are threaded
+    curl_easy_setopt(g_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(g_curl, CURLOPT_TCP_KEEPIDLE, (long)AW_KEEPALIVE_IDLE);
+    curl_easy_setopt(g_curl, CURLOPT_TCP_KEEPINTVL, (long)AW_KEEPALIVE_IDLE);
+    curl_easy_setopt(g_curl, CURLOPT_MAXAGE_CONN, (long)AW_CONNECTION_MAX_AGE); // Reuse connections idle between polls
+    curl_easy_setopt(g_curl, CURLOPT_DNS_CACHE_TIMEOUT, (long)AW_DNS_CACHE_TIMEOUT);
+    curl_easy_setopt(g_curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+    return true;
+}
+
 bool aw_init(const char* api_key, const char* application_key, const char* device_mac) {
     if (!api_key || !application_key || !device_mac) return false;
+    pthread_once(&g_curl_once, aw_global_init);
+    if (!g_curl_global_ok) return false;
+    pthread_mutex_lock(&g_curl_lock);
     strncpy(g_api_key, api_key, sizeof(g_api_key)-1);
     strncpy(g_app_key, application_key, sizeof(g_app_key)-1);
     strncpy(g_device_mac, device_mac, sizeof(g_device_mac)-1);
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    return true;
+    bool ok = aw_open_handle();
+    pthread_mutex_unlock(&g_curl_lock);
+    return ok;
+}
+
+void aw_set_endpoint(const char* base_url, long timeout_seconds) {
+    pthread_mutex_lock(&g_curl_lock);
+    strncpy(g_base_url, (base_url && base_url[0]) ? base_url : AW_DEFAULT_BASE_URL, sizeof(g_base_url)-1);
+    g_timeout = timeout_seconds > 0 ? timeout_seconds : AW_DEFAULT_TIMEOUT;
+    pthread_mutex_unlock(&g_curl_lock);
 }
 
 bool aw_get_current_weather(AW_WeatherData* data) {
     if (!data) return false;
-    CURL *curl = curl_easy_init();
-    if (!curl) return false;
-    char url[512];
+    pthread_mutex_lock(&g_curl_lock);
+    if (!aw_open_handle()) {
+        pthread_mutex_unlock(&g_curl_lock);
+        return false;
+    }
+    CURL *curl = g_curl;
+    char url[768];
     snprintf(url, sizeof(url),
-        "https://api.ambientweather.net/v1/devices/%s?apiKey=%s&applicationKey=%s&limit=1",
-        g_device_mac, g_api_key, g_app_key);
-    printf("URL: %s\n", url);
-    aw_http_buffer buffer = {0};
+        "%s/devices/%s?apiKey=%s&applicationKey=%s&limit=1",
+        g_base_url, g_device_mac, g_api_key, g_app_key);
+    // Scan into a local copy so a failed request leaves the caller's data untouched.
+    // Fields missing from the response are reported as 999.99.
+    AW_WeatherData parsed = *data;
+    AW_JsonScanner scanner;
+    aw_json_init(&scanner, &parsed);
     curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, aw_write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&buffer);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&scanner);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, g_timeout);
+    uint64_t start = metrics_now();
     CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        curl_easy_cleanup(curl);
-        free(buffer.data);
-        return false;
-    }
-    // Parse JSON
-    cJSON *root = cJSON_Parse(buffer.data);
-    if (!root) {
-        curl_easy_cleanup(curl);
-        free(buffer.data);
-        return false;
-    }
-    // The API returns an array of readings
-    cJSON *reading = cJSON_GetArrayItem(root, 0);
-    if (!reading) {
-        cJSON_Delete(root);
-        curl_easy_cleanup(curl);
-        free(buffer.data);
-        return false;
-    }
-    // Extract fields with NULL checks, use 999.99 if missing
-    cJSON *item = NULL;
-    item = cJSON_GetObjectItem(reading, "tempf");
-    data->temperature_f = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
-    item = cJSON_GetObjectItem(reading, "humidity");
-    data->humidity = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
-    item = cJSON_GetObjectItem(reading, "windspeedmph");
-    data->wind_speed_mph = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
-    item = cJSON_GetObjectItem(reading, "windgustmph");
-    data->wind_gust_mph = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
-    item = cJSON_GetObjectItem(reading, "baromabsin");
-    data->pressure_in = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
-    item = cJSON_GetObjectItem(reading, "hourlyrainin");
-    data->rainfall_in = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
-    item = cJSON_GetObjectItem(reading, "date");
-    const char* ts = (item && cJSON_IsString(item)) ? item->valuestring : "";
-    strncpy(data->timestamp, ts, sizeof(data->timestamp)-1);
-    cJSON_Delete(root);
-    curl_easy_cleanup(curl);
-    free(buffer.data);
+    metrics_record(METRIC_WEATHER_FETCH, start, res == CURLE_OK ? METRIC_OK : res == CURLE_OPERATION_TIMEDOUT ? METRIC_TIMEOUT : METRIC_FAIL);
+    long new_connections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+    pthread_mutex_unlock(&g_curl_lock);
+    LOGGER_DEBUG(LOG_MOD_WEATHER, "AmbientWeather request: %s (%s connection)", res == CURLE_OK ? "ok" : curl_easy_strerror(res),
+           new_connections == 0 ? "reused" : "new");
+    // The API returns an array of readings; we need a complete first element
+    if (res != CURLE_OK || !aw_json_complete(&scanner)) return false;
+    data->temperature_f = parsed.temperature_f;
+    data->humidity = parsed.humidity;
+    data->wind_speed_mph = parsed.wind_speed_mph;
+    data->wind_gust_mph = parsed.wind_gust_mph;
+    data->pressure_in = parsed.pressure_in;
+    data->rainfall_in = parsed.rainfall_in;
+    memcpy(data->timestamp, parsed.timestamp, sizeof(data->timestamp));
     return true;
 }
 
-void aw_cleanup() {
-    curl_global_cleanup();
+void aw_cleanup(void) {
+    pthread_mutex_lock(&g_curl_lock);
+    if (g_curl) {
+        curl_easy_cleanup(g_curl);
+        g_curl = NULL;
+    }
+    pthread_mutex_unlock(&g_curl_lock);
+    if (g_curl_global_ok) curl_global_cleanup();
 }
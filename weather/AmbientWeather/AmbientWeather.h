@@ -9,6 +9,12 @@
 
 #include <stdbool.h>
 
+#define AW_DEFAULT_BASE_URL    "https://api.ambientweather.net/v1"
+#define AW_DEFAULT_TIMEOUT     10    // Seconds allowed for one request, including connect
+#define AW_KEEPALIVE_IDLE      60    // Seconds before TCP keepalive probes on the API connection
+#define AW_CONNECTION_MAX_AGE  3600  // Longest idle time (seconds) before a cached connection is dropped
+#define AW_DNS_CACHE_TIMEOUT   3600  // Seconds the API host's address is cached
+
 // Structure to hold weather data
 typedef struct {
     double temperature_f;
@@ -21,15 +27,19 @@ typedef struct {
     bool   weatherReady;
 } AW_WeatherData;
 
-// Initialize the AmbientWeather API client
-// Returns true on success, false on failure
+// Initialize the AmbientWeather API client. libcurl is initialized once per process and one
+// handle is kept open, so later polls reuse its connection, DNS entry, and TLS session.
+// May be called again to change the keys. Returns true on success, false on failure
 bool aw_init(const char* api_key, const char* application_key, const char* device_mac);
 
+// Sets the API base URL (NULL or empty for AW_DEFAULT_BASE_URL) and the per-request timeout
+void aw_set_endpoint(const char* base_url, long timeout_seconds);
+
 // Retrieve the latest weather data
 // Returns true on success, false on failure
 bool aw_get_current_weather(AW_WeatherData* data);
 
-// Cleanup any resources used by the API client
-void aw_cleanup();
+// Cleanup any resources used by the API client; call once at exit
+void aw_cleanup(void);
 
 #endif // AMBIENTWEATHER_H
@@ -0,0 +1,117 @@
+/*
+ * Project: NightWatcher
+ * File: aw_json.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "aw_json.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Stores a completed key/value pair of element 0 if it is one of the fields we use.
+ */
+static void aw_json_commit(AW_JsonScanner *sc, bool is_string) {
+    sc->key[sc->key_len < sizeof(sc->key) ? sc->key_len : sizeof(sc->key) - 1] = '\0';
+    sc->value[sc->value_len < sizeof(sc->value) ? sc->value_len : sizeof(sc->value) - 1] = '\0';
+    sc->expect_value = false;
+    AW_WeatherData *d = sc->data;
+    if (is_string) {
+        if (strcmp(sc->key, "date") == 0) {
+            size_t n = strnlen(sc->value, sizeof(d->timestamp) - 1);
+            memcpy(d->timestamp, sc->value, n);
+            d->timestamp[n] = '\0';
+        }
+        return;
+    }
+    double *field = NULL;
+    if (strcmp(sc->key, "tempf") == 0) field = &d->temperature_f;
+    else if (strcmp(sc->key, "humidity") == 0) field = &d->humidity;
+    else if (strcmp(sc->key, "windspeedmph") == 0) field = &d->wind_speed_mph;
+    else if (strcmp(sc->key, "windgustmph") == 0) field = &d->wind_gust_mph;
+    else if (strcmp(sc->key, "baromabsin") == 0) field = &d->pressure_in;
+    else if (strcmp(sc->key, "hourlyrainin") == 0) field = &d->rainfall_in;
+    if (!field) return;
+    char *end;
+    double v = strtod(sc->value, &end);
+    if (end != sc->value) *field = v; // "null" and friends leave the 999.99 default
+}
+
+void aw_json_init(AW_JsonScanner *sc, AW_WeatherData *data) {
+    memset(sc, 0, sizeof(*sc));
+    sc->data = data;
+    data->temperature_f = data->humidity = data->wind_speed_mph = 999.99;
+    data->wind_gust_mph = data->pressure_in = data->rainfall_in = 999.99;
+    data->timestamp[0] = '\0';
+}
+
+void aw_json_feed(AW_JsonScanner *sc, const char *buf, size_t len) {
+    for (size_t i = 0; i < len && !sc->done; ++i) {
+        char c = buf[i];
+        if (sc->in_string) {
+            if (sc->escape) {
+                sc->escape = false;
+            } else if (c == '\\') {
+                sc->escape = true;
+                continue;
+            } else if (c == '"') {
+                sc->in_string = false;
+                if (sc->in_element && sc->depth == 2) {
+                    if (sc->string_is_key) {
+                        sc->key_len = sc->value_len;
+                        memcpy(sc->key, sc->value, sizeof(sc->key));
+                    } else if (sc->expect_value) {
+                        aw_json_commit(sc, true);
+                    }
+                }
+                continue;
+            }
+            if (sc->value_len < sizeof(sc->value) - 1) sc->value[sc->value_len] = c;
+            sc->value_len++;
+            continue;
+        }
+        switch (c) {
+        case '"':
+            sc->in_string = true;
+            sc->string_is_key = !sc->expect_value;
+            sc->value_len = 0;
+            break;
+        case '[':
+        case '{':
+            if (sc->depth == 0) sc->root_is_array = (c == '[');
+            if (sc->depth == 1 && sc->root_is_array && c == '{') sc->in_element = true;
+            if (sc->depth == 2) sc->expect_value = false; // Nested value: not one of ours
+            sc->depth++;
+            break;
+        case ']':
+        case '}':
+            if (sc->depth == 2 && sc->in_element && sc->expect_value) aw_json_commit(sc, false);
+            sc->depth--;
+            if (sc->depth == 1 && sc->in_element) sc->done = true;
+            if (sc->depth <= 0) sc->done = true;
+            break;
+        case ':':
+            if (sc->depth == 2 && sc->in_element) {
+                sc->expect_value = true;
+                sc->value_len = 0;
+            }
+            break;
+        case ',':
+            if (sc->depth == 2 && sc->in_element && sc->expect_value) aw_json_commit(sc, false);
+            break;
+        case ' ': case '\t': case '\r': case '\n':
+            break;
+        default:
+            // Number, true, false, or null for the current key
+            if (sc->depth == 2 && sc->in_element && sc->expect_value) {
+                if (sc->value_len < sizeof(sc->value) - 1) sc->value[sc->value_len] = c;
+                sc->value_len++;
+            }
+            break;
+        }
+    }
+}
+
+bool aw_json_complete(const AW_JsonScanner *sc) {
+    return sc->in_element && sc->done;
+}
@@ -0,0 +1,47 @@
+/*
+ * Project: NightWatcher
+ * File: aw_json.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef AW_JSON_H
+#define AW_JSON_H
+
+// Streaming scanner for the AmbientWeather device query response, a JSON array of readings.
+// Only the scalar fields of element 0 are looked at; bytes after it are skipped. No allocation:
+// keys and values longer than AW_JSON_TOKEN_MAX are truncated, which none we read are.
+// This header needs only AmbientWeather.h, so benchmarks can build the scanner without libcurl.
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "AmbientWeather.h"
+
+#define AW_JSON_TOKEN_MAX      64    // Longest JSON key or value kept while scanning a response
+
+typedef struct {
+    AW_WeatherData *data;
+    int depth;                       // Current [ / { nesting
+    bool root_is_array;
+    bool in_element;                 // Inside the object for element 0
+    bool done;                       // Element 0 has been closed
+    bool in_string;
+    bool escape;
+    bool string_is_key;
+    bool expect_value;               // Saw ':' for a key of element 0
+    char key[AW_JSON_TOKEN_MAX];
+    size_t key_len;
+    char value[AW_JSON_TOKEN_MAX];
+    size_t value_len;
+} AW_JsonScanner;
+
+// Starts a scan into data. The weather fields are set to 999.99 and the timestamp emptied,
+// so fields missing from the response keep those values; the rest of data is untouched
+void aw_json_init(AW_JsonScanner *sc, AW_WeatherData *data);
+
+// Feeds the next chunk of the response body; chunks may split tokens anywhere
+void aw_json_feed(AW_JsonScanner *sc, const char *buf, size_t len);
+
+// Returns true once a complete element 0 has been scanned
+bool aw_json_complete(const AW_JsonScanner *sc);
+
+#endif // AW_JSON_H
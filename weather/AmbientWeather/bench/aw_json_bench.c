@@ -0,0 +1,237 @@
+/*
+ * Project: NightWatcher
+ * File: aw_json_bench.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ *
+ * AmbientWeather response benchmark: feeds recorded /devices responses (bench/fixtures/)
+ * through the streaming scanner (aw_json.h) in curl-sized chunks and, when built with
+ * cJSON, through the path it replaced: append each chunk to a realloc'd buffer, then
+ * cJSON_Parse the body and look up element 0's fields. Reports nanoseconds per response
+ * and checks that both paths read the same values. Exits nonzero if a fixture has no
+ * complete element 0 or the two paths disagree.
+ */
+#include "aw_json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#ifdef AW_BENCH_CJSON
+#include <cjson/cJSON.h>
+#endif
+
+#ifndef AW_BENCH_FIXTURES
+#define AW_BENCH_FIXTURES "fixtures"
+#endif
+#define BENCH_CHUNK_SIZE 16384 // CURL_MAX_WRITE_SIZE, the most curl passes to one write callback
+
+static const char *default_fixtures[] = {
+    "devices_limit1.json",   // What the daemon requests: one reading
+    "devices_limit288.json", // A day of five-minute readings; only element 0 is used
+    "devices_awkward.json",  // Nulls, a missing field, escapes, and nested keys named like ours
+};
+
+static volatile double sink; // Keeps results from being optimized away
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Reads a whole file. Returns a malloc'd buffer and its length in *len, or NULL.
+ */
+static char *load_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    if (buf && fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    if (!buf) return NULL;
+    buf[size] = '\0';
+    *len = (size_t)size;
+    return buf;
+}
+
+/*
+ * Streaming path, as aw_get_current_weather runs it. Returns true if element 0 was complete.
+ */
+static bool scan_response(const char *body, size_t len, size_t chunk, AW_WeatherData *out) {
+    AW_JsonScanner scanner;
+    aw_json_init(&scanner, out);
+    for (size_t off = 0; off < len; off += chunk) {
+        aw_json_feed(&scanner, body + off, len - off < chunk ? len - off : chunk);
+    }
+    return aw_json_complete(&scanner);
+}
+
+#ifdef AW_BENCH_CJSON
+/*
+ * The replaced path: buffers the body chunk by chunk as the old write callback did, then
+ * parses it with cJSON. Returns true if element 0 was found.
+ */
+static bool parse_response_cjson(const char *body, size_t len, size_t chunk, AW_WeatherData *out) {
+    char *data = NULL;
+    size_t size = 0;
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = len - off < chunk ? len - off : chunk;
+        char *ptr = realloc(data, size + n + 1);
+        if (!ptr) {
+            free(data);
+            return false;
+        }
+        data = ptr;
+        memcpy(data + size, body + off, n);
+        size += n;
+        data[size] = 0;
+    }
+    cJSON *root = data ? cJSON_Parse(data) : NULL;
+    cJSON *reading = root ? cJSON_GetArrayItem(root, 0) : NULL;
+    if (!reading) {
+        cJSON_Delete(root);
+        free(data);
+        return false;
+    }
+    cJSON *item = NULL;
+    item = cJSON_GetObjectItem(reading, "tempf");
+    out->temperature_f = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
+    item = cJSON_GetObjectItem(reading, "humidity");
+    out->humidity = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
+    item = cJSON_GetObjectItem(reading, "windspeedmph");
+    out->wind_speed_mph = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
+    item = cJSON_GetObjectItem(reading, "windgustmph");
+    out->wind_gust_mph = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
+    item = cJSON_GetObjectItem(reading, "baromabsin");
+    out->pressure_in = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
+    item = cJSON_GetObjectItem(reading, "hourlyrainin");
+    out->rainfall_in = (item && cJSON_IsNumber(item)) ? item->valuedouble : 999.99;
+    item = cJSON_GetObjectItem(reading, "date");
+    const char *ts = (item && cJSON_IsString(item)) ? item->valuestring : "";
+    memset(out->timestamp, 0, sizeof(out->timestamp));
+    strncpy(out->timestamp, ts, sizeof(out->timestamp) - 1);
+    cJSON_Delete(root);
+    free(data);
+    return true;
+}
+
+// Helper: returns true if two results carry the same weather values
+static bool same_weather(const AW_WeatherData *a, const AW_WeatherData *b) {
+    return a->temperature_f == b->temperature_f && a->humidity == b->humidity &&
+           a->wind_speed_mph == b->wind_speed_mph && a->wind_gust_mph == b->wind_gust_mph &&
+           a->pressure_in == b->pressure_in && a->rainfall_in == b->rainfall_in &&
+           strcmp(a->timestamp, b->timestamp) == 0;
+}
+#endif
+
+static void print_weather(const char *label, const AW_WeatherData *d) {
+    printf("  %-8s tempf %g humidity %g wind %g gust %g baromabsin %g rain %g date \"%s\"\n", label,
+           d->temperature_f, d->humidity, d->wind_speed_mph, d->wind_gust_mph, d->pressure_in,
+           d->rainfall_in, d->timestamp);
+}
+
+/*
+ * Times one fixture. Returns 0 if the scan was complete (and matched cJSON), 1 otherwise.
+ */
+static int bench_fixture(const char *path, int iterations, size_t chunk, bool verbose) {
+    size_t len = 0;
+    char *body = load_file(path, &len);
+    if (!body) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return 1;
+    }
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    AW_WeatherData scanned;
+    memset(&scanned, 0, sizeof(scanned));
+    bool ok = true;
+    double total = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        ok = scan_response(body, len, chunk, &scanned) && ok;
+        total += scanned.temperature_f;
+    }
+    double scan_ns = (double)(now_ns() - start) / iterations;
+    if (!ok) fprintf(stderr, "%s: no complete element 0\n", name);
+
+#ifdef AW_BENCH_CJSON
+    AW_WeatherData parsed;
+    memset(&parsed, 0, sizeof(parsed));
+    bool parsed_ok = true;
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        parsed_ok = parse_response_cjson(body, len, chunk, &parsed) && parsed_ok;
+        total += parsed.temperature_f;
+    }
+    double cjson_ns = (double)(now_ns() - start) / iterations;
+    bool agree = parsed_ok && same_weather(&scanned, &parsed);
+    printf("%-24s %8zu %12.1f %12.1f %7.0f%%  %s\n", name, len, scan_ns, cjson_ns,
+           100.0 * scan_ns / cjson_ns, agree ? "same" : "DIFFERENT");
+    if (verbose || !agree) {
+        print_weather("scanner", &scanned);
+        print_weather("cJSON", &parsed);
+    }
+    ok = ok && agree;
+#else
+    printf("%-24s %8zu %12.1f\n", name, len, scan_ns);
+    if (verbose) print_weather("scanner", &scanned);
+#endif
+    sink = total;
+    free(body);
+    return ok ? 0 : 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options] [FIXTURE...]\n"
+        "  -n COUNT    iterations per fixture (default 10000)\n"
+        "  -c BYTES    bytes per write callback (default %d)\n"
+        "  -v          print the values each path read\n"
+        "Without FIXTURE arguments the recorded responses in %s are used.\n",
+        prog, BENCH_CHUNK_SIZE, AW_BENCH_FIXTURES);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 10000;
+    int chunk = BENCH_CHUNK_SIZE;
+    bool verbose = false;
+    int c;
+    while ((c = getopt(argc, argv, "n:c:vh")) != -1) {
+        switch (c) {
+        case 'n': iterations = atoi(optarg); break;
+        case 'c': chunk = atoi(optarg); break;
+        case 'v': verbose = true; break;
+        default: usage(argv[0]); return c == 'h' ? 0 : 2;
+        }
+    }
+    if (iterations < 1 || chunk < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    printf("iterations: %d, %d bytes per callback\n", iterations, chunk);
+#ifdef AW_BENCH_CJSON
+    printf("%-24s %8s %12s %12s %8s  %s\n", "fixture", "bytes", "scanner ns", "cJSON ns", "ratio", "values");
+#else
+    printf("%-24s %8s %12s  (built without cJSON; no comparison)\n", "fixture", "bytes", "scanner ns");
+#endif
+    int failures = 0;
+    if (optind < argc) {
+        for (int i = optind; i < argc; ++i) failures += bench_fixture(argv[i], iterations, (size_t)chunk, verbose);
+    } else {
+        for (size_t i = 0; i < sizeof(default_fixtures) / sizeof(default_fixtures[0]); ++i) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", AW_BENCH_FIXTURES, default_fixtures[i]);
+            failures += bench_fixture(path, iterations, (size_t)chunk, verbose);
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Project: NightWatcher
+ * File: worker_pool.c
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#include "nightwatcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct {
+    WorkerJobFn fn;
+    void *arg;
+} WorkerJob;
+
+struct WorkerPool {
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;      // Signalled when a job is queued or the pool stops
+    pthread_cond_t idle;           // Signalled when the last running job finishes
+    WorkerJob *jobs;               // Ring buffer of pending jobs
+    unsigned int capacity;
+    unsigned int head;             // Next job to run
+    unsigned int count;            // Jobs queued
+    unsigned int running;          // Jobs currently executing
+    bool stopping;
+    unsigned int nthreads;
+    pthread_t threads[WORKER_POOL_MAX_THREADS];
+};
+
+/*
+ * Worker thread: runs queued jobs until the pool is stopped and the queue is empty.
+ */
+static void *worker_main(void *arg) {
+    WorkerPool *pool = (WorkerPool *)arg;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->count == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->job_ready, &pool->lock);
+        }
+        if (pool->count == 0 && pool->stopping) break;
+        WorkerJob job = pool->jobs[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pool->running++;
+        metrics_gauge_set(METRIC_GAUGE_WORKER_QUEUE, pool->count);
+        pthread_mutex_unlock(&pool->lock);
+
+        job.fn(job.arg);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->running--;
+        if (pool->running == 0 && pool->count == 0) pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+WorkerPool *worker_pool_create(unsigned int nthreads, unsigned int queue_size) {
+    if (nthreads == 0) nthreads = WORKER_POOL_DEFAULT_THREADS;
+    if (nthreads > WORKER_POOL_MAX_THREADS) nthreads = WORKER_POOL_MAX_THREADS;
+    if (queue_size == 0) queue_size = 1;
+    WorkerPool *pool = calloc(1, sizeof(WorkerPool));
+    if (!pool) return NULL;
+    pool->jobs = calloc(queue_size, sizeof(WorkerJob));
+    if (!pool->jobs) {
+        free(pool);
+        return NULL;
+    }
+    pool->capacity = queue_size;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    for (unsigned int i = 0; i < nthreads; ++i) {
+        int err = pthread_create(&pool->threads[i], NULL, worker_main, pool);
+        if (err != 0) {
+            LOGGER_ERROR(LOG_MOD_MAIN, "pthread_create: %s", strerror(err));
+            break;
+        }
+        pool->nthreads++;
+    }
+    if (pool->nthreads == 0) {
+        free(pool->jobs);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int worker_pool_submit(WorkerPool *pool, WorkerJobFn fn, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count == pool->capacity || pool->stopping) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    unsigned int tail = (pool->head + pool->count) % pool->capacity;
+    pool->jobs[tail].fn = fn;
+    pool->jobs[tail].arg = arg;
+    pool->count++;
+    metrics_gauge_set(METRIC_GAUGE_WORKER_QUEUE, pool->count);
+    pthread_cond_signal(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void worker_pool_wait_idle(WorkerPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count > 0 || pool->running > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+unsigned int worker_pool_pending(WorkerPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    unsigned int count = pool->count;
+    pthread_mutex_unlock(&pool->lock);
+    return count;
+}
+
+void worker_pool_destroy(WorkerPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned int i = 0; i < pool->nthreads; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->jobs);
+    free(pool);
+}
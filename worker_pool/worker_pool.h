@@ -0,0 +1,36 @@
+/*
+ * Project: NightWatcher
+ * File: worker_pool.h
+ * Author: David Gilinsky - gilinsky@gilinskyresearch.com
+ * Date: 18 October 2026
+ */
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+
+#define WORKER_POOL_DEFAULT_THREADS 4
+#define WORKER_POOL_MAX_THREADS     64
+
+// A job run on one of the pool's threads
+typedef void (*WorkerJobFn)(void *arg);
+
+typedef struct WorkerPool WorkerPool;
+
+// Starts a pool of nthreads workers sharing a job queue with room for queue_size pending jobs.
+// Returns NULL on error.
+WorkerPool *worker_pool_create(unsigned int nthreads, unsigned int queue_size);
+
+// Queues a job. Returns 0 on success, -1 if the queue is full.
+int worker_pool_submit(WorkerPool *pool, WorkerJobFn fn, void *arg);
+
+// Blocks until the queue is empty and no job is running.
+void worker_pool_wait_idle(WorkerPool *pool);
+
+// Returns the number of jobs queued but not yet started.
+unsigned int worker_pool_pending(WorkerPool *pool);
+
+// Finishes queued jobs, stops the workers, and frees the pool.
+void worker_pool_destroy(WorkerPool *pool);
+
+#endif // WORKER_POOL_H